@@ -0,0 +1,205 @@
+/**
+ * @file fuzzy_match.c
+ * @brief Benchmark of the fuzzy matcher kernels on the city list.
+ *
+ * Usage: bench_fuzzy_match [cities.json] [rounds]
+ *
+ * Pass a saved response of /v2/sholat/kota/semua; without one a list of the
+ * same shape is generated. Every round scores a set of typical queries, as
+ * they look while being typed, against every city name: once with the
+ * byte-at-a-time loop the matcher used to run (behind the same presence
+ * mask check), then with each kernel this CPU supports. Every kernel's
+ * scores are checked against the byte loop.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "lib/json.h"
+#include "utils/fsutils.h"
+#include "utils/fuzzy.h"
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_ROUNDS   200
+#define SYNTHETIC_CITIES 517
+
+static const char *const queries[] = {"k",     "ka",        "kab",    "kab.", "kab. b", "kota",
+                                      "jak",   "jakarta",   "bdg",    "sby",  "mlg",    "aceh",
+                                      "utara", "kota band", "xyz",    "pa",   "pasir",  "lampung"};
+
+#define QUERY_COUNT ((int)(sizeof(queries) / sizeof(queries[0])))
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/* The matcher as it was: one byte per iteration */
+static double bytewise_score(const struct fuzzy_entry *entry, const char *pattern, int patternl) {
+  const char *str = entry->lower;
+  const int strl = entry->length;
+
+  if (patternl == 0)
+    return 0.0;
+
+  double score = 0.0;
+  int si = 0, pi = 0, consecutive = 0;
+
+  while (si < strl && pi < patternl) {
+    if (str[si] == pattern[pi]) {
+      double s = 10.0 + consecutive * 5.0;
+      if (entry->word_end[si])
+        s += 15.0;
+      score += s;
+      consecutive++;
+      pi++;
+    } else {
+      score -= 1.0;
+      consecutive = 0;
+    }
+
+    si++;
+    if (strl - si < patternl - pi)
+      break;
+  }
+
+  if (pi < patternl)
+    return -DBL_MAX;
+  return score;
+}
+
+static char **load_names(const char *path, int *count) {
+  char **names = NULL;
+  int n = 0;
+
+  if (path == NULL) {
+    static const char *const prefixes[] = {"KAB. ", "KOTA "};
+    static const char *const words[] = {"ACEH",    "BANDUNG", "JAKARTA", "LAMPUNG",   "MALANG",
+                                        "SURABAYA", "PASIR",   "UTARA",   "SELATAN",   "BARAT",
+                                        "TIMUR",   "TENGAH",  "KEPULAUAN", "SERIBU", "BANYUASIN"};
+    names = malloc(sizeof(char *) * SYNTHETIC_CITIES);
+    for (int i = 0; names && i < SYNTHETIC_CITIES; i++) {
+      char name[64];
+      snprintf(name, sizeof(name), "%s%s %s", prefixes[i % 2], words[i % 15], words[(i / 15) % 15]);
+      names[n++] = strdup(name);
+    }
+    *count = n;
+    return names;
+  }
+
+  char *json = read_file(path, NULL);
+  JsonNode *root = json ? json_decode(json) : NULL;
+  JsonNode *data = json_find_member(root, "data");
+  if (data == NULL || data->tag != JSON_ARRAY) {
+    fprintf(stderr, "%s has no data array\n", path);
+    json_delete(root);
+    free(json);
+    return NULL;
+  }
+
+  JsonNode *city;
+  int cap = 0;
+  json_foreach(city, data) { cap++; }
+  names = malloc(sizeof(char *) * (cap ? cap : 1));
+  json_foreach(city, data) {
+    JsonNode *lokasi = json_find_member(city, "lokasi");
+    if (names && lokasi && lokasi->tag == JSON_STRING)
+      names[n++] = strdup(lokasi->string_);
+  }
+
+  json_delete(root);
+  free(json);
+  *count = n;
+  return names;
+}
+
+int main(int argc, char *argv[]) {
+  int count = 0;
+  char **names = load_names(argc > 1 ? argv[1] : NULL, &count);
+  int rounds = argc > 2 ? atoi(argv[2]) : DEFAULT_ROUNDS;
+  if (names == NULL || count == 0 || rounds <= 0) {
+    fprintf(stderr, "usage: %s [cities.json] [rounds]\n", argv[0]);
+    return 1;
+  }
+
+  struct fuzzy_entry *entries = malloc(sizeof(struct fuzzy_entry) * count);
+  const struct fuzzy_entry **pointers = malloc(sizeof(struct fuzzy_entry *) * count);
+  double *expected = malloc(sizeof(double) * count * QUERY_COUNT);
+  double *scores = malloc(sizeof(double) * count);
+  char **storage = malloc(sizeof(char *) * count);
+  for (int i = 0; i < count; i++) {
+    int length = strlen(names[i]);
+    storage[i] = malloc(FUZZY_ENTRY_SIZE(length));
+    fuzzy_entry_init(&entries[i], names[i], length, storage[i]);
+    pointers[i] = &entries[i];
+  }
+
+  double pairs = (double)rounds * count * QUERY_COUNT;
+  size_t hits = 0;
+
+  printf("%s: %d names, %d queries, %d rounds\n", argc > 1 ? argv[1] : "synthetic city list",
+         count, QUERY_COUNT, rounds);
+
+  double start = now_ns();
+  for (int r = 0; r < rounds; r++) {
+    for (int q = 0; q < QUERY_COUNT; q++) {
+      int patternl = strlen(queries[q]);
+      uint64_t need = fuzzy_pattern_mask(queries[q], patternl);
+      for (int i = 0; i < count; i++) {
+        expected[q * count + i] = (entries[i].mask & need) == need
+                                      ? bytewise_score(&entries[i], queries[q], patternl)
+                                      : -DBL_MAX;
+      }
+    }
+  }
+  printf("  %-8s %8.2f ns/item\n", "bytewise", (now_ns() - start) / pairs);
+
+  static const enum fuzzy_kernel kernels[] = {FUZZY_KERNEL_SCALAR, FUZZY_KERNEL_SSE2,
+                                              FUZZY_KERNEL_AVX2, FUZZY_KERNEL_NEON};
+  int status = 0;
+  for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+    if (fuzzy_set_kernel(kernels[k]) < 0)
+      continue;
+
+    int mismatches = 0;
+    start = now_ns();
+    for (int r = 0; r < rounds; r++) {
+      for (int q = 0; q < QUERY_COUNT; q++) {
+        int patternl = strlen(queries[q]);
+        for (int i = 0; i < count; i += FUZZY_BATCH) {
+          int n = count - i < FUZZY_BATCH ? count - i : FUZZY_BATCH;
+          fuzzy_match_batch(pointers + i, n, queries[q], patternl, scores + i);
+        }
+        if (r == 0) {
+          for (int i = 0; i < count; i++) {
+            mismatches += scores[i] != expected[q * count + i];
+            hits += scores[i] != -DBL_MAX;
+          }
+        }
+      }
+    }
+    double elapsed = now_ns() - start;
+
+    printf("  %-8s %8.2f ns/item%s\n", fuzzy_kernel_name(), elapsed / pairs,
+           mismatches ? "  SCORE MISMATCH" : "");
+    if (mismatches)
+      status = 1;
+  }
+  printf("  (%zu matches)\n", hits);
+
+  for (int i = 0; i < count; i++) {
+    free(storage[i]);
+    free(names[i]);
+  }
+  free(storage);
+  free(names);
+  free(entries);
+  free(pointers);
+  free(expected);
+  free(scores);
+  return status;
+}
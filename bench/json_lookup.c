@@ -0,0 +1,144 @@
+/**
+ * @file json_lookup.c
+ * @brief Benchmark of json_find_member() on the city list payload.
+ *
+ * Usage: bench_json_lookup [payload.json] [rounds]
+ *
+ * Pass a saved response of /v2/sholat/kota/semua (for example
+ * `curl -s https://api.myquran.com/v2/sholat/kota/semua > cities.json`);
+ * without one a payload of the same shape is generated. Every round looks
+ * up "id" and "lokasi" in each city object, once with a plain strcmp scan
+ * (the previous implementation) and once with json_find_member(). A
+ * generated month schedule, whose entries have ten members, is measured
+ * the same way with the seven keys the prayer parser reads.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "lib/json.h"
+#include "utils/fsutils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_ROUNDS 2000
+#define SYNTHETIC_CITIES 517
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static char *synthetic_payload(void) {
+  size_t cap = 64 + SYNTHETIC_CITIES * 64;
+  char *json = malloc(cap);
+  if (json == NULL)
+    return NULL;
+
+  size_t len = (size_t)snprintf(json, cap, "{\"status\":true,\"data\":[");
+  for (int i = 0; i < SYNTHETIC_CITIES; i++) {
+    len += (size_t)snprintf(json + len, cap - len, "%s{\"id\":\"%04d\",\"lokasi\":\"KAB. KOTA %d\"}",
+                            i ? "," : "", 1101 + i, i);
+  }
+  snprintf(json + len, cap - len, "]}");
+  return json;
+}
+
+static char *synthetic_schedule(void) {
+  size_t cap = 64 + 31 * 256;
+  char *json = malloc(cap);
+  if (json == NULL)
+    return NULL;
+
+  size_t len = (size_t)snprintf(json, cap, "{\"status\":true,\"data\":{\"jadwal\":[");
+  for (int day = 1; day <= 31; day++) {
+    len += (size_t)snprintf(json + len, cap - len,
+                            "%s{\"tanggal\":\"Kamis, %02d/01/2026\",\"imsak\":\"04:14\","
+                            "\"subuh\":\"04:24\",\"terbit\":\"05:42\",\"dhuha\":\"06:10\","
+                            "\"dzuhur\":\"11:58\",\"ashar\":\"15:24\",\"maghrib\":\"18:13\","
+                            "\"isya\":\"19:28\",\"date\":\"2026-01-%02d\"}",
+                            day > 1 ? "," : "", day, day);
+  }
+  snprintf(json + len, cap - len, "]}}");
+  return json;
+}
+
+static JsonNode *linear_find_member(JsonNode *object, const char *name) {
+  JsonNode *member;
+  json_foreach(member, object) {
+    if (strcmp(member->key, name) == 0)
+      return member;
+  }
+  return NULL;
+}
+
+/* Look up every key in every object of @array, @rounds times */
+static void bench_array(const char *label, JsonNode *array, const char *const *keys, int nkeys,
+                        int rounds) {
+  size_t objects = 0, found = 0;
+  JsonNode *object;
+  json_foreach(object, array) { objects++; }
+
+  double start = now_ns();
+  for (int r = 0; r < rounds; r++) {
+    json_foreach(object, array) {
+      for (int k = 0; k < nkeys; k++)
+        found += linear_find_member(object, keys[k]) != NULL;
+    }
+  }
+  double linear = now_ns() - start;
+
+  start = now_ns();
+  for (int r = 0; r < rounds; r++) {
+    json_foreach(object, array) {
+      for (int k = 0; k < nkeys; k++)
+        found += json_find_member(object, keys[k]) != NULL;
+    }
+  }
+  double hashed = now_ns() - start;
+
+  double lookups = (double)rounds * (double)objects * nkeys;
+  printf("%s: %zu objects, %d keys, %d rounds\n", label, objects, nkeys, rounds);
+  printf("  strcmp scan:      %8.2f ns/lookup\n", linear / lookups);
+  printf("  json_find_member: %8.2f ns/lookup\n", hashed / lookups);
+  printf("  (%zu hits)\n", found);
+}
+
+int main(int argc, char *argv[]) {
+  char *json = argc > 1 ? read_file(argv[1], NULL) : synthetic_payload();
+  int rounds = argc > 2 ? atoi(argv[2]) : DEFAULT_ROUNDS;
+  if (json == NULL || rounds <= 0) {
+    fprintf(stderr, "usage: %s [payload.json] [rounds]\n", argv[0]);
+    free(json);
+    return 1;
+  }
+
+  JsonNode *root = json_decode(json);
+  JsonNode *data = json_find_member(root, "data");
+  if (data == NULL || data->tag != JSON_ARRAY) {
+    fprintf(stderr, "payload has no data array\n");
+    json_delete(root);
+    free(json);
+    return 1;
+  }
+
+  static const char *const city_keys[] = {"id", "lokasi"};
+  bench_array(argc > 1 ? argv[1] : "synthetic city list", data, city_keys, 2, rounds);
+  json_delete(root);
+  free(json);
+
+  json = synthetic_schedule();
+  root = json_decode(json);
+  JsonNode *jadwal = json_find_member(json_find_member(root, "data"), "jadwal");
+  if (jadwal != NULL) {
+    static const char *const day_keys[] = {"date",   "subuh",   "dhuha", "dzuhur",
+                                           "ashar", "maghrib", "isya"};
+    bench_array("synthetic month schedule", jadwal, day_keys, 7, rounds * 10);
+  }
+
+  json_delete(root);
+  free(json);
+  return 0;
+}
@@ -0,0 +1,755 @@
+/**
+ * @file muslimkit_bench.c
+ * @brief Benchmark suite of the parsing, filtering and rendering paths.
+ *
+ * Usage: muslimkit_bench [-f DIR] [-r RUNS] [-k KEYS] [CASE...]
+ *
+ * Every case is timed over many runs, after a few warmup runs, and reported
+ * as median and p99 per run together with the heap allocations one run
+ * makes, so two builds can be compared line by line. The city cases run on
+ * the API payload and on generated lists of 1k, 10k and 100k cities:
+ *
+ * - json_decode         json_decode() and json_delete() of the city list
+ * - json_in_situ        json_decode_in_situ() of a copy of the city list into
+ *                       an arena, the copy included
+ * - parse_cities        parse_cities_json(), streaming into struct cities_s
+ * - parse_schedule      parse_prayer_times_json() of a month (API payload only)
+ * - http_chunked        http_parser_feed() of the chunked city list response
+ *                       in 16 KB reads; http_gzip the same, gzip encoded
+ * - fuzzy_score         fuzzy_score() of every name for one query
+ * - list_filter         list_filter() over the items for one query
+ * - search_filter       search_index_filter() of a query typed a key at a time
+ * - listview_key        listview_from_source() on a pseudo terminal: time from
+ *                       writing a Down key to the first byte of the new frame,
+ *                       and the bytes the frame takes
+ *
+ * API payloads are read from DIR (default bench/fixtures), as recorded by
+ * bench/record_fixtures.sh; without them payloads of the same shape and
+ * size are generated. Naming cases only runs those. -r fixes the number of
+ * runs, otherwise each case runs for about BENCH_TIME_NS.
+ */
+
+#define _GNU_SOURCE /* posix_openpt, ptsname */
+#define TB_IMPL
+
+#include "domain/get_cities.h"
+#include "domain/get_prayer_times.h"
+#include "lib/json.h"
+#include "network/http_parser.h"
+#include "presentation/uikit.h"
+#include "utils/arena.h"
+#include "utils/fsutils.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <time.h>
+#ifdef MUSLIMKIT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifndef MUSLIMKIT_BENCH_FIXTURES
+#define MUSLIMKIT_BENCH_FIXTURES "bench/fixtures"
+#endif
+
+#define BENCH_WARMUP   3
+#define BENCH_MIN_RUNS 15
+#define BENCH_MAX_RUNS 10000
+#define BENCH_TIME_NS  300e6 /**< Time an unbounded case runs for */
+#define API_CITIES     517   /**< Cities of the API list, for a generated payload */
+#define READ_SIZE      16384 /**< Bytes per http_parser_feed(), about a TLS record */
+#define CHUNK_SIZE_MAX 8192  /**< Largest chunk of a generated chunked body */
+#define DEFAULT_KEYS   200   /**< Down keys a listview_key session sends */
+#define TERM_WIDTH     120
+#define TERM_HEIGHT    40
+
+static const char *const queries[] = {"kab", "jak", "kota band", "utara", "xyz"};
+
+#define QUERY_COUNT ((int)(sizeof(queries) / sizeof(queries[0])))
+
+/* Allocations are counted when the build wraps malloc, see CMakeLists.txt */
+#ifdef BENCH_COUNT_ALLOCS
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static size_t alloc_count;
+
+void *__wrap_malloc(size_t size) {
+  __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+  return __real_realloc(ptr, size);
+}
+
+static size_t allocations(void) { return __atomic_load_n(&alloc_count, __ATOMIC_RELAXED); }
+#else
+static size_t allocations(void) { return 0; }
+#endif
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * @brief Growable byte buffer for the generated payloads.
+ */
+struct buffer {
+  char *data;
+  size_t len;
+  size_t cap;
+};
+
+static void buffer_printf(struct buffer *buf, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void buffer_printf(struct buffer *buf, const char *format, ...) {
+  for (;;) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf->data + buf->len, buf->cap - buf->len, format, args);
+    va_end(args);
+    if (n < 0)
+      return;
+    if (buf->len + (size_t)n < buf->cap) {
+      buf->len += (size_t)n;
+      return;
+    }
+
+    size_t cap = buf->cap ? buf->cap * 2 : 4096;
+    while (cap <= buf->len + (size_t)n)
+      cap *= 2;
+    char *data = realloc(buf->data, cap);
+    if (data == NULL) {
+      fprintf(stderr, "bench cannot allocate %zu bytes\n", cap);
+      exit(1);
+    }
+    buf->data = data;
+    buf->cap = cap;
+  }
+}
+
+static void buffer_append(struct buffer *buf, const char *data, size_t len) {
+  if (buf->len + len >= buf->cap) {
+    size_t cap = buf->cap ? buf->cap : 4096;
+    while (cap <= buf->len + len)
+      cap *= 2;
+    char *grown = realloc(buf->data, cap);
+    if (grown == NULL) {
+      fprintf(stderr, "bench cannot allocate %zu bytes\n", cap);
+      exit(1);
+    }
+    buf->data = grown;
+    buf->cap = cap;
+  }
+  memcpy(buf->data + buf->len, data, len);
+  buf->len += len;
+  buf->data[buf->len] = '\0';
+}
+
+/* xorshift32, so every run generates the same lists */
+static uint32_t random_next(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+/**
+ * @brief City list response of @p count cities named like the API's.
+ */
+static char *generate_cities(int count) {
+  static const char *const syllables[] = {"BA", "TU", "NG", "SU", "MA", "DEN", "KA", "RA",
+                                          "JA", "WA", "LO", "PA", "SI", "GO", "RI", "BE"};
+  static const char *const suffixes[] = {"", " UTARA", " SELATAN", " BARAT", " TIMUR", " TENGAH"};
+  uint32_t state = 2463534242u;
+
+  struct buffer buf = {0};
+  buffer_printf(&buf, "{\"status\":true,\"request\":{\"path\":\"/sholat/kota/semua\"},\"data\":[");
+  for (int i = 0; i < count; i++) {
+    char name[64] = "";
+    int len = 0;
+    int parts = 2 + random_next(&state) % 3;
+    for (int p = 0; p < parts; p++)
+      len += snprintf(name + len, sizeof(name) - len, "%s", syllables[random_next(&state) % 16]);
+    buffer_printf(&buf, "%s{\"id\":\"%04d\",\"lokasi\":\"%s %s%s\"}", i ? "," : "", 1101 + i,
+                  i % 3 ? "KAB." : "KOTA", name, suffixes[random_next(&state) % 6]);
+  }
+  buffer_printf(&buf, "]}");
+  return buf.data;
+}
+
+/**
+ * @brief Month schedule response of the API's shape.
+ */
+static char *generate_schedule(void) {
+  static const char *const days[] = {"Kamis", "Jumat", "Sabtu", "Minggu", "Senin", "Selasa",
+                                     "Rabu"};
+
+  struct buffer buf = {0};
+  buffer_printf(&buf, "{\"status\":true,\"request\":{\"path\":\"/sholat/jadwal/1301/2026/1\","
+                      "\"year\":\"2026\",\"month\":\"1\"},\"data\":{\"id\":1301,"
+                      "\"lokasi\":\"KOTA JAKARTA\",\"daerah\":\"DKI JAKARTA\",\"koordinat\":"
+                      "{\"lat\":-6.1744651,\"lon\":106.822745,\"lintang\":\"6° 10' 28.07\\\" LS\","
+                      "\"bujur\":\"106° 49' 21.88\\\" BT\"},\"jadwal\":[");
+  for (int day = 1; day <= 31; day++) {
+    int m = day / 4;
+    buffer_printf(&buf,
+                  "%s{\"tanggal\":\"%s, %02d/01/2026\",\"imsak\":\"04:%02d\",\"subuh\":\"04:%02d\","
+                  "\"terbit\":\"05:%02d\",\"dhuha\":\"06:%02d\",\"dzuhur\":\"11:%02d\","
+                  "\"ashar\":\"15:%02d\",\"maghrib\":\"18:%02d\",\"isya\":\"19:%02d\","
+                  "\"date\":\"2026-01-%02d\"}",
+                  day > 1 ? "," : "", days[(day - 1) % 7], day, 10 + m, 20 + m, 38 + m, 6 + m,
+                  50 + m, 14 + m, 5 + m, 20 + m, day);
+  }
+  buffer_printf(&buf, "]}}");
+  return buf.data;
+}
+
+/**
+ * @brief The body as a chunked HTTP response, chunks of varying size.
+ */
+static struct buffer chunked_response(const char *body, size_t len, const char *encoding) {
+  struct buffer buf = {0};
+  buffer_printf(&buf, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n%s%s%s"
+                      "Transfer-Encoding: chunked\r\n\r\n",
+                encoding ? "Content-Encoding: " : "", encoding ? encoding : "",
+                encoding ? "\r\n" : "");
+
+  uint32_t state = 88675123u;
+  for (size_t at = 0; at < len;) {
+    size_t size = 512 + random_next(&state) % (CHUNK_SIZE_MAX - 512);
+    if (size > len - at)
+      size = len - at;
+    buffer_printf(&buf, "%zx\r\n", size);
+    buffer_append(&buf, body + at, size);
+    buffer_printf(&buf, "\r\n");
+    at += size;
+  }
+  buffer_printf(&buf, "0\r\n\r\n");
+  return buf;
+}
+
+#ifdef MUSLIMKIT_HAVE_ZLIB
+static struct buffer gzip_compress(const char *data, size_t len) {
+  struct buffer out = {0};
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) !=
+      Z_OK)
+    return out;
+
+  out.cap = deflateBound(&stream, len) + 1;
+  out.data = malloc(out.cap);
+  if (out.data == NULL) {
+    deflateEnd(&stream);
+    return out;
+  }
+
+  stream.next_in = (Bytef *)data;
+  stream.avail_in = (uInt)len;
+  stream.next_out = (Bytef *)out.data;
+  stream.avail_out = (uInt)out.cap;
+  deflate(&stream, Z_FINISH);
+  out.len = stream.total_out;
+  deflateEnd(&stream);
+  return out;
+}
+#endif
+
+static int count_body(void *user, const char *data, size_t len) {
+  (void)data;
+  *(size_t *)user += len;
+  return 0;
+}
+
+/**
+ * @brief Parse a whole response in READ_SIZE reads.
+ *
+ * @return Body bytes delivered, 0 if the response did not parse.
+ */
+static size_t feed_response(const struct buffer *response) {
+  size_t body = 0;
+  struct http_parser parser;
+  http_parser_init(&parser, count_body, &body);
+
+  int state = 0;
+  for (size_t at = 0; state == 0 && at < response->len;) {
+    size_t len = response->len - at < READ_SIZE ? response->len - at : READ_SIZE;
+    size_t consumed = 0;
+    state = http_parser_feed(&parser, response->data + at, len, &consumed);
+    at += consumed;
+  }
+  http_parser_free(&parser);
+  return state == 1 ? body : 0;
+}
+
+/**
+ * @brief A city list, in every form the cases take it in.
+ */
+struct dataset {
+  char name[32];
+  char *json;
+  size_t json_len;
+  struct cities_s cities;
+  struct listview_item *items;   /**< Items of cities, in list order */
+  struct listview_item *scratch; /**< Copy list_filter() reorders */
+  struct buffer chunked;
+  struct buffer gzipped; /**< Chunked, gzip encoded; empty without zlib */
+};
+
+static int dataset_init(struct dataset *set, const char *name, char *json) {
+  memset(set, 0, sizeof(*set));
+  snprintf(set->name, sizeof(set->name), "%s", name);
+  set->json = json;
+  set->json_len = strlen(json);
+
+  if (parse_cities_json(json, &set->cities) < 0 || set->cities.size == 0) {
+    fprintf(stderr, "%s: not a city list\n", name);
+    return -1;
+  }
+
+  set->items = malloc(sizeof(struct listview_item) * set->cities.size);
+  set->scratch = malloc(sizeof(struct listview_item) * set->cities.size);
+  if (set->items == NULL || set->scratch == NULL)
+    return -1;
+  for (size_t i = 0; i < set->cities.size; i++) {
+    set->items[i].id = set->cities.data[i].id;
+    set->items[i].name = set->cities.data[i].lokasi;
+  }
+
+  // The responses must decode to the payload, or their cases measure an error path
+  set->chunked = chunked_response(json, set->json_len, NULL);
+  if (feed_response(&set->chunked) != set->json_len) {
+    fprintf(stderr, "%s: chunked response does not parse\n", name);
+    return -1;
+  }
+#ifdef MUSLIMKIT_HAVE_ZLIB
+  struct buffer gz = gzip_compress(json, set->json_len);
+  if (gz.len > 0)
+    set->gzipped = chunked_response(gz.data, gz.len, "gzip");
+  free(gz.data);
+  if (set->gzipped.len > 0 && feed_response(&set->gzipped) != set->json_len) {
+    fprintf(stderr, "%s: gzip response does not parse\n", name);
+    return -1;
+  }
+#endif
+  return 0;
+}
+
+static void dataset_free(struct dataset *set) {
+  get_city_free(&set->cities);
+  free(set->json);
+  free(set->items);
+  free(set->scratch);
+  free(set->chunked.data);
+  free(set->gzipped.data);
+}
+
+/**
+ * @brief Settings of the whole suite.
+ */
+struct bench_options {
+  int runs;             /**< Runs per case, 0 for timed */
+  int keys;             /**< Keys of a listview_key session */
+  char *const *only;    /**< Cases to run, NULL for all */
+  int only_count;
+};
+
+static bool selected(const struct bench_options *options, const char *name) {
+  if (options->only == NULL)
+    return true;
+  for (int i = 0; i < options->only_count; i++) {
+    if (strcmp(options->only[i], name) == 0)
+      return true;
+  }
+  return false;
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int count, double p) {
+  int rank = (int)(p * count + 0.999999) - 1;
+  if (rank < 0)
+    rank = 0;
+  if (rank >= count)
+    rank = count - 1;
+  return sorted[rank];
+}
+
+static void print_time(double ns) {
+  if (ns < 1e4)
+    printf(" %9.1f ns", ns);
+  else if (ns < 1e7)
+    printf(" %9.1f us", ns / 1e3);
+  else
+    printf(" %9.1f ms", ns / 1e6);
+}
+
+/**
+ * @brief Print one line of results from unsorted samples.
+ *
+ * @param allocs  Allocations per sample, negative when not counted.
+ * @param extra   Trailing column (throughput, bytes), may be NULL.
+ */
+static void report(const char *name, const char *dataset, double *samples, int count,
+                   double allocs, const char *extra) {
+  qsort(samples, count, sizeof(double), compare_double);
+  printf("%-16s %-12s %6d", name, dataset, count);
+  print_time(percentile(samples, count, 0.5));
+  print_time(percentile(samples, count, 0.99));
+#ifndef BENCH_COUNT_ALLOCS
+  allocs = -1;
+#endif
+  if (allocs >= 0)
+    printf(" %10.1f", allocs);
+  else
+    printf(" %10s", "-");
+  printf("  %s\n", extra ? extra : "");
+}
+
+typedef void (*bench_fn)(void *ctx);
+
+/**
+ * @brief Time fn(ctx) and report it.
+ *
+ * @param bytes  Input bytes of a run, for a throughput column; 0 for none.
+ */
+static void bench_run(const struct bench_options *options, const char *name, const char *dataset,
+                      bench_fn fn, void *ctx, size_t bytes) {
+  for (int i = 0; i < BENCH_WARMUP; i++)
+    fn(ctx);
+
+  int capacity = options->runs ? options->runs : BENCH_MAX_RUNS;
+  double *samples = malloc(sizeof(double) * capacity);
+  if (samples == NULL)
+    return;
+
+  size_t allocs_before = allocations();
+  double started = now_ns();
+  int count = 0;
+  while (count < capacity) {
+    double start = now_ns();
+    fn(ctx);
+    samples[count++] = now_ns() - start;
+    if (!options->runs && count >= BENCH_MIN_RUNS && now_ns() - started >= BENCH_TIME_NS)
+      break;
+  }
+  double allocs = (double)(allocations() - allocs_before) / count;
+
+  char extra[64] = "";
+  if (bytes > 0) {
+    double total = 0;
+    for (int i = 0; i < count; i++)
+      total += samples[i];
+    snprintf(extra, sizeof(extra), "%8.1f MB/s", (double)bytes * count / total * 1e3);
+  }
+  report(name, dataset, samples, count, allocs, bytes > 0 ? extra : NULL);
+  free(samples);
+}
+
+static void case_json_decode(void *ctx) {
+  const struct dataset *set = ctx;
+  json_delete(json_decode(set->json));
+}
+
+struct in_situ_run {
+  const struct dataset *set;
+  char *buffer; /**< json_len + 1 bytes, overwritten by every run */
+};
+
+static void case_json_in_situ(void *ctx) {
+  struct in_situ_run *run = ctx;
+  struct arena arena;
+  arena_init(&arena, 0);
+  memcpy(run->buffer, run->set->json, run->set->json_len + 1);
+  json_decode_in_situ(run->buffer, &arena);
+  arena_free(&arena);
+}
+
+static void case_parse_cities(void *ctx) {
+  const struct dataset *set = ctx;
+  struct cities_s cities;
+  parse_cities_json(set->json, &cities);
+  get_city_free(&cities);
+}
+
+static void case_parse_schedule(void *ctx) {
+  struct prayer_times prayer_t;
+  if (parse_prayer_times_json(ctx, &prayer_t) == 0)
+    get_prayer_times_free(&prayer_t);
+}
+
+static void case_http_chunked(void *ctx) { feed_response(&((const struct dataset *)ctx)->chunked); }
+
+static void case_http_gzip(void *ctx) { feed_response(&((const struct dataset *)ctx)->gzipped); }
+
+/* Keeps the scores observable, so the calls are not optimized away */
+static volatile double score_sink;
+
+static void case_fuzzy_score(void *ctx) {
+  const struct dataset *set = ctx;
+  double sum = 0;
+  for (size_t i = 0; i < set->cities.size; i++)
+    sum += fuzzy_score(set->items[i].name, "jak");
+  score_sink = sum;
+}
+
+static void case_list_filter(void *ctx) {
+  const struct dataset *set = ctx;
+  memcpy(set->scratch, set->items, sizeof(struct listview_item) * set->cities.size);
+  list_filter(set->scratch, (int)set->cities.size, "kota band");
+}
+
+/**
+ * @brief Index of a dataset, filtered as if every query were typed in turn.
+ */
+struct search_run {
+  struct search_index index;
+};
+
+static void case_search_filter(void *ctx) {
+  struct search_run *run = ctx;
+  char typed[32];
+  for (int q = 0; q < QUERY_COUNT; q++) {
+    size_t len = strlen(queries[q]);
+    for (size_t i = 1; i <= len && i < sizeof(typed); i++) {
+      memcpy(typed, queries[q], i);
+      typed[i] = '\0';
+      search_index_filter(&run->index, typed);
+      search_index_rank(&run->index, TERM_HEIGHT);
+    }
+  }
+  search_index_filter(&run->index, "");
+}
+
+static int city_count(void *ctx) { return (int)((const struct cities_s *)ctx)->size; }
+
+static int city_get_item(void *ctx, int index, struct listview_item *dest) {
+  const struct cities_s *cities = ctx;
+  if (index < 0 || (size_t)index >= cities->size)
+    return -1;
+  dest->id = cities->data[index].id;
+  dest->name = cities->data[index].lokasi;
+  return 0;
+}
+
+/**
+ * @brief Read what the child draws until it stays quiet for @p quiet_ms.
+ *
+ * @return Bytes read, -1 when the terminal closed.
+ */
+static long drain(int master, int quiet_ms) {
+  long total = 0;
+  char buf[65536];
+  struct pollfd fd = {.fd = master, .events = POLLIN};
+  while (poll(&fd, 1, quiet_ms) > 0) {
+    ssize_t n = read(master, buf, sizeof(buf));
+    if (n <= 0)
+      return total > 0 ? total : -1;
+    total += n;
+  }
+  return total;
+}
+
+/**
+ * @brief Run the city listview in a child on a pseudo terminal and scroll it.
+ *
+ * The child makes the pseudo terminal its controlling terminal, so the
+ * /dev/tty termbox opens is the one written to here.
+ */
+static void bench_listview(const struct bench_options *options, const struct dataset *set) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+    perror("bench listview pty");
+    return;
+  }
+  struct winsize size = {TERM_HEIGHT, TERM_WIDTH, 0, 0};
+  ioctl(master, TIOCSWINSZ, &size);
+  const char *slave_name = ptsname(master);
+
+  fflush(NULL);
+  double start = now_ns();
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("bench listview fork");
+    close(master);
+    return;
+  }
+
+  if (pid == 0) {
+    setsid();
+    int slave = open(slave_name, O_RDWR);
+    if (slave < 0)
+      _exit(1);
+    dup2(slave, STDIN_FILENO);
+    dup2(slave, STDOUT_FILENO);
+    close(master);
+    setenv("TERM", "xterm-256color", 0);
+
+    struct listview_source source = {(void *)&set->cities, city_count, city_get_item, NULL, NULL,
+                                     -1};
+    int chosen = 0;
+    listview_from_source("Choice your city", &source, &chosen);
+    _exit(chosen >= 0 ? 0 : 1);
+  }
+
+  struct pollfd ready = {.fd = master, .events = POLLIN};
+  if (poll(&ready, 1, 5000) <= 0) {
+    fprintf(stderr, "listview_key: %s: no frame drawn\n", set->name);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    close(master);
+    return;
+  }
+  double startup = now_ns() - start;
+  long first = drain(master, 50);
+
+  int keys = options->runs ? options->runs : options->keys;
+  double *samples = malloc(sizeof(double) * keys);
+  int count = 0;
+  long bytes = 0;
+  for (; samples != NULL && count < keys; count++) {
+    struct pollfd fd = {.fd = master, .events = POLLIN};
+    double sent = now_ns();
+    if (write(master, "\x1b[B", 3) != 3 || poll(&fd, 1, 1000) <= 0)
+      break;
+    samples[count] = now_ns() - sent;
+
+    long frame = drain(master, 5);
+    if (frame < 0)
+      break;
+    bytes += frame;
+  }
+
+  if (write(master, "\r", 1) == 1)
+    drain(master, 200);
+  close(master);
+  waitpid(pid, NULL, 0);
+
+  if (count > 0) {
+    char extra[64];
+    snprintf(extra, sizeof(extra), "%6.0f B/frame, first frame %ld B in %.1f ms",
+             (double)bytes / count, first, startup / 1e6);
+    // The allocations happen in the child, out of reach of the counter
+    report("listview_key", set->name, samples, count, -1, extra);
+  }
+  free(samples);
+}
+
+static void bench_dataset(const struct bench_options *options, struct dataset *set) {
+  if (selected(options, "json_decode"))
+    bench_run(options, "json_decode", set->name, case_json_decode, set, set->json_len);
+  if (selected(options, "json_in_situ")) {
+    struct in_situ_run run = {set, malloc(set->json_len + 1)};
+    if (run.buffer != NULL) {
+      bench_run(options, "json_in_situ", set->name, case_json_in_situ, &run, set->json_len);
+      free(run.buffer);
+    }
+  }
+  if (selected(options, "parse_cities"))
+    bench_run(options, "parse_cities", set->name, case_parse_cities, set, set->json_len);
+  if (selected(options, "http_chunked"))
+    bench_run(options, "http_chunked", set->name, case_http_chunked, set, set->chunked.len);
+  if (set->gzipped.len > 0 && selected(options, "http_gzip"))
+    bench_run(options, "http_gzip", set->name, case_http_gzip, set, set->gzipped.len);
+  if (selected(options, "fuzzy_score"))
+    bench_run(options, "fuzzy_score", set->name, case_fuzzy_score, set, 0);
+  if (selected(options, "list_filter"))
+    bench_run(options, "list_filter", set->name, case_list_filter, set, 0);
+
+  if (selected(options, "search_filter")) {
+    struct search_run run;
+    if (search_index_build(&run.index, set->items, (int)set->cities.size) == 0) {
+      bench_run(options, "search_filter", set->name, case_search_filter, &run, 0);
+      search_index_free(&run.index);
+    }
+  }
+
+  if (selected(options, "listview_key"))
+    bench_listview(options, set);
+}
+
+int main(int argc, char *argv[]) {
+  const char *fixtures = MUSLIMKIT_BENCH_FIXTURES;
+  struct bench_options options = {0, DEFAULT_KEYS, NULL, 0};
+
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    if (strcmp(argv[arg], "-f") == 0 && arg + 1 < argc) {
+      fixtures = argv[++arg];
+    } else if (strcmp(argv[arg], "-r") == 0 && arg + 1 < argc) {
+      options.runs = atoi(argv[++arg]);
+    } else if (strcmp(argv[arg], "-k") == 0 && arg + 1 < argc) {
+      options.keys = atoi(argv[++arg]);
+    } else {
+      arg = argc + 1;
+    }
+  }
+  if (arg > argc || options.runs < 0 || options.runs > BENCH_MAX_RUNS || options.keys <= 0) {
+    fprintf(stderr, "usage: %s [-f DIR] [-r RUNS] [-k KEYS] [CASE...]\n", argv[0]);
+    return 1;
+  }
+  if (arg < argc) {
+    options.only = argv + arg;
+    options.only_count = argc - arg;
+  }
+
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/cities.json", fixtures);
+  char *api_cities = read_file(path, NULL);
+  bool recorded = api_cities != NULL;
+  if (!recorded)
+    api_cities = generate_cities(API_CITIES);
+
+  snprintf(path, sizeof(path), "%s/jadwal.json", fixtures);
+  char *schedule = read_file(path, NULL);
+  bool schedule_recorded = schedule != NULL;
+  if (!schedule_recorded)
+    schedule = generate_schedule();
+
+  printf("fixtures: %s (cities %s, schedule %s)\n", fixtures, recorded ? "recorded" : "generated",
+         schedule_recorded ? "recorded" : "generated");
+  printf("%-16s %-12s %6s %12s %12s %10s\n", "case", "dataset", "runs", "median", "p99",
+         "allocs");
+
+  static const struct {
+    const char *name;
+    int cities;
+  } scales[] = {{"api", 0}, {"cities-1k", 1000}, {"cities-10k", 10000}, {"cities-100k", 100000}};
+
+  int status = 0;
+  if (selected(&options, "parse_schedule"))
+    bench_run(&options, "parse_schedule", "api", case_parse_schedule, schedule, strlen(schedule));
+
+  for (size_t i = 0; i < sizeof(scales) / sizeof(scales[0]); i++) {
+    char *json = scales[i].cities ? generate_cities(scales[i].cities) : api_cities;
+    struct dataset set;
+    if (dataset_init(&set, scales[i].name, json) < 0) {
+      dataset_free(&set);
+      status = 1;
+      continue;
+    }
+    bench_dataset(&options, &set);
+    dataset_free(&set);
+  }
+
+  free(schedule);
+  return status;
+}
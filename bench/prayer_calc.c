@@ -0,0 +1,198 @@
+/**
+ * @file prayer_calc.c
+ * @brief Benchmark of the batch prayer time calculation.
+ *
+ * Usage: bench_prayer_calc [cities] [days]
+ *
+ * Spreads the cities over a grid covering Indonesia and calculates days
+ * days for all of them: once with the one-location-at-a-time loop the
+ * calculation used to run (libm trigonometry per event), then with the
+ * batch kernel on one thread and on one thread per CPU. Every time the
+ * kernel gives is checked against the loop; they may only differ by the
+ * minute a time sits on the rounding boundary of.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "domain/prayer_calc.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_CITIES 1000
+#define DEFAULT_DAYS   365
+
+#define DEG_TO_RAD (M_PI / 180.0)
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/* The USNO solar coordinates, as prayer_calc.c computes them */
+static void sun_at(double jd, double *declination, double *equation) {
+  double d = jd - 2451545.0;
+  double mean_anomaly = fmod(357.529 + 0.98560028 * d, 360.0) * DEG_TO_RAD;
+  double mean_longitude = fmod(280.459 + 0.98564736 * d, 360.0);
+  double longitude = (mean_longitude + 1.915 * sin(mean_anomaly) +
+                      0.020 * sin(2 * mean_anomaly)) * DEG_TO_RAD;
+  double obliquity = (23.439 - 0.00000036 * d) * DEG_TO_RAD;
+  double right_ascension =
+      atan2(cos(obliquity) * sin(longitude), cos(longitude)) / DEG_TO_RAD;
+
+  *equation = fmod(mean_longitude - right_ascension, 360.0) / 15.0;
+  if (*equation > 12.0)
+    *equation -= 24.0;
+  else if (*equation < -12.0)
+    *equation += 24.0;
+  *declination = asin(sin(obliquity) * sin(longitude));
+}
+
+/**
+ * @brief Crossing of one altitude (or the ashr one when shadow > 0), as UT
+ *        hours, NAN if the sun never gets there.
+ */
+static double crossing(const double sun[2][2], double lat, double lon, double guess,
+                       double altitude, double sign, int shadow) {
+  double t = (guess - lon) / 24.0;
+  double declination = sun[0][0] + (sun[1][0] - sun[0][0]) * t;
+  double noon = 12.0 - lon - (sun[0][1] + (sun[1][1] - sun[0][1]) * t);
+
+  if (shadow > 0) {
+    double angle = fabs(lat - declination);
+    if (angle >= M_PI / 2)
+      return NAN;
+    altitude = atan(1.0 / (shadow + tan(angle))) / DEG_TO_RAD;
+  }
+
+  double cos_hour = (sin(altitude * DEG_TO_RAD) - sin(lat) * sin(declination)) /
+                    (cos(lat) * cos(declination));
+  if (cos_hour < -1.0 || cos_hour > 1.0)
+    return NAN;
+  return noon + sign * acos(cos_hour) / DEG_TO_RAD / 15.0;
+}
+
+static double nearest(double m) { return floor(m + 0.5); }
+
+static int minutes(double ut, double offset, int margin, double (*round)(double)) {
+  if (isnan(ut))
+    return PRAYER_TIME_NONE;
+
+  double m = round((ut + offset) * 60.0 + margin);
+  int value = (int)fmod(m, 1440.0);
+  return value < 0 ? value + 1440 : value;
+}
+
+/* The calculation as it was: every event of every location and day on its own */
+static void scalar_table(const struct prayer_params *p, const struct prayer_batch *batch,
+                         const double (*sun)[2], struct prayer_table *dest) {
+  for (int l = 0; l < batch->count; l++) {
+    double lat = batch->latitude[l] * DEG_TO_RAD, lon = batch->longitude[l] / 15.0;
+    double offset = batch->utc_offset[l];
+    double (*round)(double) = p->round_up ? ceil : nearest;
+
+    for (int d = 0; d < dest->days; d++) {
+      const double(*s)[2] = &sun[d];
+      double t = (12.0 - lon) / 24.0;
+      double dzuhr = 12.0 - lon - (s[0][1] + (s[1][1] - s[0][1]) * t);
+      double maghrib = crossing(s, lat, lon, 18.0, -0.833, 1.0, 0);
+      double isya = p->isya_minutes > 0 ? maghrib + p->isya_minutes / 60.0
+                                        : crossing(s, lat, lon, 18.0, -p->isya_angle, 1.0, 0);
+      double times[PRAYER_KIND_COUNT] = {
+          [PRAYER_FAJR] = crossing(s, lat, lon, 5.0, -p->fajr_angle, -1.0, 0),
+          [PRAYER_SUNRISE] = crossing(s, lat, lon, 6.0, -0.833, -1.0, 0),
+          [PRAYER_DHUHA] = crossing(s, lat, lon, 6.0, p->dhuha_altitude, -1.0, 0),
+          [PRAYER_DZUHR] = dzuhr,
+          [PRAYER_ASHR] = crossing(s, lat, lon, 13.0, 0.0, 1.0, p->asr_shadow),
+          [PRAYER_MAGHRIB] = maghrib,
+          [PRAYER_ISYA] = isya,
+      };
+
+      size_t i = (size_t)d * dest->count + l;
+      for (int kind = 0; kind < PRAYER_KIND_COUNT; kind++)
+        dest->times[kind][i] = minutes(times[kind], offset, p->ihtiyat, round);
+      dest->times[PRAYER_SUNRISE][i] =
+          minutes(times[PRAYER_SUNRISE], offset, -p->ihtiyat, floor);
+    }
+  }
+}
+
+/* Times further apart than a rounding step, or present in only one table */
+static long mismatches(const struct prayer_table *a, const struct prayer_table *b) {
+  long count = 0;
+  for (int kind = 0; kind < PRAYER_KIND_COUNT; kind++) {
+    for (size_t i = 0; i < (size_t)a->count * a->days; i++) {
+      int x = a->times[kind][i], y = b->times[kind][i];
+      int diff = abs(x - y);
+      if ((x < 0) != (y < 0) || (diff > 1 && diff < 1439))
+        count++;
+    }
+  }
+  return count;
+}
+
+int main(int argc, char *argv[]) {
+  int count = argc > 1 ? atoi(argv[1]) : DEFAULT_CITIES;
+  int days = argc > 2 ? atoi(argv[2]) : DEFAULT_DAYS;
+  if (count <= 0 || days <= 0 || days > PRAYER_CALC_MAX_DAYS) {
+    fprintf(stderr, "usage: %s [cities] [days (1-%d)]\n", argv[0], PRAYER_CALC_MAX_DAYS);
+    return 1;
+  }
+
+  /* Sabang to Merauke, Rote to Miangas */
+  double *coordinates = malloc(sizeof(double) * 3 * count);
+  if (coordinates == NULL)
+    return 1;
+  for (int i = 0; i < count; i++) {
+    coordinates[i] = -11.0 + 17.0 * ((i * 37) % count) / count;
+    coordinates[count + i] = 95.0 + 46.0 * i / count;
+    coordinates[2 * count + i] = 7 + (coordinates[count + i] >= 112.5) +
+                                 (coordinates[count + i] >= 127.5); /* WIB, WITA, WIT */
+  }
+  struct prayer_batch batch = {count, coordinates, coordinates + count, coordinates + 2 * count};
+
+  struct prayer_params params;
+  prayer_params_init(&params, PRAYER_METHOD_KEMENAG);
+
+  struct prayer_table expected, table;
+  if (prayer_table_init(&expected, count, days) < 0 || prayer_table_init(&table, count, days) < 0)
+    return 1;
+
+  double pairs = (double)count * days;
+  printf("%d cities, %d days\n", count, days);
+
+  double start = now_ns();
+  static double sun[PRAYER_CALC_MAX_DAYS + 1][2];
+  for (int d = 0; d <= days; d++)
+    sun_at(2461041.5 + d, &sun[d][0], &sun[d][1]); /* From 1 January 2026 */
+  scalar_table(&params, &batch, sun, &expected);
+  double elapsed = now_ns() - start;
+  printf("  %-10s %8.1f ms %8.2f Mdays/s\n", "scalar", elapsed / 1e6, pairs / elapsed * 1e3);
+
+  /* One thread, then one per CPU (which needs PRAYER_BATCH_MIN cities each) */
+  int runs[] = {1, (int)sysconf(_SC_NPROCESSORS_ONLN)};
+  int status = 0;
+  for (int r = 0; r < (runs[1] > 1 ? 2 : 1); r++) {
+    int threads = runs[r];
+    start = now_ns();
+    if (prayer_calc_table(&params, &batch, 2026, 1, 1, threads, &table) < 0)
+      return 1;
+    elapsed = now_ns() - start;
+
+    long wrong = mismatches(&expected, &table);
+    char label[32];
+    snprintf(label, sizeof(label), "batch x%d", threads);
+    printf("  %-10s %8.1f ms %8.2f Mdays/s%s\n", label, elapsed / 1e6, pairs / elapsed * 1e3,
+           wrong ? "  TIME MISMATCH" : "");
+    if (wrong)
+      status = 1;
+  }
+
+  prayer_table_free(&expected);
+  prayer_table_free(&table);
+  free(coordinates);
+  return status;
+}
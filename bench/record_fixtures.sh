@@ -0,0 +1,12 @@
+#!/bin/bash
+# Record the API responses muslimkit_bench reads, into bench/fixtures by default.
+
+set -e
+
+DIR="${1:-$(dirname "$0")/fixtures}"
+API="https://api.myquran.com/v2/sholat"
+
+mkdir -p "$DIR"
+curl -sSf "$API/kota/semua" -o "$DIR/cities.json"
+curl -sSf "$API/jadwal/1301/$(date +%Y)/$(date +%-m)" -o "$DIR/jadwal.json"
+echo "Recorded $DIR/cities.json and $DIR/jadwal.json"
@@ -12,6 +12,8 @@
 
 #define _POSIX_C_SOURCE 200809L
 
+#include "utils/arena.h"
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,6 +22,10 @@
 
 #define CHUNK_SIZE 4096
 
+#define CITY_CACHE_FILE  "cities.snap"      /**< Snapshot file name inside the cache dir */
+#define CITY_CACHE_TTL   (7 * 24 * 60 * 60) /**< Seconds before the cache is revalidated */
+#define CITY_ARENA_BLOCK (32 * 1024)        /**< Arena block size, fits a whole city list */
+
 /**
  * @brief Structure representing a single city data entry.
  *
@@ -40,18 +46,34 @@ struct cities_s {
   bool status;                /**< API request status */
   struct cities_data_s *data; /**< Array of city data */
   size_t size;                /**< Number of cities in the data array */
+  void *map;                  /**< Snapshot mapping the strings point into, NULL if parsed */
+  size_t map_size;            /**< Length of the snapshot mapping */
+  struct arena arena;         /**< Holds the strings of a parsed response */
 };
 
 /**
  * @brief Free memory allocated for cities structure.
  *
- * Releases all memory associated with a cities_s structure, including
- * the data array and individual city entries.
+ * Releases all memory associated with a cities_s structure: the data
+ * array plus either the arena holding the parsed strings or the snapshot
+ * mapping they point into.
  *
  * @param cities  Pointer to the cities_s structure to free.
  */
 void get_city_free(struct cities_s *cities);
 
+/**
+ * @brief Parse a city list response body.
+ *
+ * @param json_str  Body of /v2/sholat/kota/semua, NUL terminated.
+ * @param dest      Destination for the cities data.
+ *
+ * @return 0 on success, -1 on invalid arguments or JSON.
+ *
+ * @warning dest must be freed using get_city_free(), also on failure.
+ */
+int parse_cities_json(const char *json_str, struct cities_s *dest);
+
 /**
  * @brief Fetch cities data from the API.
  *
@@ -65,4 +87,81 @@ void get_city_free(struct cities_s *cities);
  */
 int get_city(struct cities_s *dest);
 
+/**
+ * @brief Get cities data, served from the on-disk cache when possible.
+ *
+ * Loads the versioned cache file from the XDG cache directory. A cache
+ * younger than CITY_CACHE_TTL is returned without any network I/O. An
+ * expired cache is revalidated with a conditional request using the stored
+ * ETag/Last-Modified; a `304 Not Modified` only refreshes the timestamp.
+ * If the network is unavailable a stale cache is still returned.
+ *
+ * @param dest     Destination for the cities data.
+ * @param refresh  When true, ignore the cache, refetch unconditionally and
+ *                 rewrite the cache file atomically.
+ *
+ * @return 0 on success, -1 when neither the cache nor the API could be used.
+ *
+ * @warning dest must be freed using get_city_free().
+ */
+int get_city_cached(struct cities_s *dest, bool refresh);
+
+/**
+ * @brief Get the cached cities without any network I/O, however old.
+ *
+ * @param dest     Destination for the cities data.
+ * @param expired  Receives whether the cache is older than CITY_CACHE_TTL,
+ *                 i.e. whether get_city_cached() would revalidate it.
+ *
+ * @return 0 on success, -1 when there is no usable cache.
+ *
+ * @warning dest must be freed using get_city_free().
+ */
+int get_city_cache_peek(struct cities_s *dest, bool *expired);
+
+/**
+ * @brief get_city_cached() running on a thread of its own.
+ *
+ * Lets the caller show the cached list (see get_city_cache_peek()), or
+ * something else, while the list is revalidated or fetched. fd becomes
+ * readable when the fetch is done, so it can be polled along with other
+ * input, e.g. as struct listview_source::update_fd.
+ */
+struct city_fetch {
+  pthread_t thread;
+  int fd;                 /**< Readable once the fetch is done */
+  int notify;             /**< Write end of the pipe behind fd */
+  bool refresh;           /**< Passed to get_city_cached() */
+  int status;             /**< Result of get_city_cached() */
+  struct cities_s result; /**< Cities fetched, the thread's until it is joined */
+};
+
+/**
+ * @brief Start get_city_cached() on a new thread.
+ *
+ * The fetch goes over the default connection: nothing else may use it
+ * until get_city_fetch_finish() is called.
+ *
+ * @param fetch    State of the fetch.
+ * @param refresh  Passed to get_city_cached().
+ *
+ * @return 0 when the thread was started, -1 otherwise.
+ */
+int get_city_fetch_start(struct city_fetch *fetch, bool refresh);
+
+/**
+ * @brief Wait for a fetch started with get_city_fetch_start() to end.
+ *
+ * Blocks only while the fetch is still running, then releases the thread
+ * and fd.
+ *
+ * @param fetch  The fetch.
+ * @param dest   Receives the cities on success.
+ *
+ * @return What get_city_cached() returned.
+ *
+ * @warning dest must be freed using get_city_free().
+ */
+int get_city_fetch_finish(struct city_fetch *fetch, struct cities_s *dest);
+
 #endif
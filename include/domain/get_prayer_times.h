@@ -10,26 +10,58 @@
 #ifndef GET_PRAYER_TIMES_H
 #define GET_PRAYER_TIMES_H
 
+#include "utils/arena.h"
 #include <stdbool.h>
 
+#include <stddef.h>
+#include <stdint.h>
+
+#define SCHEDULE_PREFETCH_DAYS 3          /**< Prefetch next month when this close to month end */
+#define SCHEDULE_ARENA_BLOCK   1024       /**< Arena block size, fits the month's strings */
+#define SCHEDULE_TIME_NONE     UINT16_MAX /**< A time the schedule does not give */
+#define SCHEDULE_TIME_LEN      6          /**< "HH:MM" and its NUL */
+
+struct http_conn;
+
 struct prayer_times_req {
   char *path;
 };
 
+/**
+ * @brief The prayer times of a schedule day, as indices of
+ *        struct prayer_times_data_schedule::times. In time order.
+ */
+enum schedule_time {
+  SCHEDULE_FAJR,
+  SCHEDULE_DHUHA,
+  SCHEDULE_DZUHR,
+  SCHEDULE_ASHR,
+  SCHEDULE_MAGHRIB,
+  SCHEDULE_ISYA,
+  SCHEDULE_TIME_COUNT,
+};
+
+/**
+ * @brief One day of a schedule, 16 bytes.
+ *
+ * Times are minutes after local midnight, SCHEDULE_TIME_NONE when the day
+ * has none; they are only turned into text when displayed, see
+ * schedule_format_time(). The days of a schedule are in date order.
+ */
 struct prayer_times_data_schedule {
-  char *date;
-  char *fajr;
-  char *dhuha;
-  char *dzuhr;
-  char *ashr;
-  char *maghrib;
-  char *isya;
+  uint16_t year;
+  uint8_t month;
+  uint8_t day;
+  uint16_t times[SCHEDULE_TIME_COUNT];
 };
 
 struct prayer_times_data {
   int id;
   char *location;
   char *province;
+  bool has_coordinates; /**< The response carried the city's coordinates */
+  double latitude;      /**< Degrees, north positive */
+  double longitude;     /**< Degrees, east positive */
   int schedule_size;
   struct prayer_times_data_schedule *schedule;
 };
@@ -38,10 +70,177 @@ struct prayer_times {
   bool status;
   struct prayer_times_req req;
   struct prayer_times_data data;
+  void *map;          /**< Snapshot mapping the strings and days point into, NULL if parsed */
+  size_t map_size;    /**< Length of the snapshot mapping */
+  struct arena arena; /**< Holds the strings of a parsed response */
 };
 
+/**
+ * @brief Fetch the current month's schedule for a city from the API.
+ *
+ * @param city_id  City ID as returned by get_city() (e.g. "1301").
+ * @param dest     Destination for the parsed schedule.
+ *
+ * @return 0 on success, -1 on failure.
+ *
+ * @warning dest must be freed using get_prayer_times_free().
+ */
 int get_prayer_times(const char *city_id, struct prayer_times *dest);
 
+/**
+ * @brief Parse a month schedule response body.
+ *
+ * @param json_str  Body of /v2/sholat/jadwal/<id>/<year>/<month>, NUL terminated.
+ * @param dest      Destination for the parsed schedule.
+ *
+ * @return 0 on success, -1 on invalid arguments or JSON.
+ *
+ * @warning dest must be freed using get_prayer_times_free().
+ */
+int parse_prayer_times_json(const char *json_str, struct prayer_times *dest);
+
+/**
+ * @brief Fetch the schedule of a given month for a city from the API.
+ *
+ * @param city_id  City ID.
+ * @param year     Gregorian year (e.g. 2025).
+ * @param month    Month, 1-12.
+ * @param dest     Destination for the parsed schedule.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int get_prayer_times_month(const char *city_id, int year, int month, struct prayer_times *dest);
+
+/**
+ * @brief Get the schedule of a given month, served from the local store when possible.
+ *
+ * Monthly schedules never change once published, so a cached month is
+ * returned without any network I/O. A missing month is fetched from the
+ * API and written to the cache directory keyed by (city_id, year, month).
+ * When the API cannot be reached, the month is calculated locally (see
+ * prayer_calc.h) from the coordinates of another cached month of the city.
+ *
+ * @param city_id  City ID (digits/letters only, it is used in the file name).
+ * @param year     Gregorian year.
+ * @param month    Month, 1-12.
+ * @param dest     Destination for the schedule.
+ *
+ * @return 0 on success, -1 on failure.
+ *
+ * @warning dest must be freed using get_prayer_times_free().
+ */
+int get_prayer_times_cached(const char *city_id, int year, int month, struct prayer_times *dest);
+
+/**
+ * @brief Whether a month is in the local store.
+ */
+bool get_prayer_times_is_cached(const char *city_id, int year, int month);
+
+/**
+ * @brief How one month of get_prayer_times_refetch() went.
+ *
+ * @enum SCHEDULE_FETCH_STORED     Fetched and written to the local store
+ * @enum SCHEDULE_FETCH_UNCHANGED  The cached copy is current (304 Not Modified)
+ * @enum SCHEDULE_FETCH_FAILED     Not fetched, or not stored
+ */
+enum schedule_fetch_status {
+  SCHEDULE_FETCH_STORED,
+  SCHEDULE_FETCH_UNCHANGED,
+  SCHEDULE_FETCH_FAILED,
+};
+
+/**
+ * @brief One month to fetch with get_prayer_times_refetch(), and its outcome.
+ *
+ * @param city_id     City ID.
+ * @param year        Gregorian year.
+ * @param month       Month, 1-12.
+ * @param status      Filled in, see enum schedule_fetch_status.
+ * @param latency_ms  Filled in: from sending the request to its response.
+ */
+struct schedule_fetch {
+  const char *city_id;
+  int year;
+  int month;
+  enum schedule_fetch_status status;
+  double latency_ms;
+};
+
+/**
+ * @brief Fetch months over a given connection into the local store.
+ *
+ * Unlike get_prayer_times_cached() the months are always asked for and
+ * nothing is returned. A month already cached is asked for conditionally,
+ * with the ETag and Last-Modified it was stored with, so an unchanged one
+ * costs a body-less 304. All requests are pipelined on the connection,
+ * which stays open for the next call. Responses without a schedule are
+ * not stored.
+ *
+ * @param conn     Keep-alive connection, see struct http_conn.
+ * @param fetches  Months; their status and latency_ms are filled in.
+ * @param count    Number of months, at most HTTP_PIPELINE_MAX.
+ *
+ * @return Number of months that failed, or -1 on invalid arguments.
+ */
+int get_prayer_times_refetch(struct http_conn *conn, struct schedule_fetch *fetches, int count);
+
+/**
+ * @brief Find the schedule entry of a given day, by binary search.
+ *
+ * @param prayer_t  Monthly schedule.
+ * @param year      Gregorian year.
+ * @param month     Month, 1-12.
+ * @param day       Day of month, 1-31.
+ *
+ * @return Pointer into prayer_t->data.schedule, or NULL when the day is absent.
+ */
+const struct prayer_times_data_schedule *
+get_prayer_times_day(const struct prayer_times *prayer_t, int year, int month, int day);
+
+/**
+ * @brief Find the first prayer after a moment of the schedule.
+ *
+ * Looks at the rest of the given day, then at the following days of the
+ * schedule.
+ *
+ * @param prayer_t  Monthly schedule.
+ * @param year, month, day  Day of the moment.
+ * @param minutes   Minutes after midnight of the moment; only later times
+ *                  count. -1 to include all of the day.
+ * @param entry     Receives the day of the prayer.
+ *
+ * @return The enum schedule_time of the prayer, or -1 when the schedule
+ *         has none left.
+ */
+int get_prayer_times_next(const struct prayer_times *prayer_t, int year, int month, int day,
+                          int minutes, const struct prayer_times_data_schedule **entry);
+
+/**
+ * @brief Name of a prayer ("Fajr", "Dhuha", "Dzuhr", "Ashr", "Maghrib",
+ *        "Isya"), NULL for an unknown one.
+ */
+const char *schedule_time_name(enum schedule_time time);
+
+/**
+ * @brief Format a schedule time as "HH:MM", or "-" for SCHEDULE_TIME_NONE.
+ *
+ * @return dest.
+ */
+char *schedule_format_time(uint16_t minutes, char dest[SCHEDULE_TIME_LEN]);
+
+/**
+ * @brief Prefetch next month's schedule in the background near the month end.
+ *
+ * When today is within SCHEDULE_PREFETCH_DAYS of the end of the month and
+ * next month is not cached yet, a detached child process fetches it into
+ * the cache so later lookups never block on the API. Returns immediately.
+ *
+ * @param city_id  City ID.
+ *
+ * @return 1 if a prefetch was started, 0 if none was needed, -1 on failure.
+ */
+int get_prayer_times_prefetch(const char *city_id);
+
 void get_prayer_times_free(struct prayer_times *prayer_t);
 
 #endif
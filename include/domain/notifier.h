@@ -0,0 +1,82 @@
+/**
+ * @file notifier.h
+ * @brief Prayer time notification daemon.
+ *
+ * Looks up the next prayer in the cached schedule, turns it into an
+ * absolute timestamp and sleeps on a single timerfd until then; nothing
+ * runs between two prayers. The timer is armed on CLOCK_REALTIME at an
+ * absolute time and cancelled whenever the clock is set, so it stays right
+ * across midnight, month ends, DST changes, suspend and NTP steps: after
+ * every wakeup the next event is looked up again from the current time.
+ */
+
+#ifndef NOTIFIER_H
+#define NOTIFIER_H
+
+#include "domain/get_prayer_times.h"
+#include <stdio.h>
+#include <time.h>
+
+#define NOTIFIER_LATE_SECONDS  300 /**< Still announce an event missed by this much */
+#define NOTIFIER_RETRY_SECONDS 900 /**< Wait before retrying when no schedule loads */
+
+/**
+ * @brief One upcoming prayer.
+ *
+ * @param at    Local time of the prayer as a timestamp.
+ * @param time  Which prayer it is.
+ * @param name  Name of the prayer ("Fajr", "Dzuhr", ...), static storage.
+ */
+struct notifier_event {
+  time_t at;
+  enum schedule_time time;
+  const char *name;
+};
+
+struct schedule_shm;
+
+/**
+ * @brief Load the schedule of a month, as get_prayer_times_cached() does.
+ *
+ * @return 0 on success, -1 on failure. dest is freed by the caller using
+ *         get_prayer_times_free().
+ */
+typedef int (*notifier_load_fn)(void *ctx, int year, int month, struct prayer_times *dest);
+
+/**
+ * @brief The first prayer strictly after a point in time.
+ *
+ * Searches the rest of that month, then the next month.
+ *
+ * @param load        Schedule source.
+ * @param ctx         Passed to load.
+ * @param utc_offset  Seconds east of UTC the schedule times are in, or
+ *                    TMUTILS_LOCAL_ZONE for the machine's time zone.
+ * @param after       Point in time.
+ * @param dest        Receives the prayer.
+ *
+ * @return 0 on success, -1 when no schedule loads or none has a later prayer.
+ */
+int notifier_next(notifier_load_fn load, void *ctx, long utc_offset, time_t after,
+                  struct notifier_event *dest);
+
+/**
+ * @brief Announce every prayer on @p out as it comes, until an error.
+ *
+ * Prints one "HH:MM Name" line per prayer, in the schedule's time (see
+ * notifier_next() for @p utc_offset). Events that came due while the
+ * machine was asleep are still announced if they are at most
+ * NOTIFIER_LATE_SECONDS old, and dropped otherwise. When no schedule can be
+ * loaded the daemon retries every NOTIFIER_RETRY_SECONDS.
+ *
+ * @param shm  When not NULL, the current month and the next prayer are
+ *             published there whenever the next prayer changes, see
+ *             schedule_shm.h.
+ *
+ * @return -1 if the timer cannot be created or waited on; does not return
+ *         otherwise.
+ */
+int notifier_run(notifier_load_fn load, void *ctx, long utc_offset, FILE *out,
+                 struct schedule_shm *shm);
+
+#endif
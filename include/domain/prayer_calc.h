@@ -0,0 +1,252 @@
+/**
+ * @file prayer_calc.h
+ * @brief Offline astronomical prayer time calculation.
+ *
+ * Computes the daily prayer times of a location from its coordinates: the
+ * sun's declination and the equation of time give the moment of solar noon
+ * (dzuhr), and every other time is the hour angle at which the sun reaches
+ * the altitude a calculation method prescribes for it.
+ *
+ * The sun's position only depends on the date, so it is computed once per
+ * day and shared by every location of a batch; a year for thousands of
+ * cities costs little more than the per-location hour angles. Those are
+ * computed PRAYER_BATCH_LANES locations at a time by a kernel without any
+ * libm call, which the compiler vectorizes (AVX2 when the CPU has it), and
+ * large batches are split by location across threads.
+ */
+
+#ifndef PRAYER_CALC_H
+#define PRAYER_CALC_H
+
+#include "domain/get_prayer_times.h"
+#include <stdint.h>
+
+#define PRAYER_TIME_NONE         (-1) /**< The sun never reaches the altitude on that day */
+#define PRAYER_CALC_MAX_DAYS     366  /**< Longest range prayer_calc_days() accepts */
+#define PRAYER_BATCH_LANES       8    /**< Locations computed together by the batch kernel */
+#define PRAYER_BATCH_MIN         256  /**< Locations per thread below which fewer are used */
+#define PRAYER_BATCH_MAX_THREADS 16   /**< Most threads prayer_calc_table() runs */
+
+/**
+ * @brief Calculation conventions.
+ *
+ * @enum PRAYER_METHOD_KEMENAG      Kementerian Agama RI: fajr 20°, isya 18°,
+ *                                  2 minutes of ihtiyat, rounded up
+ * @enum PRAYER_METHOD_MWL          Muslim World League: fajr 18°, isya 17°
+ * @enum PRAYER_METHOD_ISNA         Islamic Society of North America: 15°, 15°
+ * @enum PRAYER_METHOD_EGYPT        Egyptian General Authority of Survey: 19.5°, 17.5°
+ * @enum PRAYER_METHOD_UMM_AL_QURA  Umm al-Qura, Makkah: fajr 18.5°, isya 90
+ *                                  minutes after maghrib
+ * @enum PRAYER_METHOD_KARACHI      University of Islamic Sciences, Karachi: 18°, 18°
+ * @enum PRAYER_METHOD_JAKIM        JAKIM (Malaysia) and MUIS (Singapore): 20°, 18°
+ */
+enum prayer_method {
+  PRAYER_METHOD_KEMENAG,
+  PRAYER_METHOD_MWL,
+  PRAYER_METHOD_ISNA,
+  PRAYER_METHOD_EGYPT,
+  PRAYER_METHOD_UMM_AL_QURA,
+  PRAYER_METHOD_KARACHI,
+  PRAYER_METHOD_JAKIM,
+  PRAYER_METHOD_COUNT,
+};
+
+/**
+ * @brief Parameters of a calculation, see prayer_params_init().
+ *
+ * @param fajr_angle      Sun depression at fajr, degrees.
+ * @param isya_angle      Sun depression at isya, degrees; ignored when
+ *                        isya_minutes is set.
+ * @param isya_minutes    Isya as a fixed interval after maghrib, 0 for none.
+ * @param dhuha_altitude  Sun altitude at dhuha, degrees.
+ * @param asr_shadow      Shadow length factor at ashr: 1 (Shafi'i, Maliki,
+ *                        Hanbali) or 2 (Hanafi).
+ * @param ihtiyat         Safety margin in minutes, added to every time and
+ *                        subtracted from sunrise.
+ * @param round_up        Round to the next whole minute rather than the
+ *                        nearest one (sunrise is always rounded down).
+ */
+struct prayer_params {
+  double fajr_angle;
+  double isya_angle;
+  int isya_minutes;
+  double dhuha_altitude;
+  int asr_shadow;
+  int ihtiyat;
+  bool round_up;
+};
+
+/**
+ * @brief Where to calculate for.
+ *
+ * @param latitude    Degrees, north positive.
+ * @param longitude   Degrees, east positive.
+ * @param utc_offset  Hours local time is ahead of UTC (7 for WIB).
+ */
+struct prayer_location {
+  double latitude;
+  double longitude;
+  double utc_offset;
+};
+
+/**
+ * @brief Prayer times of one day, in minutes after local midnight.
+ *
+ * Each field is a whole number of minutes, or PRAYER_TIME_NONE when the sun
+ * does not reach the required altitude (fajr and isya near the poles in
+ * summer, for instance).
+ */
+struct prayer_day {
+  int fajr;
+  int sunrise;
+  int dhuha;
+  int dzuhr;
+  int ashr;
+  int maghrib;
+  int isya;
+};
+
+/**
+ * @brief The times of a day, as indices of struct prayer_table::times.
+ */
+enum prayer_kind {
+  PRAYER_FAJR,
+  PRAYER_SUNRISE,
+  PRAYER_DHUHA,
+  PRAYER_DZUHR,
+  PRAYER_ASHR,
+  PRAYER_MAGHRIB,
+  PRAYER_ISYA,
+  PRAYER_KIND_COUNT,
+};
+
+/**
+ * @brief Locations of a batch calculation, one array per coordinate.
+ *
+ * @param count       Number of locations.
+ * @param latitude    count latitudes, degrees.
+ * @param longitude   count longitudes, degrees.
+ * @param utc_offset  count UTC offsets, hours.
+ */
+struct prayer_batch {
+  int count;
+  const double *latitude;
+  const double *longitude;
+  const double *utc_offset;
+};
+
+/**
+ * @brief Times of a batch calculation, one array per prayer.
+ *
+ * times[kind][day * count + location] is in minutes after local midnight,
+ * or PRAYER_TIME_NONE, as in struct prayer_day. The days of one location
+ * are count entries apart, so a day of every location is contiguous.
+ *
+ * @param count  Number of locations.
+ * @param days   Number of days.
+ * @param times  One array of count * days entries per enum prayer_kind, all
+ *               in a single allocation.
+ */
+struct prayer_table {
+  int count;
+  int days;
+  int16_t *times[PRAYER_KIND_COUNT];
+};
+
+/**
+ * @brief Fill the parameters of a calculation method.
+ *
+ * @return 0 on success, -1 for an unknown method.
+ */
+int prayer_params_init(struct prayer_params *params, enum prayer_method method);
+
+/**
+ * @brief Look up a method by its short name ("kemenag", "mwl", "isna",
+ *        "egypt", "makkah", "karachi" or "jakim").
+ *
+ * @return The method, or -1 when the name is unknown.
+ */
+int prayer_method_from_name(const char *name);
+
+/**
+ * @brief Short name of a method, NULL for an unknown one.
+ */
+const char *prayer_method_name(enum prayer_method method);
+
+/**
+ * @brief Calculate the prayer times of one day.
+ *
+ * @return 0 on success, -1 on invalid arguments.
+ */
+int prayer_calc_day(const struct prayer_params *params, const struct prayer_location *location,
+                    int year, int month, int day, struct prayer_day *dest);
+
+/**
+ * @brief Calculate a range of days for several locations.
+ *
+ * The sun's position is computed once per day of the range and reused for
+ * every location.
+ *
+ * @param params          Calculation parameters.
+ * @param locations       Locations to calculate for.
+ * @param location_count  Number of locations.
+ * @param year, month, day  First day of the range; later days may run past
+ *                        the end of the month or year.
+ * @param days            Number of days, 1 to PRAYER_CALC_MAX_DAYS.
+ * @param dest            Receives location_count * days entries, all days of
+ *                        the first location first.
+ *
+ * @return 0 on success, -1 on invalid arguments.
+ */
+int prayer_calc_days(const struct prayer_params *params, const struct prayer_location *locations,
+                     int location_count, int year, int month, int day, int days,
+                     struct prayer_day *dest);
+
+/**
+ * @brief Allocate a table for count locations over days days.
+ *
+ * @return 0 on success, -1 on invalid sizes or allocation failure.
+ *
+ * @warning table must be freed using prayer_table_free().
+ */
+int prayer_table_init(struct prayer_table *table, int count, int days);
+
+/**
+ * @brief Release a table allocated by prayer_table_init().
+ */
+void prayer_table_free(struct prayer_table *table);
+
+/**
+ * @brief Calculate a range of days for a batch of locations.
+ *
+ * Gives the same times as prayer_calc_days(), in table form.
+ *
+ * @param params   Calculation parameters.
+ * @param batch    Locations.
+ * @param year, month, day  First day of the range.
+ * @param threads  Threads to split the locations over, 0 for one per CPU.
+ *                 Batches under PRAYER_BATCH_MIN locations per thread use
+ *                 fewer threads.
+ * @param dest     Table from prayer_table_init() with matching count; its
+ *                 days is the length of the range (1 to PRAYER_CALC_MAX_DAYS).
+ *
+ * @return 0 on success, -1 on invalid arguments.
+ */
+int prayer_calc_table(const struct prayer_params *params, const struct prayer_batch *batch,
+                      int year, int month, int day, int threads, struct prayer_table *dest);
+
+/**
+ * @brief Calculate a monthly schedule in the form the API returns it.
+ *
+ * dest is filled like get_prayer_times_month() would: one schedule entry per
+ * day, with SCHEDULE_TIME_NONE for PRAYER_TIME_NONE. Location and province
+ * are left NULL.
+ *
+ * @return 0 on success, -1 on failure.
+ *
+ * @warning dest must be freed using get_prayer_times_free().
+ */
+int prayer_calc_month(const struct prayer_params *params, const struct prayer_location *location,
+                      int year, int month, struct prayer_times *dest);
+
+#endif
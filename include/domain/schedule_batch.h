@@ -0,0 +1,116 @@
+/**
+ * @file schedule_batch.h
+ * @brief Fetching many (city, month) schedules into the local store at once.
+ *
+ * Requests are shared out over a small pool of worker threads, each holding
+ * its own keep-alive connection, so a few hundred months cost a handful of
+ * TCP and TLS handshakes (the later ones resumed). Each worker pipelines up
+ * to pipeline requests at a time on its connection, and a refresh of months
+ * already cached sends conditional requests, so revalidating an unchanged
+ * store moves a few hundred bytes per month. An optional rate limit spaces
+ * the start of requests evenly across all workers, to stay polite to the
+ * public API.
+ */
+
+#ifndef SCHEDULE_BATCH_H
+#define SCHEDULE_BATCH_H
+
+#include <stdbool.h>
+
+#define SCHEDULE_BATCH_MAX_CONNECTIONS 16 /**< Most connections a batch opens */
+#define SCHEDULE_BATCH_MAX_PIPELINE    32 /**< Most requests in flight per connection */
+
+/**
+ * @brief One month to fetch.
+ *
+ * @param city_id  City ID, as in struct cities_data_s.
+ * @param year     Gregorian year.
+ * @param month    Month, 1-12.
+ */
+struct schedule_request {
+  const char *city_id;
+  int year;
+  int month;
+};
+
+/**
+ * @brief How a request went.
+ *
+ * @enum SCHEDULE_BATCH_FETCHED    Fetched and written to the store
+ * @enum SCHEDULE_BATCH_CACHED     Already in the store, not asked for
+ * @enum SCHEDULE_BATCH_UNCHANGED  In the store and revalidated (304 Not Modified)
+ * @enum SCHEDULE_BATCH_FAILED     Fetching or storing failed
+ */
+enum schedule_batch_status {
+  SCHEDULE_BATCH_FETCHED,
+  SCHEDULE_BATCH_CACHED,
+  SCHEDULE_BATCH_UNCHANGED,
+  SCHEDULE_BATCH_FAILED,
+};
+
+/**
+ * @brief Outcome of one request.
+ *
+ * @param status      See enum schedule_batch_status.
+ * @param latency_ms  Time from sending the request to its response, 0 for a
+ *                    cached one.
+ */
+struct schedule_result {
+  enum schedule_batch_status status;
+  double latency_ms;
+};
+
+/**
+ * @brief Called once per finished request, never from two threads at a time.
+ *
+ * @param user     struct schedule_batch_options::user.
+ * @param request  The request.
+ * @param result   Its outcome.
+ * @param done     Requests finished so far, this one included.
+ * @param total    Requests in the batch.
+ */
+typedef void (*schedule_batch_progress_fn)(void *user, const struct schedule_request *request,
+                                           const struct schedule_result *result, int done,
+                                           int total);
+
+/**
+ * @brief Settings of a batch.
+ *
+ * @param connections  Concurrent connections, 1 to SCHEDULE_BATCH_MAX_CONNECTIONS
+ *                     (0 takes 4).
+ * @param pipeline     Requests sent ahead on a connection before reading the
+ *                     responses, 1 to SCHEDULE_BATCH_MAX_PIPELINE (0 takes 8).
+ * @param rate         Most requests started per second over the whole batch,
+ *                     0 for no limit.
+ * @param refresh      Revalidate months that are already in the store as well.
+ * @param progress     Optional progress callback.
+ * @param user         Passed to progress.
+ */
+struct schedule_batch_options {
+  int connections;
+  int pipeline;
+  double rate;
+  bool refresh;
+  schedule_batch_progress_fn progress;
+  void *user;
+};
+
+/**
+ * @brief Fetch every requested month into the schedule cache.
+ *
+ * Months already in the cache are skipped unless options->refresh is set, in
+ * which case they are replaced only when the server's copy changed.
+ * Requests are started in order, but finish in any order.
+ *
+ * @param requests  Months to fetch.
+ * @param count     Number of requests.
+ * @param options   Batch settings, NULL for the defaults.
+ * @param results   Receives count outcomes, in the order of requests; may be NULL.
+ *
+ * @return Number of failed requests, or -1 on invalid arguments.
+ */
+int schedule_batch_fetch(const struct schedule_request *requests, int count,
+                         const struct schedule_batch_options *options,
+                         struct schedule_result *results);
+
+#endif
@@ -0,0 +1,144 @@
+/**
+ * @file schedule_shm.h
+ * @brief The current month's schedule, published in shared memory.
+ *
+ * The notification daemon owns the schedule cache and publishes the month
+ * it works from, with the next prayer, in a POSIX shared memory segment of
+ * the user (SCHEDULE_SHM_NAME_PREFIX followed by the uid). Other programs on
+ * the machine, such as a status bar widget, map it read-only and read the
+ * next prayer with no system call after the mapping and no network or
+ * parsing work of their own.
+ *
+ * There is a single writer, which holds an exclusive flock() on the
+ * segment. Updates go under a sequence lock: the writer makes the sequence
+ * odd, writes, and makes it even again; a reader copies the data and tries
+ * again when the sequence was odd or changed while it copied.
+ */
+
+#ifndef SCHEDULE_SHM_H
+#define SCHEDULE_SHM_H
+
+#include "domain/get_prayer_times.h"
+#include "domain/notifier.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define SCHEDULE_SHM_NAME_PREFIX  "/muslimkit-" /**< Segment name, the uid follows */
+#define SCHEDULE_SHM_MAGIC        "MKSHM\r\n"   /**< 8 byte segment signature */
+#define SCHEDULE_SHM_VERSION      2             /**< Bumped whenever the layout changes */
+#define SCHEDULE_SHM_MAX_DAYS     31            /**< Days of the longest month */
+#define SCHEDULE_SHM_LOCATION_LEN 64            /**< Location name and its NUL */
+#define SCHEDULE_SHM_READ_TRIES   1000          /**< Copies before a reader gives up */
+
+/**
+ * @brief What the daemon publishes, copied out whole by readers.
+ *
+ * next_day and next_time index the next prayer in days; a next prayer in
+ * the following month (after the last one of this month) only has next_at.
+ */
+struct schedule_shm_data {
+  int32_t city_id;                          /**< City of the schedule, 0 if calculated */
+  int32_t days_count;                       /**< Valid entries of days */
+  char location[SCHEDULE_SHM_LOCATION_LEN]; /**< Location name, may be truncated */
+  int64_t published_at;                     /**< When this was published */
+  int64_t next_at;                          /**< Next prayer as a timestamp, 0 if none */
+  int32_t next_day;                         /**< Its index in days, -1 if not in them */
+  int32_t next_time;                        /**< Its enum schedule_time, -1 if none */
+  int32_t local_zone;                       /**< 1: days are in the reader's local time */
+  int32_t utc_offset;                       /**< Else seconds east of UTC they are in */
+  /** The month, in date order */
+  struct prayer_times_data_schedule days[SCHEDULE_SHM_MAX_DAYS];
+};
+
+/**
+ * @brief Layout of the segment.
+ *
+ * Stored in native byte order; the segment never leaves the machine.
+ */
+struct schedule_shm_segment {
+  char magic[8];             /**< SCHEDULE_SHM_MAGIC */
+  uint32_t version;          /**< SCHEDULE_SHM_VERSION */
+  _Atomic uint32_t sequence; /**< Odd while written, 0 until the first publication */
+  struct schedule_shm_data data;
+};
+
+/**
+ * @brief A mapping of the segment, for writing or for reading.
+ */
+struct schedule_shm {
+  int fd;
+  struct schedule_shm_segment *segment;
+};
+
+/**
+ * @brief Create or take over the segment of the user, for publishing.
+ *
+ * @return 0 on success, -1 when the segment cannot be created or another
+ *         process publishes already.
+ *
+ * @warning shm must be released using schedule_shm_close().
+ */
+int schedule_shm_create(struct schedule_shm *shm);
+
+/**
+ * @brief Map the segment of the user read-only.
+ *
+ * @return 0 on success, -1 when there is no segment or it has another layout.
+ *
+ * @warning shm must be released using schedule_shm_close().
+ */
+int schedule_shm_open(struct schedule_shm *shm);
+
+/**
+ * @brief Unmap the segment. The segment itself stays for other readers.
+ */
+void schedule_shm_close(struct schedule_shm *shm);
+
+/**
+ * @brief Publish a month and its next prayer.
+ *
+ * @param shm         Segment from schedule_shm_create().
+ * @param month       Schedule of the current month; days past
+ *                    SCHEDULE_SHM_MAX_DAYS are dropped.
+ * @param utc_offset  Seconds east of UTC the month's times are in, or
+ *                    TMUTILS_LOCAL_ZONE for the machine's time zone.
+ * @param next        Next prayer, NULL when there is none.
+ */
+void schedule_shm_publish(struct schedule_shm *shm, const struct prayer_times *month,
+                          long utc_offset, const struct notifier_event *next);
+
+/**
+ * @brief Copy out a consistent publication.
+ *
+ * Yields while the writer is mid-update, trying at most
+ * SCHEDULE_SHM_READ_TRIES times.
+ *
+ * @return 0 on success, -1 when nothing is published yet or no consistent
+ *         copy could be made.
+ */
+int schedule_shm_read(const struct schedule_shm *shm, struct schedule_shm_data *dest);
+
+/**
+ * @brief UTC offset the days of a publication are in, for get_zone_time_at().
+ *
+ * @return Seconds east of UTC, or TMUTILS_LOCAL_ZONE.
+ */
+long schedule_shm_utc_offset(const struct schedule_shm_data *data);
+
+/**
+ * @brief The first prayer of a publication strictly after a point in time.
+ *
+ * The published next prayer is used while it is still ahead; once it has
+ * passed, for instance when the daemon is late or gone, the rest of the
+ * published month is searched instead.
+ *
+ * @param data  Copy from schedule_shm_read().
+ *
+ * @return 0 on success, -1 when the published month has no later prayer.
+ */
+int schedule_shm_next(const struct schedule_shm_data *data, time_t after,
+                      struct notifier_event *dest);
+
+#endif
@@ -0,0 +1,138 @@
+/**
+ * @file snapshot.h
+ * @brief Flat binary snapshot format for cached domain data.
+ *
+ * A snapshot file is laid out as:
+ *
+ *     struct snapshot_header
+ *     uint32_t records[record_count][record_fields]   (offsets into the blob)
+ *     char     blob[blob_size]                        (NUL-terminated strings)
+ *
+ * Files are written once and read back with mmap, so cached city lists and
+ * schedules can point straight into the mapping without parsing or
+ * allocating a string per field. Kinds with fixed-size binary records store
+ * them in the record table itself, as record_fields 32-bit words each.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SNAPSHOT_MAGIC    "MKSNAP\r\n" /**< 8 byte file signature */
+#define SNAPSHOT_VERSION  2            /**< Bumped whenever the layout changes */
+#define SNAPSHOT_META_MAX 6            /**< Kind specific string slots in the header */
+#define SNAPSHOT_NULL     UINT32_MAX   /**< Offset value used for NULL strings */
+
+/**
+ * @brief Kind of data stored in a snapshot.
+ *
+ * @enum SNAPSHOT_CITIES    City list, fields: id, lokasi. Meta: etag, last-modified
+ * @enum SNAPSHOT_SCHEDULE  Monthly schedule, binary records: one struct
+ *                          prayer_times_data_schedule per day. Meta: location,
+ *                          province, request path, "lat,lon" coordinates,
+ *                          etag, last-modified. Number: city id
+ */
+enum snapshot_kind {
+  SNAPSHOT_CITIES = 1,
+  SNAPSHOT_SCHEDULE = 2,
+};
+
+/**
+ * @brief On-disk snapshot header.
+ *
+ * Stored in native byte order; the cache never leaves the machine that wrote it.
+ */
+struct snapshot_header {
+  char magic[8];                    /**< SNAPSHOT_MAGIC */
+  uint32_t version;                 /**< SNAPSHOT_VERSION */
+  uint32_t kind;                    /**< enum snapshot_kind */
+  uint32_t record_count;            /**< Number of records in the table */
+  uint32_t record_fields;           /**< String fields per record */
+  uint32_t blob_size;               /**< Size of the string blob in bytes */
+  uint32_t reserved;                /**< Padding, always 0 */
+  int64_t fetched;                  /**< Unix time of the last fetch or revalidation */
+  int64_t number;                   /**< Kind specific number */
+  uint32_t meta[SNAPSHOT_META_MAX]; /**< Kind specific strings (blob offsets) */
+};
+
+/**
+ * @brief A validated, read-only snapshot mapping.
+ */
+struct snapshot {
+  void *map;                            /**< Start of the mapping */
+  size_t map_size;                      /**< Length of the mapping */
+  const struct snapshot_header *header; /**< Header at the start of the mapping */
+  const uint32_t *records;              /**< Record table */
+  const char *blob;                     /**< String blob */
+};
+
+/**
+ * @brief Description of the data to be written into a snapshot.
+ */
+struct snapshot_desc {
+  uint32_t kind;                       /**< enum snapshot_kind */
+  uint32_t record_count;               /**< Number of records */
+  uint32_t record_fields;              /**< String fields per record */
+  const char *const *values;           /**< record_count * record_fields strings, NULL allowed */
+  const void *words;                   /**< Binary records written as is, instead of values */
+  const char *meta[SNAPSHOT_META_MAX]; /**< Header strings, NULL allowed */
+  int64_t fetched;                     /**< Copied into the header */
+  int64_t number;                      /**< Copied into the header */
+};
+
+/**
+ * @brief Map and validate a snapshot file.
+ *
+ * Checks the magic, version, kind and that every section lies within the
+ * file. The blob is guaranteed to end with a NUL byte, so any in-range
+ * offset is a valid C string.
+ *
+ * @param path    Snapshot file.
+ * @param kind    Expected enum snapshot_kind.
+ * @param fields  Expected number of string fields per record.
+ * @param dest    Receives the mapping on success.
+ *
+ * @return 0 on success, -1 if the file is missing, stale or corrupt.
+ *
+ * @warning The mapping must be released with snapshot_close().
+ */
+int snapshot_open(const char *path, uint32_t kind, uint32_t fields, struct snapshot *dest);
+
+/**
+ * @brief Resolve a blob offset to a string.
+ *
+ * @return Pointer into the mapping, or NULL for SNAPSHOT_NULL or an
+ *         out-of-range offset.
+ */
+const char *snapshot_string(const struct snapshot *snap, uint32_t offset);
+
+/**
+ * @brief Resolve a field of a record to a string.
+ *
+ * @return Pointer into the mapping, or NULL when the field is NULL.
+ */
+const char *snapshot_field(const struct snapshot *snap, uint32_t record, uint32_t field);
+
+/**
+ * @brief Unmap a snapshot previously opened with snapshot_open().
+ */
+void snapshot_close(struct snapshot *snap);
+
+/**
+ * @brief Unmap a mapping handed over from a snapshot (see struct cities_s::map).
+ */
+void snapshot_unmap(void *map, size_t map_size);
+
+/**
+ * @brief Serialize and atomically write a snapshot file.
+ *
+ * @param path  Destination file, replaced atomically.
+ * @param desc  Data to write.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int snapshot_write(const char *path, const struct snapshot_desc *desc);
+
+#endif
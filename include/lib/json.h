@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum {
   JSON_NULL,
@@ -23,13 +24,22 @@ struct JsonNode {
   /* only if parent is an object (NULL otherwise) */
   char *key; /* Must be valid UTF-8. */
 
+  /* Length of key, compared before its bytes in json_find_member */
+  uint32_t key_len;
+
+  /* FNV-1a hash of key, compared before the key itself in json_find_member */
+  uint32_t key_hash;
+
   JsonTag tag;
   union {
     /* JSON_BOOL */
     bool bool_;
 
     /* JSON_STRING */
-    char *string_; /* Must be valid UTF-8. */
+    struct {
+      char *string_;     /* Must be valid UTF-8. */
+      size_t string_len; /* strlen(string_) */
+    };
 
     /* JSON_NUMBER */
     double number_;
@@ -45,6 +55,23 @@ struct JsonNode {
 /*** Encoding, decoding, and validation ***/
 
 JsonNode *json_decode(const char *json);
+
+/*
+ * Decode with every node and string allocated from @arena. The tree is
+ * released with arena_free() in one go and must not be passed to
+ * json_delete() or modified with the manipulation functions below.
+ */
+struct arena;
+JsonNode *json_decode_arena(const char *json, struct arena *arena);
+
+/*
+ * Decode @json in place: strings and keys are unescaped inside the buffer,
+ * and the nodes point into it instead of holding copies, so only the nodes
+ * are allocated from @arena. The buffer is modified even when decoding
+ * fails, and must outlive the tree, which is released as for
+ * json_decode_arena().
+ */
+JsonNode *json_decode_in_situ(char *json, struct arena *arena);
 char *json_encode(const JsonNode *node);
 char *json_encode_string(const char *str);
 char *json_stringify(const JsonNode *node, const char *space);
@@ -78,6 +105,86 @@ void json_prepend_member(JsonNode *object, const char *key, JsonNode *value);
 
 void json_remove_from_parent(JsonNode *node);
 
+/*** Streaming (SAX) parsing ***/
+
+/*
+ * Events reported by the streaming parser. Objects and arrays are reported
+ * as a START/END pair around their contents; every object member is
+ * preceded by a JSON_EVENT_KEY.
+ */
+typedef enum {
+  JSON_EVENT_OBJECT_START,
+  JSON_EVENT_OBJECT_END,
+  JSON_EVENT_ARRAY_START,
+  JSON_EVENT_ARRAY_END,
+  JSON_EVENT_KEY,
+  JSON_EVENT_STRING,
+  JSON_EVENT_NUMBER,
+  JSON_EVENT_BOOL,
+  JSON_EVENT_NULL,
+} JsonEventType;
+
+typedef struct {
+  JsonEventType type;
+
+  /*
+   * Nesting level of the value: 0 for the root, 1 for members or elements
+   * of the root container, and so on. A KEY has the depth of its value and
+   * an END has the depth of its START.
+   */
+  int depth;
+
+  /*
+   * JSON_EVENT_KEY and JSON_EVENT_STRING: unescaped UTF-8, only valid for
+   * the duration of the callback and not null-terminated.
+   */
+  const char *string;
+  size_t length;
+
+  double number_; /* JSON_EVENT_NUMBER */
+  bool bool_;     /* JSON_EVENT_BOOL */
+} JsonEvent;
+
+/* Return false to stop parsing; the parser then reports an error. */
+typedef bool (*JsonEventCallback)(void *user, const JsonEvent *event);
+
+#define JSON_SAX_MAX_DEPTH 64
+
+typedef struct {
+  JsonEventCallback callback;
+  void *user;
+
+  int state;
+  int depth;
+  char stack[JSON_SAX_MAX_DEPTH]; /* '{' or '[' per open container */
+
+  bool string_is_key;
+  bool string_escape; /* previous raw byte was a backslash */
+  const char *literal;
+  int literal_pos;
+
+  /* Partial token carried over between feeds */
+  char *scratch;
+  size_t scratch_len;
+  size_t scratch_cap;
+} JsonSax;
+
+/*
+ * Incremental parser that reports values through a callback instead of
+ * building a tree. The input may be split at any byte, so it can be fed
+ * straight from the network as data arrives.
+ */
+void json_sax_init(JsonSax *sax, JsonEventCallback callback, void *user);
+bool json_sax_feed(JsonSax *sax, const char *data, size_t len);
+bool json_sax_finish(JsonSax *sax); /* true if exactly one complete value was parsed */
+void json_sax_free(JsonSax *sax);
+
+/* Parse a complete document in one go */
+bool json_sax_parse(const char *json, size_t len, JsonEventCallback callback, void *user);
+
+/* True if a KEY or STRING event equals @name */
+bool json_event_is(const JsonEvent *event, const char *name);
+
 /*** Debugging ***/
 
 /*
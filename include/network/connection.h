@@ -15,8 +15,12 @@
 #include <netinet/in.h>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <sys/socket.h>
+#include <sys/types.h>
+
+#include "network/http_parser.h"
 
 #define PORT                 443                  /**< HTTPS port number */
 #define PORTSTR              "443"                /**< Port as string for getaddrinfo */
@@ -24,10 +28,17 @@
 #define API_VERSION          "/v2"                /**< API version path */
 #define CITY_ENDPOINT        "/sholat/kota/semua" /**< Cities endpoint */
 #define PRAYER_TIME_ENDPOINT "/sholat/jadwal"     /**< Prayer times endpoint */
-#define ADDR_FAMILY          AF_INET              /**< IPv4 address family */
+#define ADDR_FAMILY          AF_UNSPEC            /**< Resolve both IPv4 and IPv6 */
 #define ADDR_TYPE            SOCK_STREAM          /**< TCP socket type */
-#define RADIX                16                   /**< Hexadecimal radix for chunk size parsing */
-#define CHUNK_SIZE           4096
+#define CHUNK_SIZE           4096                 /**< Initial response body allocation */
+#define RECV_BUFFER_SIZE     16384                /**< Stack buffer for one SSL_read */
+#define HTTP_PIPELINE_MAX    32                   /**< Most requests of one http_conn_pipeline() */
+#define TLS_SESSION_FILE     "tls-session.der"    /**< Persisted TLS session in the cache dir */
+#define DNS_MAX_ADDRS        16                   /**< Addresses kept per resolved host */
+#define DNS_CACHE_SIZE       4                    /**< Hosts kept in the resolver cache */
+#define DNS_CACHE_TTL        300                  /**< Seconds a resolved host stays cached */
+#define CONNECT_STAGGER_MS   250                  /**< Delay before racing the next address */
+#define CONNECT_TIMEOUT_MS   10000                /**< Overall TCP connect timeout */
 
 /**
  * @brief Structure representing a parsed HTTP response.
@@ -38,49 +49,117 @@
 struct http_response {
   char *header;   /**< HTTP headers (null-terminated string) */
   char *body;     /**< HTTP body content (null-terminated string) */
-  uint8_t status; /**< HTTP status code (e.g., 200, 404) */
+  int status;     /**< HTTP status code (e.g., 200, 304, 404) */
+};
+
+/**
+ * @brief A reusable HTTPS connection.
+ *
+ * Keeps the socket and TLS session open between requests (HTTP/1.1
+ * keep-alive) so back-to-back requests to the same host pay for a single
+ * TCP and TLS handshake. Initialize with `{.fd = -1}`.
+ */
+struct http_conn {
+  int fd;       /**< Socket descriptor, -1 when not connected */
+  SSL *ssl;     /**< TLS session on top of fd */
+  pid_t pid;    /**< Process that opened the connection */
+  int requests; /**< Requests completed on this connection */
+};
+
+/**
+ * @brief One request of a pipeline and, once it ran, its response.
+ */
+struct http_pipeline_request {
+  const char *path;              /**< Request path */
+  const char *headers;           /**< Extra header lines, each terminated by "\r\n", or NULL */
+  http_body_cb on_body;          /**< Body consumer, NULL to discard the body */
+  void *user;                    /**< Passed to on_body */
+  struct http_response response; /**< Status and headers when result is 0 (body is NULL) */
+  int result;                    /**< 0 when the response was received, -1 otherwise */
+  double latency_ms;             /**< From sending the request to its response being parsed */
+};
+
+/**
+ * @brief TLS handshake counters for the shared SSL context.
+ *
+ * A handshake that offered a saved session either resumed it (hit) or was
+ * rejected by the server and fell back to a full handshake (miss). A
+ * handshake with the API host that had no resumable session to offer is
+ * counted as not offered.
+ */
+struct tls_stats {
+  unsigned long handshakes;  /**< Completed handshakes */
+  unsigned long resumed;     /**< Offered sessions the server accepted */
+  unsigned long rejected;    /**< Offered sessions the server declined */
+  unsigned long not_offered; /**< API host handshakes without a session to offer */
+};
+
+/**
+ * @brief Addresses a host name resolved to.
+ *
+ * Ordered for connection attempts: address families alternate, starting
+ * with the family the system resolver preferred (RFC 8305 section 4).
+ */
+struct resolved_host {
+  int count;                                     /**< Number of valid addresses */
+  struct sockaddr_storage addrs[DNS_MAX_ADDRS];  /**< Socket addresses including port */
+  socklen_t lens[DNS_MAX_ADDRS];                 /**< Length of each address */
+  bool cached;                                   /**< Served from the resolver cache */
 };
 
 /**
  * @brief Create a socket connection.
  *
  * Defines a socket connection with the following configuration:
- * - Address family: ADDR_FAMILY
- * - Type: ADDR_TYPE
+ * - Address family: @p family (AF_INET or AF_INET6)
+ * - Type: ADDR_TYPE, non-blocking and close-on-exec
  * - Protocol: 0 (TCP)
  *
+ * @param family  Address family of the peer.
+ *
  * @return On success, returns a non-negative integer (socket descriptor).
  *         On error, returns -1.
  */
-int fsocket(void);
+int fsocket(int family);
 
 /**
  * @brief Establish a TCP connection to a remote host.
  *
- * Attempts to make a connection using a socket and a sockaddr structure
- * containing the peer address.
+ * Resolves @p hostname through htoip() and races the candidates "happy
+ * eyeballs" style: a new non-blocking attempt starts every
+ * CONNECT_STAGGER_MS (or immediately when one fails) while earlier attempts
+ * stay pending, and the first one to complete wins. The whole operation is
+ * bounded by CONNECT_TIMEOUT_MS so a black-holed address cannot stall on the
+ * OS connect timeout. When cached addresses all fail the host is resolved
+ * again once.
  *
- * @param sockfd   File descriptor associated with the socket (must be TCP).
- * @param host     Host address (e.g., domain name or IP).
+ * @param hostname  Host to connect to.
+ * @param port      Port as a string (e.g. PORTSTR).
  *
- * @return Returns 0 on success, or -1 on failure.
+ * @return Connected socket in blocking mode, or -1 on failure.
  */
-int fconnect(const int sockfd);
+int fconnect(const char *hostname, const char *port);
 
 /**
- * @brief Convert a hostname to its corresponding IP address.
+ * @brief Resolve a hostname to its addresses.
  *
- * Since direct hostname connections are not supported in C sockets,
- * this function resolves the given domain into its first available IP.
+ * Results are cached for DNS_CACHE_TTL seconds. getaddrinfo() does not
+ * report record TTLs, so a fixed lifetime is used.
  *
- * @param hostname   The name of the server (e.g., "example.com").
- * @param port       The port number as a string (e.g., "443" for HTTPS).
- * @param ipstr      Buffer to store the resulting IP string.
- * @param ipstr_len  Size of the IP buffer (e.g., sizeof(ipstr)).
+ * @param hostname   The name of the server (e.g. "example.com").
+ * @param port       The port number as a string (e.g. "443" for HTTPS).
+ * @param dest       Receives the IPv4 and IPv6 addresses.
  *
  * @return Returns 0 on success, or -1 on failure.
  */
-int htoip(const char *hostname, const char *port, char *ipstr, size_t ipstr_len);
+int htoip(const char *hostname, const char *port, struct resolved_host *dest);
+
+/**
+ * @brief Drop a host from the resolver cache.
+ *
+ * @param hostname  Host to forget.
+ */
+void htoip_invalidate(const char *hostname);
 
 /**
  * @brief Initialize an SSL context.
@@ -90,6 +169,21 @@ int htoip(const char *hostname, const char *port, char *ipstr, size_t ipstr_len)
  */
 SSL_CTX *ssl_init(void);
 
+/**
+ * @brief Get the process-wide SSL context.
+ *
+ * The context is created on first use and shared by every connection until
+ * network_cleanup() is called. Creating it also ignores SIGPIPE so writes to
+ * a connection closed by the peer fail instead of terminating the process.
+ *
+ * Sessions issued by the server are kept and offered on the next handshake;
+ * the latest one is persisted to TLS_SESSION_FILE in the cache directory so
+ * the first request of the next process can resume it.
+ *
+ * @return The shared SSL_CTX, or NULL if it could not be created.
+ */
+SSL_CTX *ssl_shared_ctx(void);
+
 /**
  * @brief Establish an SSL/TLS connection.
  *
@@ -105,6 +199,29 @@ SSL_CTX *ssl_init(void);
  */
 SSL *ssl_connect(SSL_CTX *ctx, int fd, const char *hostname);
 
+/**
+ * @brief Establish an SSL/TLS connection, offering a session for resumption.
+ *
+ * Same as ssl_connect() but offers @p session to the server so the
+ * handshake can be abbreviated. Use SSL_session_reused() on the result to
+ * find out whether the server accepted it.
+ *
+ * @param ctx       Pointer to the initialized SSL_CTX.
+ * @param fd        Socket file descriptor.
+ * @param hostname  The hostname of the server.
+ * @param session   Session to resume, or NULL for a full handshake.
+ *
+ * @return Returns a pointer to an SSL object on success, or NULL on failure.
+ */
+SSL *ssl_connect_session(SSL_CTX *ctx, int fd, const char *hostname, SSL_SESSION *session);
+
+/**
+ * @brief Get a snapshot of the TLS handshake counters.
+ *
+ * @param dest  Receives the counters.
+ */
+void tls_stats_get(struct tls_stats *dest);
+
 /**
  * @brief Extract status code from a raw HTTP Response header
  *
@@ -121,11 +238,40 @@ SSL *ssl_connect(SSL_CTX *ctx, int fd, const char *hostname);
  */
 int http_response_status_code(const char *header);
 
+/**
+ * @brief Look up a header value in a raw HTTP response header
+ *
+ * Header names are matched case-insensitively as required by RFC 9110.
+ * Leading and trailing whitespace around the value is stripped.
+ *
+ * @param header    raw c-string header as returned in struct http_response
+ * @param name      header name without the colon (e.g. "ETag")
+ *
+ * @return Newly allocated value, or NULL when the header is absent
+ *
+ * @warning the returned string must be freed by the caller
+ */
+char *http_response_header_value(const char *header, const char *name);
+
+/**
+ * @brief Copy a header value into a fixed buffer, as for validators
+ *        (ETag, Last-Modified) kept next to cached data.
+ *
+ * @param header  Raw header, as in struct http_response; may be NULL.
+ * @param name    Header name without the colon.
+ * @param dest    Receives the value, or an empty string when the header is
+ *                absent or its value does not fit.
+ * @param len     Size of dest.
+ */
+void http_response_header_copy(const char *header, const char *name, char *dest, size_t len);
+
 /**
  * @brief Extract raw http response to struct http_response
  *
  * return a http_response containing header and body extraction from
- * raw http response.
+ * raw http response. The text is run through the same incremental parser
+ * used on live connections, so chunked framing is removed and a truncated
+ * response is reported with a status of -1.
  *
  * @param raw_response   Full HTTP response as a C-string.
  *
@@ -147,6 +293,147 @@ struct http_response http_response_extract(const char *raw_response);
  */
 void http_response_free(struct http_response *response);
 
+/**
+ * @brief Open a connection to a host.
+ *
+ * Resolves and connects to the API host and performs the TLS handshake
+ * using the shared SSL context.
+ *
+ * @param conn  Connection to open (must not be connected).
+ * @param host  Host name used for SNI.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int http_conn_open(struct http_conn *conn, const char *host);
+
+/**
+ * @brief Send a GET request over a keep-alive connection.
+ *
+ * Opens the connection on first use and reuses it afterwards. Exactly one
+ * response is read, delimited by its chunked framing or Content-Length,
+ * so the connection can carry the next request. A reused connection that
+ * the server closed while idle is transparently reopened once. The body is
+ * decoded while it is received and collected into dest->body.
+ *
+ * @param conn     Connection, initialized with `{.fd = -1}`.
+ * @param host     Host name sent in the Host header.
+ * @param path     Request path.
+ * @param headers  Extra header lines, each terminated by "\r\n", or NULL.
+ * @param dest     Receives the parsed response on success.
+ *
+ * @return 0 on success, -1 on failure.
+ *
+ * @warning dest must be released with http_response_free().
+ */
+int http_conn_request(struct http_conn *conn, const char *host, const char *path,
+                      const char *headers, struct http_response *dest);
+
+/**
+ * @brief Send a GET request and stream the decoded body to a callback.
+ *
+ * Behaves like http_conn_request() but never buffers the body: every
+ * decoded piece is passed to @p on_body as soon as it is read, so callers
+ * can parse the payload while it is still arriving.
+ *
+ * @param conn     Connection, initialized with `{.fd = -1}`.
+ * @param host     Host name sent in the Host header.
+ * @param path     Request path.
+ * @param headers  Extra header lines, each terminated by "\r\n", or NULL.
+ * @param on_body  Body consumer; returning non-zero aborts the request.
+ * @param user     Passed to on_body.
+ * @param dest     Receives the header and status; dest->body is left NULL.
+ *
+ * @return 0 on success, -1 on failure.
+ *
+ * @warning dest must be released with http_response_free().
+ */
+int http_conn_request_stream(struct http_conn *conn, const char *host, const char *path,
+                             const char *headers, http_body_cb on_body, void *user,
+                             struct http_response *dest);
+
+/**
+ * @brief Send several GET requests over a keep-alive connection at once.
+ *
+ * All requests are written before the first response is read (HTTP/1.1
+ * pipelining), so N small requests such as conditional revalidations cost
+ * about one round trip instead of N. Responses are read in order and each
+ * body is streamed to its request's consumer, as http_conn_request_stream()
+ * does. When the server closes the connection part way, the requests it did
+ * not answer are sent again on a new connection.
+ *
+ * @param conn      Connection, initialized with `{.fd = -1}`.
+ * @param host      Host name sent in the Host header.
+ * @param requests  Requests; their response, result and latency_ms are filled in.
+ * @param count     Number of requests, at most HTTP_PIPELINE_MAX.
+ *
+ * @return Number of requests that got no response, or -1 on invalid arguments.
+ *
+ * @warning The response of every request with result 0 must be released with
+ *          http_response_free().
+ */
+int http_conn_pipeline(struct http_conn *conn, const char *host,
+                       struct http_pipeline_request *requests, int count);
+
+/**
+ * @brief Close a connection, sending a TLS close_notify when owned by this process.
+ */
+void http_conn_close(struct http_conn *conn);
+
+/**
+ * @brief Release the default connection and the shared SSL context.
+ *
+ * Persists the most recent TLS session for the next run. Call once before
+ * the process exits.
+ */
+void network_cleanup(void);
+
+/**
+ * @brief Perform an HTTPS GET request
+ *
+ * Requests share one process-wide keep-alive connection.
+ *
+ * @param host  Host name sent in the Host header
+ * @param path  Request path (e.g. "/v2/sholat/kota/semua")
+ * @param dest  Receives the parsed response on success
+ *
+ * @return 0 on success, -1 on failure
+ *
+ * @warning dest must be released with http_response_free()
+ */
 int get(const char *host, const char *path, struct http_response *dest);
 
+/**
+ * @brief Perform an HTTPS GET request with additional request headers
+ *
+ * Same as get() but appends @p headers verbatim to the request, which lets
+ * callers send conditional requests (If-None-Match, If-Modified-Since).
+ *
+ * @param host     Host name sent in the Host header
+ * @param path     Request path
+ * @param headers  Extra header lines, each terminated by "\r\n", or NULL
+ * @param dest     Receives the parsed response on success
+ *
+ * @return 0 on success, -1 on failure
+ */
+int get_with_headers(const char *host, const char *path, const char *headers,
+                     struct http_response *dest);
+
+/**
+ * @brief Perform an HTTPS GET request and stream the body to a callback
+ *
+ * Uses the same keep-alive connection as get(); see
+ * http_conn_request_stream() for how the body is delivered.
+ *
+ * @param host     Host name sent in the Host header
+ * @param path     Request path
+ * @param headers  Extra header lines, each terminated by "\r\n", or NULL
+ * @param on_body  Body consumer
+ * @param user     Passed to on_body
+ * @param dest     Receives the header and status (dest->body stays NULL)
+ *
+ * @return 0 on success, -1 on failure
+ */
+int get_stream(const char *host, const char *path, const char *headers, http_body_cb on_body,
+               void *user, struct http_response *dest);
+
 #endif
@@ -0,0 +1,144 @@
+/**
+ * @file http_parser.h
+ * @brief Incremental HTTP/1.1 response parser.
+ *
+ * The parser is fed raw bytes as they come off the TLS connection. Header
+ * fields are matched case-insensitively, chunked framing is removed on the
+ * fly and body bytes are handed to a consumer callback straight out of the
+ * read buffer, so a response is never buffered whole before it is decoded.
+ * A compressed body (Content-Encoding gzip or deflate with zlib, br with
+ * brotli) is decompressed on the way, in HTTP_DECODE_BUFFER sized pieces,
+ * so the consumer only ever sees the decoded bytes.
+ */
+
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HTTP_MAX_HEADER    65536 /**< Largest accepted header block */
+#define HTTP_MAX_LINE      256   /**< Bytes of a chunk-size line that are kept */
+#define HTTP_DECODE_BUFFER 16384 /**< Decompressed bytes handed to the consumer at a time */
+
+/** @brief Accept-Encoding value for the codings this build can decode, NULL for none */
+#if defined(MUSLIMKIT_HAVE_BROTLI) && defined(MUSLIMKIT_HAVE_ZLIB)
+#define HTTP_ACCEPT_ENCODING "br, gzip"
+#elif defined(MUSLIMKIT_HAVE_BROTLI)
+#define HTTP_ACCEPT_ENCODING "br"
+#elif defined(MUSLIMKIT_HAVE_ZLIB)
+#define HTTP_ACCEPT_ENCODING "gzip"
+#else
+#define HTTP_ACCEPT_ENCODING NULL
+#endif
+
+/**
+ * @brief Body consumer callback.
+ *
+ * @param user  User pointer given to http_parser_init().
+ * @param data  Decoded body bytes (not null-terminated).
+ * @param len   Number of bytes.
+ *
+ * @return 0 to continue, non-zero to abort parsing with an error.
+ */
+typedef int (*http_body_cb)(void *user, const char *data, size_t len);
+
+/**
+ * @brief Content-Encoding of a body.
+ */
+enum http_content_coding {
+  HTTP_CODING_IDENTITY, /**< Not encoded */
+  HTTP_CODING_GZIP,     /**< gzip (or x-gzip) */
+  HTTP_CODING_DEFLATE,  /**< zlib-wrapped deflate */
+  HTTP_CODING_BROTLI,   /**< br */
+};
+
+/** @brief Decompression state of a body, see http_parser.c */
+struct http_decoder;
+
+/**
+ * @brief Parser state machine positions.
+ */
+enum http_parser_state {
+  HTTP_PARSE_HEADERS,    /**< Accumulating the status line and header fields */
+  HTTP_PARSE_IDENTITY,   /**< Body delimited by Content-Length */
+  HTTP_PARSE_UNTIL_EOF,  /**< Body delimited by the peer closing */
+  HTTP_PARSE_CHUNK_SIZE, /**< Reading a chunk-size line */
+  HTTP_PARSE_CHUNK_DATA, /**< Inside chunk data */
+  HTTP_PARSE_CHUNK_END,  /**< Expecting the CRLF after chunk data */
+  HTTP_PARSE_TRAILERS,   /**< Trailer fields after the last chunk */
+  HTTP_PARSE_DONE,       /**< A complete response was parsed */
+  HTTP_PARSE_ERROR,      /**< Malformed input or aborted by the callback */
+};
+
+/**
+ * @brief Incremental parser for a single HTTP response.
+ */
+struct http_parser {
+  enum http_parser_state state;
+  int status;                      /**< Status code, valid once headers are parsed */
+  bool headers_done;               /**< Header block fully parsed */
+  bool chunked;                    /**< Transfer-Encoding: chunked */
+  bool keep_alive;                 /**< Connection may carry another request */
+  long long content_length;        /**< Content-Length, -1 when absent */
+  unsigned long long remaining;    /**< Bytes left in the identity body or current chunk */
+  enum http_content_coding coding; /**< Content-Encoding of the body */
+  struct http_decoder *decoder;    /**< Decompression state, NULL for an identity body */
+
+  char *header;      /**< Raw header block (null-terminated, without the final CRLFCRLF) */
+  size_t header_len; /**< Length of the header block */
+  size_t header_cap; /**< Allocated size of header */
+
+  char line[HTTP_MAX_LINE]; /**< Partial chunk-size or trailer line */
+  size_t line_len;          /**< Bytes seen on the current line */
+
+  http_body_cb on_body; /**< Body consumer, may be NULL to discard */
+  void *user;           /**< Passed to on_body */
+};
+
+/**
+ * @brief Prepare a parser for a new response.
+ *
+ * @param parser   Parser to initialize.
+ * @param on_body  Body consumer, or NULL to discard the body.
+ * @param user     User pointer passed to on_body.
+ */
+void http_parser_init(struct http_parser *parser, http_body_cb on_body, void *user);
+
+/**
+ * @brief Feed received bytes to the parser.
+ *
+ * Parsing stops at the end of the response; bytes after it (a pipelined
+ * response) are not consumed.
+ *
+ * @param parser    Parser.
+ * @param data      Received bytes.
+ * @param len       Number of bytes.
+ * @param consumed  Receives how many bytes belonged to this response.
+ *
+ * @return 1 when the response is complete, 0 when more input is needed,
+ *         -1 on error.
+ */
+int http_parser_feed(struct http_parser *parser, const char *data, size_t len, size_t *consumed);
+
+/**
+ * @brief Signal that the peer closed the connection.
+ *
+ * @return 1 if the response is complete (including bodies delimited by
+ *         connection close), -1 if it was truncated.
+ */
+int http_parser_finish(struct http_parser *parser);
+
+/**
+ * @brief Take ownership of the raw header block.
+ *
+ * @return The header string (caller frees), or NULL if none was parsed.
+ */
+char *http_parser_take_header(struct http_parser *parser);
+
+/**
+ * @brief Release memory held by the parser.
+ */
+void http_parser_free(struct http_parser *parser);
+
+#endif
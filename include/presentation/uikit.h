@@ -10,6 +10,9 @@
 #define UIKIT_H
 
 #include "../lib/termbox.h"
+#include "../utils/arena.h"
+#include "../utils/fuzzy.h"
+#include <stdbool.h>
 
 /* UI Box Drawing Characters (Unicode) */
 #define BOX_ROUND_TOP_LEFT     0x256D /**< Rounded top-left corner: ╭ */
@@ -38,6 +41,12 @@
 #define PRIMARY_COLOR    0x0007 /**< Primary color (Cyan) */
 #define BACKGROUND_COLOR 0x0000 /**< Background color (Black) */
 
+/* Search */
+#define SEARCH_TOP_K        128   /**< Matches put in final order per ranking step */
+#define SEARCH_PARALLEL_MIN 16384 /**< Candidates from which scoring uses worker threads */
+#define SEARCH_MAX_WORKERS  8     /**< Upper bound of scoring threads */
+#define SEARCH_CANCELLED    (-2)  /**< search_index_filter() was interrupted */
+
 /**
  * @brief Vim Motion event
  *
@@ -69,6 +78,103 @@ struct listview_item {
   char *name;
 };
 
+/**
+ * @brief Items of a listview, provided on demand.
+ *
+ * listview_from_source() asks for the items it draws, so a list can be shown
+ * straight from where it lives (a mapped snapshot, a paged remote source)
+ * without building an array of every item first.
+ *
+ * Without a filter callback the names are indexed once, through get_item,
+ * and searched by listview itself; item indices stay the indices of the
+ * source. With one, the source does its own searching: after filter()
+ * returns, count() and get_item() address the filtered rows in the order
+ * they are to be shown.
+ *
+ * A source whose items are still arriving (fetched in the background, say)
+ * sets update and update_fd. listview then starts right away, with whatever
+ * items there are or a loading indicator when there are none, and calls
+ * update() each time update_fd becomes readable.
+ *
+ * @param ctx        Passed to every callback.
+ * @param count      Number of items (rows after the last filter, if any).
+ * @param get_item   Fill dest with item index, return 0 or -1 if it is not
+ *                   available. The strings must stay valid until the next
+ *                   call to filter or update, or the end of the listview.
+ * @param filter     Apply a query, return 0 or -1 to keep the previous rows.
+ *                   NULL to let listview search the names.
+ * @param update     Take in what made update_fd readable. Sets *changed when
+ *                   the items were replaced (a filtering source keeps its
+ *                   last query applied). Return 1 while more updates are to
+ *                   come, 0 after the last one, -1 if the source failed; in
+ *                   the last two cases update_fd is no longer watched, and
+ *                   if there are no items to show by then the listview ends
+ *                   as if the user quit. NULL for a source that never
+ *                   changes.
+ * @param update_fd  Readable when update() has something to take in; only
+ *                   used with update.
+ */
+struct listview_source {
+  void *ctx;
+  int (*count)(void *ctx);
+  int (*get_item)(void *ctx, int index, struct listview_item *dest);
+  int (*filter)(void *ctx, const char *query);
+  int (*update)(void *ctx, bool *changed);
+  int update_fd;
+};
+
+/**
+ * @brief Scored candidate of a search_index query.
+ */
+struct search_match {
+  int index;
+  double score;
+};
+
+struct search_pool;
+
+/**
+ * @brief Search index over the items of one listview() session.
+ *
+ * Built once, so filtering never lowercases or measures an item again, and
+ * an item whose mask lacks a character of the query is rejected with a
+ * single AND before it is scored. The ranking of the last query is kept:
+ * repeating it costs nothing and a query that extends it only rescores the
+ * items that matched before. Matches are ranked lazily: only the first
+ * @p sorted entries of order are final, see search_index_rank().
+ *
+ * Indexes of at least SEARCH_PARALLEL_MIN items own a pool of worker
+ * threads, kept for the lifetime of the index, that score slices of the
+ * candidates in parallel.
+ *
+ * @param entries    One entry per item, in item order.
+ * @param count      Number of entries.
+ * @param order      Item indices of the current ranking, matches first.
+ * @param matched    Number of leading order entries that match query.
+ * @param sorted     Number of leading order entries in final rank order.
+ * @param query      Lowercased query the ranking belongs to, NULL before the
+ *                   first filter.
+ * @param matches    Scratch space for scoring, count entries.
+ * @param misses     Scratch space for rejected items, count entries.
+ * @param pool       Scoring threads, NULL for small indexes.
+ * @param cancel_fd  File descriptor that interrupts a parallel filter when
+ *                   it becomes readable (the terminal input), -1 for none.
+ * @param arena      Holds the lowercase copies and word-end flags.
+ */
+struct search_index {
+  struct fuzzy_entry *entries;
+  int count;
+  int *order;
+  int matched;
+  int sorted;
+  char *query;
+  struct search_match *matches;
+  int *misses;
+  struct search_pool *pool;
+  int cancel_fd;
+  struct arena arena;
+};
+
 /**
  * @brief Vim-like motion
  *
@@ -152,6 +258,13 @@ void inputtext(const int x, const int y, const char *input, const int enabled);
  */
 void scrollbar(int current_index, int item_count, int visible_lines, int *offset);
 
+/**
+ * @brief Fuzzy score of a string against a query, case-insensitive.
+ *
+ * @return Score (higher is better), or -DBL_MAX if pattern does not match.
+ */
+double fuzzy_score(const char *str, const char *pattern);
+
 /**
  * @brief Filter and sort items based on fuzzy search query.
  *
@@ -174,6 +287,74 @@ void scrollbar(int current_index, int item_count, int visible_lines, int *offset
  */
 void list_filter(struct listview_item items[], const int count, char *query);
 
+/**
+ * @brief Build the search index of a list of items.
+ *
+ * @param index  Destination index.
+ * @param items  Items to index; only the names are read.
+ * @param count  Number of items.
+ *
+ * @return 0 on success, -1 on allocation failure.
+ *
+ * @warning index must be released with search_index_free().
+ */
+int search_index_build(struct search_index *index, const struct listview_item items[],
+                       const int count);
+
+/**
+ * @brief Build the search index of the items of a source.
+ *
+ * Every item is read through source->get_item once; nothing of the source
+ * is kept.
+ *
+ * @return 0 on success, -1 on allocation failure or if an item cannot be
+ *         read.
+ *
+ * @warning index must be released with search_index_free().
+ */
+int search_index_build_source(struct search_index *index, const struct listview_source *source);
+
+/**
+ * @brief Rank the indexed items against a query.
+ *
+ * Updates index->order: matches first, best score first, then the items
+ * that do not match, each group in item order for equal scores. Scores are
+ * identical to fuzzy_score(). Nothing is rescored when the query is the
+ * same as the previous one.
+ *
+ * Non-matches are partitioned out in one pass and only the best
+ * SEARCH_TOP_K matches are sorted; the rest are ranked on demand by
+ * search_index_rank(). With a worker pool every thread keeps its own top
+ * SEARCH_TOP_K and the lists are merged at the end. A parallel filter stops
+ * early when index->cancel_fd becomes readable, so a new keystroke does not
+ * wait behind a query that is already outdated.
+ *
+ * @param index  Search index.
+ * @param query  The search query string (empty keeps the item order).
+ *
+ * @return Number of matching items, -1 on allocation failure or
+ *         SEARCH_CANCELLED; in both cases the previous ranking is kept.
+ */
+int search_index_filter(struct search_index *index, const char *query);
+
+/**
+ * @brief Make sure the first entries of index->order are in final order.
+ *
+ * Selects the next best matches out of the unranked remainder and sorts
+ * only those, at least SEARCH_TOP_K at a time.
+ *
+ * @param index  Search index.
+ * @param upto   Number of leading entries that must be ranked.
+ *
+ * @return Number of ranked entries (index->sorted).
+ */
+int search_index_rank(struct search_index *index, int upto);
+
+/**
+ * @brief Release a search index.
+ */
+void search_index_free(struct search_index *index);
+
 /**
  * @brief Display an interactive selection menu.
  *
@@ -182,13 +363,31 @@ void list_filter(struct listview_item items[], const int count, char *query);
  * selection or 'q' to quit.
  *
  * @param title     Title
- * @param items     Array of strings to display.
+ * @param items     Array of strings to display. The array is not reordered.
  * @param count     Number of items in the array.
- * @param selected  Pointer to an integer where the selected index will be stored.
- *                  Will be set to -1 if the user quits without selecting.
+ * @param selected  Pointer to an integer where the index (into items) of the
+ *                  selected item will be stored.
+ *                  Will be set to -1 if the user quits without selecting,
+ *                  or when the list is empty or cannot be shown.
  *
  * @note This function handles termbox initialization and cleanup internally.
  */
 void listview(const char *title, struct listview_item items[], const int count, int *selected);
 
+/**
+ * @brief Display an interactive selection menu over a data source.
+ *
+ * Same interface as listview(), except that items are read from @p source
+ * only when a row is drawn, see struct listview_source.
+ *
+ * @param title     Title
+ * @param source    Items to display.
+ * @param selected  Receives the index of the selected item as passed to
+ *                  source->get_item (for a filtering source: the row after
+ *                  its last filter), or -1 if the user quits without
+ *                  selecting, there is nothing to select or the list
+ *                  cannot be shown. Its value on entry is the initial cursor.
+ */
+void listview_from_source(const char *title, const struct listview_source *source, int *selected);
+
 #endif
@@ -0,0 +1,62 @@
+/**
+ * @file arena.h
+ * @brief Bump allocator for data that is released all at once.
+ *
+ * Parsed responses consist of many small strings that share one lifetime.
+ * An arena hands them out from a few large blocks and frees every block in
+ * one call instead of one free() per string.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE (16 * 1024) /**< Default block size */
+
+struct arena_block;
+
+/**
+ * @brief An arena. A zero-initialized struct is an empty, usable arena.
+ */
+struct arena {
+  struct arena_block *head; /**< Most recent block, NULL when empty */
+  size_t block_size;        /**< Size of new blocks, 0 for ARENA_BLOCK_SIZE */
+};
+
+/**
+ * @brief Prepare an empty arena.
+ *
+ * @param arena       Arena to initialize.
+ * @param block_size  Size of each block, 0 for ARENA_BLOCK_SIZE. Pick it so
+ *                    the expected data fits in a single block.
+ */
+void arena_init(struct arena *arena, size_t block_size);
+
+/**
+ * @brief Allocate memory aligned for any type.
+ *
+ * Requests larger than the block size get a block of their own.
+ *
+ * @return Pointer valid until arena_free(), or NULL when out of memory.
+ */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/**
+ * @brief Allocate zeroed memory, see arena_alloc().
+ */
+void *arena_calloc(struct arena *arena, size_t size);
+
+/**
+ * @brief Copy @p len bytes of @p str into the arena and null-terminate them.
+ *
+ * @return The copy, or NULL when out of memory.
+ */
+char *arena_strndup(struct arena *arena, const char *str, size_t len);
+
+/**
+ * @brief Release every block of the arena and leave it empty.
+ */
+void arena_free(struct arena *arena);
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * @file fsutils.h
+ * @brief Filesystem helpers for the on-disk cache.
+ *
+ * Resolves the XDG cache directory used by muslimkit and provides
+ * whole-file read and atomic write primitives so cache files are never
+ * observed half-written.
+ */
+
+#ifndef FSUTILS_H
+#define FSUTILS_H
+
+#include <stddef.h>
+
+#define CACHE_APP_DIR "muslimkit" /**< Subdirectory created under the XDG cache dir */
+
+/**
+ * @brief Resolve (and create) the muslimkit cache directory.
+ *
+ * Uses `$XDG_CACHE_HOME/muslimkit` when XDG_CACHE_HOME is set to an absolute
+ * path, otherwise `$HOME/.cache/muslimkit`. Missing directories are created
+ * with mode 0700.
+ *
+ * @param dest      Buffer receiving the directory path.
+ * @param dest_len  Size of the buffer.
+ *
+ * @return 0 on success, -1 if no usable directory could be resolved.
+ */
+int cache_dir(char *dest, size_t dest_len);
+
+/**
+ * @brief Build the full path of a file inside the cache directory.
+ *
+ * @param name      File name (e.g. "cities.v1").
+ * @param dest      Buffer receiving the path.
+ * @param dest_len  Size of the buffer.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int cache_path(const char *name, char *dest, size_t dest_len);
+
+/**
+ * @brief Read a whole file into a null-terminated heap buffer.
+ *
+ * @param path  File to read.
+ * @param size  Optional pointer receiving the number of bytes read.
+ *
+ * @return Heap buffer on success, NULL if the file is missing or unreadable.
+ *
+ * @warning The returned buffer must be released with free().
+ */
+char *read_file(const char *path, size_t *size);
+
+/**
+ * @brief Atomically replace a file with new contents.
+ *
+ * Writes into a temporary file next to @p path, flushes it to disk and
+ * renames it over the destination, so readers either see the old or the
+ * new contents but never a partial write.
+ *
+ * @param path  Destination file.
+ * @param data  Bytes to write.
+ * @param len   Number of bytes.
+ *
+ * @return 0 on success, -1 on failure (the old file is left untouched).
+ */
+int atomic_write_file(const char *path, const void *data, size_t len);
+
+#endif
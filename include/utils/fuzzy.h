@@ -0,0 +1,123 @@
+/**
+ * @file fuzzy.h
+ * @brief Fuzzy subsequence matcher with vectorized kernels.
+ *
+ * Scores a lowercase pattern against prepared lowercase text. Instead of
+ * stepping through the text one byte at a time, the matcher jumps to the
+ * next occurrence of each pattern character; that scan runs on SSE2 or
+ * AVX2 (x86) or NEON (ARM), picked at runtime, with a portable byte loop as
+ * fallback. Every kernel returns exactly the same scores.
+ */
+
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FUZZY_PAD   32 /**< Readable slack after an entry, so kernels never load past it */
+#define FUZZY_BATCH 64 /**< Suggested number of entries per fuzzy_match_batch() call */
+
+/**
+ * @brief Bytes of storage needed by fuzzy_entry_init() for a text.
+ */
+#define FUZZY_ENTRY_SIZE(length) ((size_t)(length) * 2 + 1 + FUZZY_PAD)
+
+/**
+ * @brief Prepared text to match against.
+ *
+ * @param lower     Lowercase, null-terminated copy of the text.
+ * @param word_end  Per byte of lower: 1 when the byte ends a word (it is the
+ *                  last byte or the next one is not alphanumeric).
+ * @param length    Length of lower in bytes.
+ * @param mask      Character presence bitmask, see fuzzy_pattern_mask().
+ */
+struct fuzzy_entry {
+  const char *lower;
+  const unsigned char *word_end;
+  int length;
+  uint64_t mask;
+};
+
+/**
+ * @brief Matcher implementations.
+ */
+enum fuzzy_kernel {
+  FUZZY_KERNEL_AUTO,   /**< Best kernel the CPU supports */
+  FUZZY_KERNEL_SCALAR, /**< Portable byte loop */
+  FUZZY_KERNEL_SSE2,   /**< 16 bytes per step (x86) */
+  FUZZY_KERNEL_AVX2,   /**< 32 bytes per step (x86) */
+  FUZZY_KERNEL_NEON,   /**< 16 bytes per step (ARM) */
+};
+
+/**
+ * @brief Prepare a text for matching.
+ *
+ * @param entry    Entry to fill.
+ * @param text     Text to prepare (any case).
+ * @param length   Length of text.
+ * @param storage  FUZZY_ENTRY_SIZE(length) bytes owned by the caller, which
+ *                 must outlive the entry.
+ */
+void fuzzy_entry_init(struct fuzzy_entry *entry, const char *text, int length, char *storage);
+
+/**
+ * @brief ASCII-lowercase @p length bytes of @p src into @p dest.
+ */
+void fuzzy_lower(char *dest, const char *src, int length);
+
+/**
+ * @brief Character presence bitmask of a lowercase string.
+ *
+ * An entry can only match a pattern if (entry->mask & pattern_mask) equals
+ * pattern_mask. Letters, digits and space have distinct bits; other bytes
+ * may share one, which only lets a few impossible entries through.
+ */
+uint64_t fuzzy_pattern_mask(const char *pattern, int length);
+
+/**
+ * @brief Fuzzy match score of a lowercase pattern.
+ *
+ * Scoring breakdown:
+ * - Base match: 10 points
+ * - Consecutive matches: +5 points per consecutive character
+ * - Word boundary matches: +15 points
+ * - Non-matching characters before the last match: -1 point
+ *
+ * @param entry     Prepared text.
+ * @param pattern   Lowercase pattern.
+ * @param patternl  Length of pattern.
+ *
+ * @return Score (higher is better), 0.0 for an empty pattern, or -DBL_MAX
+ *         if the pattern does not match.
+ */
+double fuzzy_match(const struct fuzzy_entry *entry, const char *pattern, int patternl);
+
+/**
+ * @brief Score one pattern against several entries.
+ *
+ * Entries rejected by the presence mask are not scanned at all.
+ *
+ * @param entries   Entries to score.
+ * @param count     Number of entries.
+ * @param pattern   Lowercase pattern.
+ * @param patternl  Length of pattern.
+ * @param scores    Receives count scores, as fuzzy_match().
+ */
+void fuzzy_match_batch(const struct fuzzy_entry *const entries[], int count, const char *pattern,
+                       int patternl, double scores[]);
+
+/**
+ * @brief Choose the matcher implementation.
+ *
+ * @return 0 on success, -1 if the kernel is not supported by this CPU or
+ *         build (the current kernel is kept).
+ */
+int fuzzy_set_kernel(enum fuzzy_kernel kernel);
+
+/**
+ * @brief Name of the kernel in use ("scalar", "sse2", "avx2" or "neon").
+ */
+const char *fuzzy_kernel_name(void);
+
+#endif
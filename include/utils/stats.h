@@ -0,0 +1,125 @@
+/**
+ * @file stats.h
+ * @brief Timing spans around the hot paths, reported by --stats.
+ *
+ * A span is opened and closed around one stage of the work (resolving,
+ * connecting, reading, parsing, ...) and adds its duration, its bytes and
+ * the heap allocations made inside it to the totals of its phase. Spans
+ * nest: a phase is only charged for its own time and allocations, what
+ * nested spans took goes to theirs, so the phases add up to at most the
+ * wall time. Until stats_enable() is called a span costs a load and a
+ * branch, and nothing is recorded.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @brief Stage a span is charged to.
+ *
+ * @enum STATS_DNS       Host name resolution, htoip()
+ * @enum STATS_CONNECT   TCP connect, fconnect()
+ * @enum STATS_TLS       TLS handshake
+ * @enum STATS_TRANSFER  SSL_read() and SSL_write() of requests and responses
+ * @enum STATS_DECODE    Decompression of response bodies
+ * @enum STATS_PARSE     JSON parsing of the city and schedule responses
+ * @enum STATS_CACHE     Mapping and writing cache snapshots
+ * @enum STATS_FILTER    Fuzzy filtering of the city list
+ * @enum STATS_RENDER    Sending listview frames to the terminal
+ */
+enum stats_phase {
+  STATS_DNS,
+  STATS_CONNECT,
+  STATS_TLS,
+  STATS_TRANSFER,
+  STATS_DECODE,
+  STATS_PARSE,
+  STATS_CACHE,
+  STATS_FILTER,
+  STATS_RENDER,
+  STATS_PHASE_COUNT,
+};
+
+/**
+ * @brief Events counted for the report, next to the phases.
+ *
+ * @enum STATS_TLS_HANDSHAKES  Completed TLS handshakes
+ * @enum STATS_TLS_RESUMED     Handshakes that resumed the offered session
+ * @enum STATS_TLS_REJECTED    Handshakes whose offered session the server declined
+ * @enum STATS_TLS_NOT_OFFERED Handshakes with no resumable session to offer
+ */
+enum stats_counter {
+  STATS_TLS_HANDSHAKES,
+  STATS_TLS_RESUMED,
+  STATS_TLS_REJECTED,
+  STATS_TLS_NOT_OFFERED,
+  STATS_COUNTER_COUNT,
+};
+
+/**
+ * @brief Format of the report printed at exit.
+ */
+enum stats_format { STATS_TEXT, STATS_JSON };
+
+/**
+ * @brief An open span, on the stack of the code it measures.
+ */
+struct stats_span {
+  uint64_t start;           /**< Monotonic ns at the start, 0 when stats are off */
+  uint64_t nested_ns;       /**< Time of the spans nested inside */
+  uint64_t allocs;          /**< Allocation count of the thread at the start */
+  uint64_t nested_allocs;   /**< Allocations of the spans nested inside */
+  struct stats_span *outer; /**< Span this one is nested in, NULL at the top */
+};
+
+/** @brief Set once by stats_enable(), before any thread is started. */
+extern bool stats_enabled;
+
+void stats_span_open(struct stats_span *span);
+void stats_counter_add(enum stats_counter counter);
+void stats_span_close(struct stats_span *span, enum stats_phase phase, size_t bytes);
+
+/**
+ * @brief Open a span, a no-op unless stats are enabled.
+ */
+static inline void stats_begin(struct stats_span *span) {
+  span->start = 0;
+  if (stats_enabled)
+    stats_span_open(span);
+}
+
+/**
+ * @brief Close a span opened with stats_begin() on the same thread.
+ *
+ * @param phase  Phase the span is charged to.
+ * @param bytes  Bytes the span moved or processed, 0 if it does not apply.
+ */
+static inline void stats_end(struct stats_span *span, enum stats_phase phase, size_t bytes) {
+  if (span->start != 0)
+    stats_span_close(span, phase, bytes);
+}
+
+/**
+ * @brief Count an event, a no-op unless stats are enabled.
+ */
+static inline void stats_count(enum stats_counter counter) {
+  if (stats_enabled)
+    stats_counter_add(counter);
+}
+
+/**
+ * @brief Start recording, and print the report to stderr at exit.
+ */
+void stats_enable(enum stats_format format);
+
+/**
+ * @brief Print the per-phase totals recorded so far.
+ */
+void stats_report(FILE *out, enum stats_format format);
+
+#endif
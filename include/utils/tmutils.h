@@ -10,6 +10,51 @@ struct tmutils {
   int seconds;
 };
 
+#include <limits.h>
+#include <time.h>
+
+#define TMUTILS_LOCAL_ZONE LONG_MIN /**< UTC offset argument for the machine's time zone */
+
 void get_current_time(struct tmutils *dest);
 
+/**
+ * @brief Local calendar time of a timestamp.
+ */
+void get_time_at(time_t when, struct tmutils *dest);
+
+/**
+ * @brief Timestamp of a local wall clock time.
+ *
+ * Out of range fields are carried over (day 32 is the first of next month,
+ * minute 1500 the next day) and daylight saving time is resolved for that
+ * date, not today's.
+ *
+ * @return The timestamp, or -1 if it cannot be represented.
+ */
+time_t local_time_at(int year, int month, int day, int hours, int minutes);
+
+/**
+ * @brief Calendar time of a timestamp at a fixed UTC offset.
+ *
+ * @param utc_offset  Seconds east of UTC, or TMUTILS_LOCAL_ZONE for
+ *                    get_time_at().
+ */
+void get_zone_time_at(time_t when, long utc_offset, struct tmutils *dest);
+
+/**
+ * @brief Timestamp of a wall clock time at a fixed UTC offset, see
+ *        local_time_at(), which TMUTILS_LOCAL_ZONE stands for.
+ */
+time_t zone_time_at(int year, int month, int day, int hours, int minutes, long utc_offset);
+
+/**
+ * @brief Number of days of a Gregorian month (1-12).
+ */
+int days_in_month(int year, int month);
+
+/**
+ * @brief Offset of the local time zone from UTC right now, in seconds east.
+ */
+long get_utc_offset(void);
+
 #endif
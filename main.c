@@ -12,55 +12,622 @@
 
 #include "include/domain/get_cities.h"
 #include "include/domain/get_prayer_times.h"
+#include "include/domain/notifier.h"
+#include "include/domain/prayer_calc.h"
+#include "include/domain/schedule_batch.h"
+#include "include/domain/schedule_shm.h"
+#include "include/network/connection.h"
 #include "include/presentation/uikit.h"
+#include "include/utils/stats.h"
+#include "include/utils/tmutils.h"
+#include <math.h>
+
+/**
+ * @brief Cities shown by the city listview, while a fresh list may be on its way.
+ */
+struct city_list {
+  struct cities_s cities; /**< The cached list, then the fetched one once it is in */
+  struct city_fetch fetch;
+  bool fetching; /**< fetch was started and not finished yet */
+};
+
+/**
+ * @brief Number of cities, for the city listview.
+ */
+static int city_count(void *ctx) { return (int)((const struct city_list *)ctx)->cities.size; }
+
+/**
+ * @brief City as a listview item. The strings stay in the cities data.
+ */
+static int city_get_item(void *ctx, int index, struct listview_item *dest) {
+  const struct cities_s *cities = &((const struct city_list *)ctx)->cities;
+  if (index < 0 || (size_t)index >= cities->size)
+    return -1;
+
+  dest->id = cities->data[index].id;       /* City ID (e.g., "1301") */
+  dest->name = cities->data[index].lokasi; /* City name (e.g., "Jakarta") */
+  return 0;
+}
+
+/**
+ * @brief The background fetch is done: show its cities in place of the cached ones.
+ *
+ * A failed fetch keeps the cached list, if there is one.
+ */
+static int city_update(void *ctx, bool *changed) {
+  struct city_list *list = ctx;
+  struct cities_s fresh;
+  memset(&fresh, 0, sizeof(fresh));
+
+  list->fetching = false;
+  if (get_city_fetch_finish(&list->fetch, &fresh) < 0)
+    return -1;
+
+  get_city_free(&list->cities);
+  list->cities = fresh;
+  *changed = true;
+  return 0;
+}
+
+/**
+ * @brief Wait for a background fetch the listview did not see the end of.
+ *
+ * The listview's selection indexes the cities it showed, so they are kept;
+ * the fetch still rewrote the cache for the next run.
+ */
+static void city_list_settle(struct city_list *list) {
+  if (!list->fetching)
+    return;
+
+  struct cities_s fresh;
+  memset(&fresh, 0, sizeof(fresh));
+  list->fetching = false;
+  if (get_city_fetch_finish(&list->fetch, &fresh) == 0)
+    get_city_free(&fresh);
+}
+
+/**
+ * @brief stderr held back while the terminal UI is up.
+ */
+struct stderr_hold {
+  int saved;  /**< The real stderr, -1 when nothing is held */
+  FILE *file; /**< Temporary file receiving the messages meanwhile */
+};
+
+/**
+ * @brief Send stderr to a temporary file until stderr_release().
+ *
+ * Messages of a fetch running behind the listview would be written over the
+ * screen; this way they are printed once it is gone. When no temporary file
+ * can be made stderr is left alone.
+ */
+static void stderr_hold(struct stderr_hold *hold) {
+  hold->saved = -1;
+  hold->file = tmpfile();
+  if (hold->file == NULL)
+    return;
+
+  fflush(stderr);
+  hold->saved = dup(STDERR_FILENO);
+  if (hold->saved < 0 || dup2(fileno(hold->file), STDERR_FILENO) < 0) {
+    if (hold->saved >= 0)
+      close(hold->saved);
+    hold->saved = -1;
+    fclose(hold->file);
+  }
+}
+
+/**
+ * @brief Restore stderr and print what was written to it meanwhile.
+ */
+static void stderr_release(struct stderr_hold *hold) {
+  if (hold->saved < 0)
+    return;
+
+  fflush(stderr);
+  dup2(hold->saved, STDERR_FILENO);
+  close(hold->saved);
+  hold->saved = -1;
+
+  char buf[512];
+  size_t n;
+  rewind(hold->file);
+  while ((n = fread(buf, 1, sizeof(buf), hold->file)) > 0)
+    fwrite(buf, 1, n, stderr);
+  fclose(hold->file);
+}
+
+/**
+ * @brief Print a monthly schedule.
+ */
+static void print_schedule(const struct prayer_times *prayer_t) {
+  printf("Schedule size: %d\n", prayer_t->data.schedule_size);
+
+  for (int i = 0; i < prayer_t->data.schedule_size; i++) {
+    const struct prayer_times_data_schedule *day = &prayer_t->data.schedule[i];
+    char text[SCHEDULE_TIME_LEN];
+
+    printf("{\n");
+    printf("  'date':'%04d-%02d-%02d'\n", day->year, day->month, day->day);
+    printf("  'fajr':'%s'\n", schedule_format_time(day->times[SCHEDULE_FAJR], text));
+    printf("  'dhuha':'%s'\n", schedule_format_time(day->times[SCHEDULE_DHUHA], text));
+    printf("  'dzuhr':'%s'\n", schedule_format_time(day->times[SCHEDULE_DZUHR], text));
+    printf("  'ashr':'%s'\n", schedule_format_time(day->times[SCHEDULE_ASHR], text));
+    printf("  'magrib':'%s'\n", schedule_format_time(day->times[SCHEDULE_MAGHRIB], text));
+    printf("  'isya':'%s'\n", schedule_format_time(day->times[SCHEDULE_ISYA], text));
+    printf("}\n");
+  }
+}
+
+/**
+ * @brief Coordinates and method of an offline calculation.
+ */
+struct calculated_source {
+  struct prayer_location location;
+  struct prayer_params params;
+  long utc_offset; /**< Seconds east of UTC of the times, TMUTILS_LOCAL_ZONE without UTC */
+};
+
+/**
+ * @brief Parse the --coords and --method options.
+ *
+ * @param coords  "LAT,LON" or "LAT,LON,UTC_OFFSET"; without an offset the
+ *                local time zone is used.
+ * @param method  Calculation method name, see prayer_method_from_name().
+ *
+ * @return 0 on success, -1 on invalid arguments.
+ */
+static int parse_calculated(const char *coords, const char *method,
+                            struct calculated_source *dest) {
+  struct prayer_location *location = &dest->location;
+  int fields = sscanf(coords, "%lf,%lf,%lf", &location->latitude, &location->longitude,
+                      &location->utc_offset);
+  if (fields < 2) {
+    fprintf(stderr, "Invalid coordinates: %s (expected LAT,LON[,UTC_OFFSET])\n", coords);
+    return -1;
+  }
+  if (fields == 2)
+    location->utc_offset = get_utc_offset() / 3600.0;
+
+  /* Times calculated for an explicit offset are on that clock, not the machine's */
+  dest->utc_offset = fields == 2 ? TMUTILS_LOCAL_ZONE : lround(location->utc_offset * 3600);
+
+  int method_id = prayer_method_from_name(method);
+  if (method_id < 0 || prayer_params_init(&dest->params, method_id) < 0) {
+    fprintf(stderr, "Unknown method: %s\n", method);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Notifier schedule source calculating months for coordinates.
+ */
+static int load_calculated(void *ctx, int year, int month, struct prayer_times *dest) {
+  const struct calculated_source *source = ctx;
+  return prayer_calc_month(&source->params, &source->location, year, month, dest);
+}
+
+/**
+ * @brief Notifier schedule source reading a city's months from the cache.
+ *
+ * Every load also warms next month near the month end, so a daemon running
+ * across it never waits on the API.
+ */
+static int load_city(void *ctx, int year, int month, struct prayer_times *dest) {
+  const char *city_id = ctx;
+  int loaded = get_prayer_times_cached(city_id, year, month, dest);
+  get_prayer_times_prefetch(city_id);
+  return loaded;
+}
+
+/**
+ * @brief Run the notification daemon, publishing the schedule for other
+ *        programs when no other daemon does already.
+ *
+ * @return 1, the daemon only returns on failure.
+ */
+static int run_notifier(notifier_load_fn load, void *ctx, long utc_offset) {
+  struct schedule_shm shm;
+  bool publishing = schedule_shm_create(&shm) == 0;
+  notifier_run(load, ctx, utc_offset, stdout, publishing ? &shm : NULL);
+  if (publishing)
+    schedule_shm_close(&shm);
+  return 1;
+}
+
+/**
+ * @brief Print the next prayer published by a running daemon, for --next.
+ *
+ * @return 0 on success, 1 when no daemon publishes a schedule with a later prayer.
+ */
+static int print_next(void) {
+  struct schedule_shm shm;
+  if (schedule_shm_open(&shm) < 0) {
+    fprintf(stderr, "No schedule is published, start muslimkit --daemon first\n");
+    return 1;
+  }
+
+  struct schedule_shm_data data;
+  int read = schedule_shm_read(&shm, &data);
+  schedule_shm_close(&shm);
+
+  struct notifier_event next;
+  if (read < 0 || schedule_shm_next(&data, time(NULL), &next) < 0) {
+    fprintf(stderr, "The published schedule has no later prayer\n");
+    return 1;
+  }
+
+  /* On the clock of the schedule, as the daemon announces it */
+  struct tmutils at;
+  get_zone_time_at(next.at, schedule_shm_utc_offset(&data), &at);
+  printf("%02d:%02d %s\n", at.hours, at.minutes, next.name);
+  return 0;
+}
+
+/**
+ * @brief Print this month's schedule calculated for coordinates, offline.
+ *
+ * @return 0 on success, 1 on failure.
+ */
+static int print_calculated(const struct calculated_source *source) {
+  /* The month is the one at the coordinates' offset, not the machine's */
+  struct tmutils now;
+  get_zone_time_at(time(NULL), source->utc_offset, &now);
+
+  struct prayer_times prayer_t;
+  if (prayer_calc_month(&source->params, &source->location, now.year, now.month, &prayer_t) < 0)
+    return 1;
+
+  print_schedule(&prayer_t);
+  get_prayer_times_free(&prayer_t);
+  return 0;
+}
+
+/**
+ * @brief Months of a --batch file, with the strings of their city IDs.
+ */
+struct batch_list {
+  struct schedule_request *requests;
+  int count;
+  int capacity;
+  struct arena arena;
+};
+
+static int batch_list_append(struct batch_list *list, const char *city_id, int year, int month) {
+  if (list->count == list->capacity) {
+    int capacity = list->capacity ? list->capacity * 2 : 64;
+    struct schedule_request *requests =
+        realloc(list->requests, sizeof(struct schedule_request) * capacity);
+    if (requests == NULL) {
+      fprintf(stderr, "Cannot allocate memory for the batch\n");
+      return -1;
+    }
+    list->requests = requests;
+    list->capacity = capacity;
+  }
+
+  char *id = arena_strndup(&list->arena, city_id, strlen(city_id));
+  if (id == NULL) {
+    fprintf(stderr, "Cannot allocate memory for the batch\n");
+    return -1;
+  }
+  list->requests[list->count++] = (struct schedule_request){id, year, month};
+  return 0;
+}
+
+/**
+ * @brief Read the months of a --batch file.
+ *
+ * One `CITY_ID [YYYY-MM]` per line, the current month when no month is
+ * given; `*` stands for every city of the city list. Empty lines and lines
+ * starting with `#` are skipped.
+ *
+ * @param path  File to read, "-" for stdin.
+ *
+ * @return 0 on success, -1 on a read or syntax error.
+ */
+static int parse_batch(const char *path, bool refresh, struct batch_list *dest) {
+  FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+  if (in == NULL) {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return -1;
+  }
+
+  struct tmutils now;
+  get_current_time(&now);
+
+  struct cities_s cities;
+  memset(&cities, 0, sizeof(cities));
+  bool have_cities = false;
+
+  int status = 0;
+  char line[256];
+  for (int number = 1; status == 0 && fgets(line, sizeof(line), in); number++) {
+    char city_id[64];
+    int year = now.year, month = now.month;
+    char extra;
+    int fields = sscanf(line, "%63s %d-%d %c", city_id, &year, &month, &extra);
+    if (fields <= 0 || city_id[0] == '#')
+      continue;
+    if (fields == 2 || fields > 3 || month < 1 || month > 12) {
+      fprintf(stderr, "%s:%d: expected CITY_ID [YYYY-MM]\n", path, number);
+      status = -1;
+      break;
+    }
+
+    if (strcmp(city_id, "*") != 0) {
+      status = batch_list_append(dest, city_id, year, month);
+      continue;
+    }
+
+    if (!have_cities) {
+      if (get_city_cached(&cities, refresh) < 0) {
+        status = -1;
+        break;
+      }
+      have_cities = true;
+    }
+    for (size_t i = 0; status == 0 && i < cities.size; i++)
+      status = batch_list_append(dest, cities.data[i].id, year, month);
+  }
+
+  if (in != stdin)
+    fclose(in);
+  if (have_cities)
+    get_city_free(&cities);
+  return status;
+}
+
+static const char *batch_status_name(enum schedule_batch_status status) {
+  switch (status) {
+  case SCHEDULE_BATCH_FETCHED:
+    return "fetched";
+  case SCHEDULE_BATCH_CACHED:
+    return "cached";
+  case SCHEDULE_BATCH_UNCHANGED:
+    return "unchanged";
+  default:
+    return "failed";
+  }
+}
+
+/**
+ * @brief Print one line per finished month on stderr.
+ */
+static void print_batch_progress(void *user, const struct schedule_request *request,
+                                 const struct schedule_result *result, int done, int total) {
+  (void)user;
+  fprintf(stderr, "[%d/%d] %s %04d-%02d %s", done, total, request->city_id, request->year,
+          request->month, batch_status_name(result->status));
+  if (result->status != SCHEDULE_BATCH_CACHED)
+    fprintf(stderr, " %.1f ms", result->latency_ms);
+  fprintf(stderr, "\n");
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Fetch the months of a --batch file into the schedule cache.
+ *
+ * @return 0 when every month is in the cache afterwards, 1 otherwise.
+ */
+static int run_batch(const char *path, const struct schedule_batch_options *options) {
+  struct batch_list list;
+  memset(&list, 0, sizeof(list));
+  arena_init(&list.arena, 4096);
+
+  int status = 1;
+  struct schedule_result *results = NULL;
+  double *latencies = NULL;
+  if (parse_batch(path, options->refresh, &list) < 0)
+    goto out;
+
+  results = malloc(sizeof(struct schedule_result) * (list.count ? list.count : 1));
+  latencies = malloc(sizeof(double) * (list.count ? list.count : 1));
+  if (results == NULL || latencies == NULL) {
+    fprintf(stderr, "Cannot allocate memory for the batch\n");
+    goto out;
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int failed = schedule_batch_fetch(list.requests, list.count, options, results);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (failed < 0)
+    goto out;
+
+  /* Latency percentiles only count the months that went to the API */
+  int counts[SCHEDULE_BATCH_FAILED + 1] = {0};
+  int fetched = 0;
+  for (int i = 0; i < list.count; i++) {
+    counts[results[i].status]++;
+    if (results[i].status != SCHEDULE_BATCH_CACHED)
+      latencies[fetched++] = results[i].latency_ms;
+  }
+  qsort(latencies, fetched, sizeof(double), compare_double);
+
+  double elapsed = (double)(end.tv_sec - start.tv_sec) * 1e3 +
+                   (double)(end.tv_nsec - start.tv_nsec) / 1e6;
+  fprintf(stderr, "%d months: %d fetched, %d unchanged, %d cached, %d failed in %.1f ms",
+          list.count, counts[SCHEDULE_BATCH_FETCHED], counts[SCHEDULE_BATCH_UNCHANGED],
+          counts[SCHEDULE_BATCH_CACHED], counts[SCHEDULE_BATCH_FAILED], elapsed);
+  if (fetched > 0)
+    fprintf(stderr, " (latency p50 %.1f ms, max %.1f ms)", latencies[fetched / 2],
+            latencies[fetched - 1]);
+  fprintf(stderr, "\n");
+  status = failed > 0 ? 1 : 0;
+
+out:
+  free(latencies);
+  free(results);
+  free(list.requests);
+  arena_free(&list.arena);
+  return status;
+}
 
 /**
  * @brief Application entry point
  *
  * Workflow:
- * 1. Fetches the list of Indonesian cities from the MyQuran API
- * 2. Displays an interactive terminal UI for city selection
- * 3. Returns the selected city (currently exits after selection)
+ * 1. Loads the list of Indonesian cities from the on-disk cache, fetching it
+ *    from the MyQuran API in the background when the cache is missing or
+ *    expired
+ * 2. Displays an interactive terminal UI for city selection right away: the
+ *    cached cities, or a loading indicator, until the fetched list comes in
+ * 3. Prints the selected city's monthly schedule from the schedule cache
  *
  * The application uses the termbox library for rendering a text-based UI
  * with support for both default arrow key navigation and vim keybindings.
  * Users can toggle between motion modes using Ctrl+/.
  *
- * @return 0 on success, 1 if city fetching fails
+ * Options:
+ * - `--refresh`               Ignore the city cache, refetch it and rewrite the cache file
+ * - `--coords LAT,LON[,UTC]`  Skip the city list and the API, print this month
+ *                             calculated for the coordinates (anywhere in the world)
+ * - `--method NAME`           Calculation method for `--coords` (default: kemenag)
+ * - `--daemon`                Instead of printing the schedule, stay running and print
+ *                             each prayer as its time comes (see notifier.h), and publish
+ *                             the month in shared memory (see schedule_shm.h)
+ * - `--next`                  Print the next prayer published by a running `--daemon`,
+ *                             without touching the cache or the network
+ * - `--batch FILE`            Fetch the months listed in FILE ("-" for stdin) into the
+ *                             schedule cache, see parse_batch(); `--refresh` revalidates
+ *                             cached months as well
+ * - `--connections N`         Concurrent connections for `--batch` (default: 4)
+ * - `--pipeline N`            Requests in flight per connection for `--batch` (default: 8)
+ * - `--rate R`                Most requests per second for `--batch` (default: no limit)
+ * - `--stats`                 At exit, print to stderr where the time went, per phase
+ *                             (DNS, connect, TLS, transfer, parsing, ...), see stats.h
+ * - `--stats-json`            Same as `--stats`, as one line of JSON
+ *
+ * @param argc  Number of command line arguments
+ * @param argv  Command line arguments
  *
- * @note Currently, the application only fetches cities and displays the
- *       selection UI. Prayer time fetching and display functionality is
- *       planned but not yet implemented.
+ * @return 0 on success, 1 if city fetching fails or an option is invalid
  *
  * Memory management:
- * - Allocates memory for city data via get_city()
- * - Creates a stack-allocated listview_item array for UI rendering
+ * - Allocates memory for city data via get_city_cache_peek() and the
+ *   background get_city_fetch_start(), joined before anything else uses the
+ *   network
+ * - The city listview reads the cities data in place, no item array is built
  * - Properly frees all allocated memory before exit
  */
-int main() {
-  /* Fetch list of Indonesian cities from MyQuran API */
-  struct cities_s cities;
-  memset(&cities, 0, sizeof(struct cities_s));
-  int get_cities = get_city(&cities);
+int main(int argc, char *argv[]) {
+  bool refresh = false;
+  const char *coords = NULL;
+  const char *method = "kemenag";
+  bool run_daemon = false;
+  bool show_next = false;
+  const char *batch = NULL;
+  struct schedule_batch_options batch_options = {0};
 
-  /* Handle error: city data failed to fetch */
-  if (get_cities < 0) {
-    get_city_free(&cities); /* Safe to call on NULL pointer */
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--refresh") == 0) {
+      refresh = true;
+    } else if (strcmp(argv[i], "--coords") == 0 && i + 1 < argc) {
+      coords = argv[++i];
+    } else if (strcmp(argv[i], "--method") == 0 && i + 1 < argc) {
+      method = argv[++i];
+    } else if (strcmp(argv[i], "--daemon") == 0) {
+      run_daemon = true;
+    } else if (strcmp(argv[i], "--next") == 0) {
+      show_next = true;
+    } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+      batch = argv[++i];
+    } else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc) {
+      batch_options.connections = atoi(argv[++i]);
+      if (batch_options.connections < 1 ||
+          batch_options.connections > SCHEDULE_BATCH_MAX_CONNECTIONS) {
+        fprintf(stderr, "--connections must be 1-%d\n", SCHEDULE_BATCH_MAX_CONNECTIONS);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+      batch_options.pipeline = atoi(argv[++i]);
+      if (batch_options.pipeline < 1 || batch_options.pipeline > SCHEDULE_BATCH_MAX_PIPELINE) {
+        fprintf(stderr, "--pipeline must be 1-%d\n", SCHEDULE_BATCH_MAX_PIPELINE);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+      batch_options.rate = atof(argv[++i]);
+      if (batch_options.rate <= 0) {
+        fprintf(stderr, "--rate must be positive\n");
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      stats_enable(STATS_TEXT);
+    } else if (strcmp(argv[i], "--stats-json") == 0) {
+      stats_enable(STATS_JSON);
+    } else {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      fprintf(stderr,
+              "Usage: %s [--refresh] [--coords LAT,LON[,UTC] [--method NAME]] [--daemon]\n"
+              "       %s [--refresh] --batch FILE [--connections N] [--pipeline N] [--rate R]\n"
+              "       %s --next\n"
+              "Add --stats or --stats-json to report time spent per phase at exit\n",
+              argv[0], argv[0], argv[0]);
+      return 1;
+    }
+  }
+
+  /* The daemon did the work already, nothing to load */
+  if (show_next)
+    return print_next();
+
+  if (batch != NULL) {
+    batch_options.refresh = refresh;
+    batch_options.progress = print_batch_progress;
+    int status = run_batch(batch, &batch_options);
+    network_cleanup();
+    return status;
+  }
+
+  /* Coordinates need neither the city list nor the network */
+  if (coords != NULL) {
+    struct calculated_source source;
+    if (parse_calculated(coords, method, &source) < 0)
+      return 1;
+    if (run_daemon)
+      return run_notifier(load_calculated, &source, source.utc_offset);
+    return print_calculated(&source);
+  }
+
+  /*
+   * Load list of Indonesian cities from the cache; when it is missing,
+   * expired or to be refreshed the MyQuran API is asked in the background,
+   * so the list shows at once and is replaced when the answer comes
+   */
+  struct city_list list;
+  memset(&list, 0, sizeof(list));
+  bool expired = true;
+  bool cached = get_city_cache_peek(&list.cities, &expired) == 0;
+  if ((!cached || expired || refresh) && get_city_fetch_start(&list.fetch, refresh) == 0)
+    list.fetching = true;
+
+  /* Handle error: no cities, and no fetch on its way either */
+  if (!cached && !list.fetching && get_city_cached(&list.cities, refresh) < 0) {
+    get_city_free(&list.cities);
+    network_cleanup();
     printf("cities NULL\n");
     return 1;
   }
 
-  /* Verify city data is valid before processing */
-  if (cities.data != NULL && cities.size > 0) {
-    /* Prepare UI data structure: convert cities to listview items */
-    struct listview_item location[cities.size];
-    memset(location, 0, sizeof(location)); /* Zero-initialize array */
+  struct stderr_hold held = {-1, NULL};
+  if (list.fetching)
+    stderr_hold(&held);
 
-    /* Map city data to listview items for UI rendering */
-    for (size_t i = 0; i < cities.size; i++) {
-      location[i].id = cities.data[i].id;       /* City ID (e.g., "1301") */
-      location[i].name = cities.data[i].lokasi; /* City name (e.g., "Jakarta") */
-    }
+  /* Verify there is something to show, or to wait for, before processing */
+  if (list.cities.size > 0 || list.fetching) {
+    /* The listview reads the cities in place, whether parsed or mapped */
+    struct listview_source source = {&list,
+                                     city_count,
+                                     city_get_item,
+                                     NULL,
+                                     list.fetching ? city_update : NULL,
+                                     list.fetching ? list.fetch.fd : -1};
 
     /* Display interactive city selection UI */
     int selected = 0; /* Index of selected city (modified by listview) */
@@ -72,34 +639,56 @@ int main() {
      * - Vim mode: j/k navigation, g/G (top/bottom), Ctrl+U/D (page up/down), '/' search
      * - Toggle modes with Ctrl+/
      */
-    listview(title, location, cities.size, &selected);
+    listview_from_source(title, &source, &selected);
+    city_list_settle(&list);
+    stderr_release(&held);
+
+    /* The fetch failed and there was no cache to show */
+    if (list.cities.size == 0) {
+      get_city_free(&list.cities);
+      network_cleanup();
+      printf("cities NULL\n");
+      return 1;
+    }
+
+    /* Quit without choosing a city */
+    if (selected < 0) {
+      get_city_free(&list.cities);
+      network_cleanup();
+      return 0;
+    }
+    const char *city_id = list.cities.data[selected].id;
+
+    if (run_daemon) {
+      int status = run_notifier(load_city, (void *)city_id, TMUTILS_LOCAL_ZONE);
+      get_city_free(&list.cities);
+      network_cleanup();
+      return status;
+    }
+
+    /* Current month comes from the schedule cache, the API is only hit on a miss */
+    struct tmutils now;
+    get_current_time(&now);
 
     struct prayer_times prayer_t;
     memset(&prayer_t, 0, sizeof(prayer_t));
-    int get_prayer = get_prayer_times(location[selected].id, &prayer_t);
+    int get_prayer = get_prayer_times_cached(city_id, now.year, now.month, &prayer_t);
     if (get_prayer < 0) {
-      get_city_free(&cities);
+      get_city_free(&list.cities);
+      network_cleanup();
       return 1;
     }
 
-    printf("Schedule size: %d\n", prayer_t.data.schedule_size);
-
-    for (int i = 0; i < prayer_t.data.schedule_size; i++) {
-      printf("{\n");
-      printf("  'date':'%s'\n", prayer_t.data.schedule[i].date);
-      printf("  'fajr':'%s'\n", prayer_t.data.schedule[i].fajr);
-      printf("  'dhuha':'%s'\n", prayer_t.data.schedule[i].dhuha);
-      printf("  'dzuhr':'%s'\n", prayer_t.data.schedule[i].dzuhr);
-      printf("  'ashr':'%s'\n", prayer_t.data.schedule[i].ashr);
-      printf("  'magrib':'%s'\n", prayer_t.data.schedule[i].maghrib);
-      printf("  'isya':'%s'\n", prayer_t.data.schedule[i].isya);
-      printf("}\n");
-    }
+    /* Near the month end, warm next month's cache without blocking */
+    get_prayer_times_prefetch(city_id);
+
+    print_schedule(&prayer_t);
 
     get_prayer_times_free(&prayer_t);
   }
 
   /* Clean up allocated memory before exit */
-  get_city_free(&cities);
+  get_city_free(&list.cities);
+  network_cleanup();
   return 0;
 }
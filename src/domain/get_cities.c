@@ -7,92 +7,213 @@
  */
 
 #include "domain/get_cities.h"
+#include "domain/snapshot.h"
 #include "lib/json.h"
 #include "network/connection.h"
+#include "utils/fsutils.h"
+#include "utils/stats.h"
+#include <errno.h>
+#include <time.h>
 
-int parse_cities_json(const char *json_str, struct cities_s *dest) {
-  JsonNode *root = json_decode(json_str);
-  if (root == NULL) {
-    printf("parse_cities_json() root NULL\n");
-    return -1;
-  }
+/**
+ * @brief Validators and freshness data stored next to the cached cities.
+ */
+struct city_cache_meta {
+  long long fetched;     /**< Unix time of the last fetch or revalidation */
+  char etag[128];        /**< ETag of the cached response, empty if none */
+  char last_modified[64]; /**< Last-Modified of the cached response, empty if none */
+};
 
-  struct cities_s *result = calloc(1, sizeof(struct cities_s));
+/**
+ * @brief Member whose value the city parser expects next.
+ */
+enum city_key {
+  CITY_KEY_NONE,
+  CITY_KEY_STATUS,
+  CITY_KEY_DATA,
+  CITY_KEY_ID,
+  CITY_KEY_LOKASI,
+};
 
-  if (result == NULL) {
-    json_delete(root);
-    printf("parse_cities_json() calloc failure\n");
-    return -1;
-  }
+/**
+ * @brief State of a streaming parse of the city list response.
+ *
+ * The response looks like `{"status": true, "data": [{"id": ..., "lokasi": ...}]}`;
+ * cities are appended to dest as their objects open and their strings are
+ * copied once, straight from the received bytes, into dest->arena.
+ */
+struct city_parser {
+  JsonSax sax;
+  struct cities_s *dest;
+  size_t capacity;  /**< Allocated entries of dest->data */
+  enum city_key key; /**< Key of the member being parsed */
+  bool in_data;     /**< Inside the top-level "data" array */
+  bool failed;      /**< Invalid JSON, the rest of the body is ignored */
+};
 
-  const bool status = json_get_bool(root, "status");
-  result->status = status;
+static bool city_append(struct city_parser *parser) {
+  struct cities_s *dest = parser->dest;
 
-  JsonNode *data = json_find_member(root, "data");
-  if (data && data->tag == JSON_ARRAY) {
-    size_t count = 0;
-    JsonNode *elem;
+  if (dest->size == parser->capacity) {
+    size_t capacity = parser->capacity ? parser->capacity * 2 : 256;
+    struct cities_data_s *data = realloc(dest->data, capacity * sizeof(struct cities_data_s));
+    if (data == NULL) {
+      fprintf(stderr, "parse_cities_json cannot allocate memory\n");
+      return false;
+    }
+    dest->data = data;
+    parser->capacity = capacity;
+  }
 
-    json_foreach(elem, data) { count++; }
+  memset(&dest->data[dest->size], 0, sizeof(struct cities_data_s));
+  dest->size++;
+  return true;
+}
 
-    result->data = calloc(count, sizeof(struct cities_data_s));
-    if (result->data == NULL) {
-      free(result);
-      json_delete(root);
-      printf("malloc fail");
-      return -1;
+static bool city_event(void *user, const JsonEvent *event) {
+  struct city_parser *parser = user;
+  struct cities_s *dest = parser->dest;
+
+  switch (event->type) {
+  case JSON_EVENT_KEY:
+    if (event->depth == 1) {
+      parser->key = json_event_is(event, "status") ? CITY_KEY_STATUS
+                    : json_event_is(event, "data") ? CITY_KEY_DATA
+                                                   : CITY_KEY_NONE;
+    } else if (event->depth == 3 && parser->in_data) {
+      parser->key = json_event_is(event, "id")       ? CITY_KEY_ID
+                    : json_event_is(event, "lokasi") ? CITY_KEY_LOKASI
+                                                     : CITY_KEY_NONE;
     }
+    break;
+
+  case JSON_EVENT_BOOL:
+    if (event->depth == 1 && parser->key == CITY_KEY_STATUS)
+      dest->status = event->bool_;
+    break;
+
+  case JSON_EVENT_ARRAY_START:
+    if (event->depth == 1 && parser->key == CITY_KEY_DATA)
+      parser->in_data = true;
+    break;
+
+  case JSON_EVENT_ARRAY_END:
+    if (event->depth == 1)
+      parser->in_data = false;
+    break;
 
-    result->size = count;
+  case JSON_EVENT_OBJECT_START:
+    if (event->depth == 2 && parser->in_data)
+      return city_append(parser);
+    break;
 
-    size_t idx = 0;
-    json_foreach(elem, data) {
-      JsonNode *id = json_find_member(elem, "id");
-      if (id && id->tag == JSON_STRING) {
-        char *tmp = id->string_;
-        result->data[idx].id = strndup(tmp, strlen(tmp));
-      }
+  case JSON_EVENT_STRING: {
+    if (event->depth != 3 || !parser->in_data)
+      break;
 
-      JsonNode *location = json_find_member(elem, "lokasi");
-      if (location && location->tag == JSON_STRING) {
-        char *tmp = location->string_;
-        result->data[idx].lokasi = strndup(tmp, strlen(tmp));
-      }
+    struct cities_data_s *city = &dest->data[dest->size - 1];
+    char **field = parser->key == CITY_KEY_ID       ? &city->id
+                   : parser->key == CITY_KEY_LOKASI ? &city->lokasi
+                                                    : NULL;
+    if (field == NULL)
+      break;
 
-      idx++;
+    *field = arena_strndup(&dest->arena, event->string, event->length);
+    if (*field == NULL) {
+      fprintf(stderr, "parse_cities_json cannot allocate memory\n");
+      return false;
     }
+    break;
   }
 
-  json_delete(root);
-  *dest = *result;
-  free(result);
+  default:
+    break;
+  }
+
+  return true;
+}
+
+static void city_parser_init(struct city_parser *parser, struct cities_s *dest) {
+  memset(parser, 0, sizeof(*parser));
+  memset(dest, 0, sizeof(*dest));
+  arena_init(&dest->arena, CITY_ARENA_BLOCK);
+  parser->dest = dest;
+  json_sax_init(&parser->sax, city_event, parser);
+}
+
+/* http_body_cb feeding received body bytes to the parser */
+static int city_parser_body(void *user, const char *data, size_t len) {
+  struct city_parser *parser = user;
+  struct stats_span span;
+  stats_begin(&span);
+  if (!parser->failed && !json_sax_feed(&parser->sax, data, len))
+    parser->failed = true;
+  stats_end(&span, STATS_PARSE, len);
   return 0;
 }
 
-int get_city(struct cities_s *dest) {
+static int city_parser_finish(struct city_parser *parser) {
+  bool complete = !parser->failed && json_sax_finish(&parser->sax);
+  json_sax_free(&parser->sax);
+  return complete ? 0 : -1;
+}
+
+int parse_cities_json(const char *json_str, struct cities_s *dest) {
+  if (json_str == NULL || dest == NULL) {
+    printf("parse_cities_json() invalid argument\n");
+    return -1;
+  }
+
+  struct city_parser parser;
+  city_parser_init(&parser, dest);
+  city_parser_body(&parser, json_str, strlen(json_str));
+
+  if (city_parser_finish(&parser) < 0) {
+    printf("parse_cities_json() invalid JSON\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Request the city list, parsing the body into @p dest as it arrives.
+ *
+ * @return 0 when a response was received, -1 on network failure. @p dest
+ *         is left empty (status false) unless the body was valid JSON.
+ */
+static int fetch_cities(const char *headers, struct http_response *response,
+                        struct cities_s *dest) {
   int endpoint_len = strlen(API_VERSION) + strlen(CITY_ENDPOINT) + 1;
   char *endpoint = malloc(endpoint_len);
   if (endpoint == NULL) {
     fprintf(stderr, "Cannot allocate memory for get_city endpoint\n");
+    memset(dest, 0, sizeof(*dest));
     return -1;
   }
   snprintf(endpoint, endpoint_len, "%s%s", API_VERSION, CITY_ENDPOINT);
 
-  struct http_response response;
-  memset(&response, 0, sizeof(response));
+  struct city_parser parser;
+  city_parser_init(&parser, dest);
 
-  int get_request = get(HOST, endpoint, &response);
+  int get_request = get_stream(HOST, endpoint, headers, city_parser_body, &parser, response);
   free(endpoint);
 
-  if (get_request < 0) {
-    http_response_free(&response);
-    return -1;
+  if (city_parser_finish(&parser) < 0 || get_request < 0) {
+    get_city_free(dest);
+    memset(dest, 0, sizeof(*dest));
   }
 
+  return get_request;
+}
+
+int get_city(struct cities_s *dest) {
+  struct http_response response;
+  memset(&response, 0, sizeof(response));
+
   struct cities_s city_s;
-  memset(&city_s, 0, sizeof(struct cities_s));
-  int city = parse_cities_json(response.body, &city_s);
-  if (city < 0) {
+  memset(&city_s, 0, sizeof(city_s));
+  if (fetch_cities(NULL, &response, &city_s) < 0 || response.status != 200 || !city_s.status) {
     get_city_free(&city_s);
     http_response_free(&response);
     return -1;
@@ -103,16 +224,265 @@ int get_city(struct cities_s *dest) {
   return 0;
 }
 
+/**
+ * @brief Map the cached cities snapshot.
+ *
+ * The returned city strings point into the read-only mapping; only the
+ * data array itself is allocated.
+ */
+static int city_cache_load(const char *path, struct cities_s *dest, struct city_cache_meta *meta) {
+  struct snapshot snap;
+  if (snapshot_open(path, SNAPSHOT_CITIES, 2, &snap) < 0)
+    return -1;
+
+  size_t count = snap.header->record_count;
+  if (count == 0) {
+    snapshot_close(&snap);
+    return -1;
+  }
+
+  struct cities_data_s *data = calloc(count, sizeof(struct cities_data_s));
+  if (data == NULL) {
+    fprintf(stderr, "city_cache_load cannot allocate memory\n");
+    snapshot_close(&snap);
+    return -1;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    data[i].id = (char *)snapshot_field(&snap, i, 0);
+    data[i].lokasi = (char *)snapshot_field(&snap, i, 1);
+  }
+
+  memset(meta, 0, sizeof(*meta));
+  meta->fetched = snap.header->fetched;
+
+  const char *etag = snapshot_string(&snap, snap.header->meta[0]);
+  if (etag)
+    snprintf(meta->etag, sizeof(meta->etag), "%s", etag);
+
+  const char *last_modified = snapshot_string(&snap, snap.header->meta[1]);
+  if (last_modified)
+    snprintf(meta->last_modified, sizeof(meta->last_modified), "%s", last_modified);
+
+  memset(dest, 0, sizeof(*dest));
+  dest->status = true;
+  dest->data = data;
+  dest->size = count;
+  dest->map = snap.map;
+  dest->map_size = snap.map_size;
+  return 0;
+}
+
+static int city_cache_store(const char *path, const struct cities_s *cities,
+                            const struct city_cache_meta *meta) {
+  if (cities->size == 0 || cities->size > UINT32_MAX / 2)
+    return -1;
+
+  const char **values = malloc(cities->size * 2 * sizeof(char *));
+  if (values == NULL) {
+    fprintf(stderr, "city_cache_store cannot allocate memory\n");
+    return -1;
+  }
+
+  for (size_t i = 0; i < cities->size; i++) {
+    values[i * 2] = cities->data[i].id;
+    values[i * 2 + 1] = cities->data[i].lokasi;
+  }
+
+  struct snapshot_desc desc;
+  memset(&desc, 0, sizeof(desc));
+  desc.kind = SNAPSHOT_CITIES;
+  desc.record_count = (uint32_t)cities->size;
+  desc.record_fields = 2;
+  desc.values = values;
+  desc.meta[0] = meta->etag[0] ? meta->etag : NULL;
+  desc.meta[1] = meta->last_modified[0] ? meta->last_modified : NULL;
+  desc.fetched = meta->fetched;
+
+  int written = snapshot_write(path, &desc);
+  free(values);
+  return written;
+}
+
+/**
+ * @brief Whether the cache described by meta is younger than CITY_CACHE_TTL.
+ */
+static bool city_cache_fresh(const struct city_cache_meta *meta, long long now) {
+  return now >= meta->fetched && now - meta->fetched < CITY_CACHE_TTL;
+}
+
+int get_city_cached(struct cities_s *dest, bool refresh) {
+  if (dest == NULL) {
+    fprintf(stderr, "get_city_cached destination NULL\n");
+    return -1;
+  }
+
+  char path[4096];
+  bool has_path = cache_path(CITY_CACHE_FILE, path, sizeof(path)) == 0;
+
+  struct cities_s cached;
+  memset(&cached, 0, sizeof(cached));
+  struct city_cache_meta meta;
+  memset(&meta, 0, sizeof(meta));
+
+  bool has_cache = false;
+  if (has_path && !refresh) {
+    has_cache = city_cache_load(path, &cached, &meta) == 0;
+  }
+
+  long long now = (long long)time(NULL);
+  if (has_cache && city_cache_fresh(&meta, now)) {
+    *dest = cached;
+    return 0;
+  }
+
+  /* Expired cache: ask the server whether our copy is still current */
+  char headers[256] = "";
+  if (has_cache) {
+    int len = 0;
+    if (meta.etag[0] != '\0')
+      len += snprintf(headers + len, sizeof(headers) - len, "If-None-Match: %s\r\n", meta.etag);
+    if (meta.last_modified[0] != '\0')
+      snprintf(headers + len, sizeof(headers) - len, "If-Modified-Since: %s\r\n",
+               meta.last_modified);
+  }
+
+  struct http_response response;
+  memset(&response, 0, sizeof(response));
+  struct cities_s fresh;
+  memset(&fresh, 0, sizeof(fresh));
+  if (fetch_cities(headers, &response, &fresh) < 0) {
+    http_response_free(&response);
+    if (has_cache) {
+      fprintf(stderr, "Cannot reach API, using stale city cache\n");
+      *dest = cached;
+      return 0;
+    }
+    return -1;
+  }
+
+  if (has_cache && response.status == 304) {
+    meta.fetched = now;
+    if (city_cache_store(path, &cached, &meta) < 0)
+      fprintf(stderr, "Cannot update city cache\n");
+
+    get_city_free(&fresh);
+    http_response_free(&response);
+    *dest = cached;
+    return 0;
+  }
+
+  if (response.status != 200 || !fresh.status) {
+    get_city_free(&fresh);
+    http_response_free(&response);
+    if (has_cache) {
+      fprintf(stderr, "Invalid API response, using stale city cache\n");
+      *dest = cached;
+      return 0;
+    }
+    return -1;
+  }
+
+  struct city_cache_meta fresh_meta;
+  memset(&fresh_meta, 0, sizeof(fresh_meta));
+  fresh_meta.fetched = now;
+  http_response_header_copy(response.header, "ETag", fresh_meta.etag, sizeof(fresh_meta.etag));
+  http_response_header_copy(response.header, "Last-Modified", fresh_meta.last_modified,
+                            sizeof(fresh_meta.last_modified));
+  http_response_free(&response);
+
+  if (has_path && city_cache_store(path, &fresh, &fresh_meta) < 0)
+    fprintf(stderr, "Cannot write city cache\n");
+
+  get_city_free(&cached);
+  *dest = fresh;
+  return 0;
+}
+
+int get_city_cache_peek(struct cities_s *dest, bool *expired) {
+  if (dest == NULL) {
+    fprintf(stderr, "get_city_cache_peek destination NULL\n");
+    return -1;
+  }
+
+  char path[4096];
+  struct city_cache_meta meta;
+  if (cache_path(CITY_CACHE_FILE, path, sizeof(path)) < 0 ||
+      city_cache_load(path, dest, &meta) < 0)
+    return -1;
+
+  if (expired != NULL)
+    *expired = !city_cache_fresh(&meta, (long long)time(NULL));
+  return 0;
+}
+
+static void *city_fetch_thread(void *arg) {
+  struct city_fetch *fetch = arg;
+  fetch->status = get_city_cached(&fetch->result, fetch->refresh);
+
+  // Only the wakeup matters, a full pipe is readable already
+  char done = 1;
+  while (write(fetch->notify, &done, 1) < 0 && errno == EINTR)
+    ;
+  return NULL;
+}
+
+int get_city_fetch_start(struct city_fetch *fetch, bool refresh) {
+  if (fetch == NULL) {
+    fprintf(stderr, "get_city_fetch_start fetch NULL\n");
+    return -1;
+  }
+
+  memset(fetch, 0, sizeof(*fetch));
+  fetch->refresh = refresh;
+  fetch->status = -1;
+
+  int fds[2];
+  if (pipe(fds) < 0) {
+    perror("get_city_fetch_start pipe");
+    return -1;
+  }
+  fetch->fd = fds[0];
+  fetch->notify = fds[1];
+
+  if (pthread_create(&fetch->thread, NULL, city_fetch_thread, fetch) != 0) {
+    fprintf(stderr, "get_city_fetch_start cannot start thread\n");
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  return 0;
+}
+
+int get_city_fetch_finish(struct city_fetch *fetch, struct cities_s *dest) {
+  if (fetch == NULL || dest == NULL) {
+    fprintf(stderr, "get_city_fetch_finish argument NULL\n");
+    return -1;
+  }
+
+  pthread_join(fetch->thread, NULL);
+  close(fetch->fd);
+  close(fetch->notify);
+  fetch->fd = -1;
+  fetch->notify = -1;
+
+  if (fetch->status < 0)
+    return -1;
+  *dest = fetch->result;
+  memset(&fetch->result, 0, sizeof(fetch->result));
+  return 0;
+}
+
 void get_city_free(struct cities_s *cities) {
   if (cities == NULL) {
     printf("cities NULL\n");
     return;
   }
 
-  for (size_t i = 0; i < cities->size; i++) {
-    free(cities->data[i].id);
-    free(cities->data[i].lokasi);
-  }
+  /* Strings live either in the snapshot mapping or in the arena */
+  if (cities->map != NULL)
+    snapshot_unmap(cities->map, cities->map_size);
+  arena_free(&cities->arena);
 
   free(cities->data);
 }
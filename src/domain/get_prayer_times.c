@@ -1,171 +1,379 @@
 #include "domain/get_prayer_times.h"
+#include "domain/prayer_calc.h"
+#include "domain/snapshot.h"
 #include "lib/json.h"
 #include "network/connection.h"
+#include "utils/fsutils.h"
+#include "utils/stats.h"
 #include "utils/tmutils.h"
+#include <ctype.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Cached days are stored as is, in 32-bit words of the snapshot record table */
+#define SCHEDULE_WORDS (sizeof(struct prayer_times_data_schedule) / sizeof(uint32_t))
+
+#define SCHEDULE_DAY_DATE (-2) /**< day_field value of the "date" member */
+
+_Static_assert(sizeof(struct prayer_times_data_schedule) == 16, "schedule day is 16 bytes");
+
+/**
+ * @brief Member whose value the schedule parser expects next.
+ */
+enum schedule_key {
+  SCHEDULE_KEY_NONE,
+  SCHEDULE_KEY_STATUS,
+  SCHEDULE_KEY_REQUEST,
+  SCHEDULE_KEY_DATA,
+  SCHEDULE_KEY_PATH,
+  SCHEDULE_KEY_ID,
+  SCHEDULE_KEY_LOCATION,
+  SCHEDULE_KEY_PROVINCE,
+  SCHEDULE_KEY_JADWAL,
+  SCHEDULE_KEY_COORDINATES, /**< data.koordinat */
+  SCHEDULE_KEY_LATITUDE,
+  SCHEDULE_KEY_LONGITUDE,
+  SCHEDULE_KEY_DAY_FIELD, /**< A member of a schedule day, see day_field */
+};
+
+/**
+ * @brief State of a streaming parse of a monthly schedule response.
+ *
+ * The response looks like
+ * `{"status": true, "request": {"path": ...},
+ *   "data": {"id": 1301, "lokasi": ..., "daerah": ...,
+ *            "koordinat": {"lat": ..., "lon": ...}, "jadwal": [{...}]}}`;
+ * fields are filled in as their tokens arrive. Strings are copied once,
+ * straight from the received bytes, into dest->arena; the date and times
+ * of each day are parsed into the typed record instead.
+ */
+struct schedule_parser {
+  JsonSax sax;
+  struct prayer_times *dest;
+  int capacity;                 /**< Allocated entries of dest->data.schedule */
+  enum schedule_key root;       /**< Top-level member being parsed */
+  enum schedule_key key;        /**< Key of the nested member being parsed */
+  enum schedule_key coordinate; /**< Member of data.koordinat being parsed */
+  int day_field;                /**< enum schedule_time or SCHEDULE_DAY_DATE of the value */
+  int coordinates;              /**< Bit 0: latitude seen, bit 1: longitude seen */
+  bool in_jadwal;               /**< Inside data.jadwal */
+  bool has_data;                /**< The response has a data member */
+  bool failed;                  /**< Invalid JSON, the rest of the body is ignored */
+};
+
+static bool schedule_store_string(struct schedule_parser *parser, char **field,
+                                  const JsonEvent *event) {
+  *field = arena_strndup(&parser->dest->arena, event->string, event->length);
+  if (*field == NULL) {
+    fprintf(stderr, "Cannot allocate memory for prayer times\n");
+    return false;
+  }
+  return true;
+}
 
-static int parse_json(char *json_str, struct prayer_times *dest) {
-  if (json_str == NULL || dest == NULL) {
-    fprintf(stderr, "Cannot parse json response from prayer times\n");
-    return -1;
+static bool schedule_append(struct schedule_parser *parser) {
+  struct prayer_times_data *data = &parser->dest->data;
+
+  if (data->schedule_size == parser->capacity) {
+    int capacity = parser->capacity ? parser->capacity * 2 : 32;
+    struct prayer_times_data_schedule *schedule =
+        realloc(data->schedule, capacity * sizeof(struct prayer_times_data_schedule));
+    if (schedule == NULL) {
+      fprintf(stderr, "Cannot allocate memory for prayer times\n");
+      return false;
+    }
+    data->schedule = schedule;
+    parser->capacity = capacity;
   }
 
-  JsonNode *root = json_decode(json_str);
-  if (root == NULL) {
-    fprintf(stderr, "Cannot proceed prayer times json\n");
+  struct prayer_times_data_schedule *day = &data->schedule[data->schedule_size++];
+  memset(day, 0, sizeof(*day));
+  for (int i = 0; i < SCHEDULE_TIME_COUNT; i++)
+    day->times[i] = SCHEDULE_TIME_NONE;
+  return true;
+}
+
+/* Member of a schedule day, -1 for one that is not kept */
+static int schedule_day_field(const JsonEvent *key) {
+  if (json_event_is(key, "date"))
+    return SCHEDULE_DAY_DATE;
+  if (json_event_is(key, "subuh"))
+    return SCHEDULE_FAJR;
+  if (json_event_is(key, "dhuha"))
+    return SCHEDULE_DHUHA;
+  if (json_event_is(key, "dzuhur"))
+    return SCHEDULE_DZUHR;
+  if (json_event_is(key, "ashar"))
+    return SCHEDULE_ASHR;
+  if (json_event_is(key, "maghrib"))
+    return SCHEDULE_MAGHRIB;
+  if (json_event_is(key, "isya"))
+    return SCHEDULE_ISYA;
+  return -1;
+}
+
+/**
+ * @brief Parse the digits of a string that is not NUL-terminated.
+ *
+ * @return The number, or -1 unless [from, from + n) are all digits.
+ */
+static int parse_digits(const char *str, size_t length, size_t from, size_t n) {
+  if (from + n > length)
     return -1;
-  }
 
-  const bool status = json_get_bool(root, "status");
-  dest->status = status;
+  int value = 0;
+  for (size_t i = from; i < from + n; i++) {
+    if (str[i] < '0' || str[i] > '9')
+      return -1;
+    value = value * 10 + (str[i] - '0');
+  }
+  return value;
+}
 
-  JsonNode *request_json = json_find_member(root, "request");
-  if (request_json && request_json->tag == JSON_OBJECT) {
-    JsonNode *path = json_find_member(request_json, "path");
-    if (path && path->tag == JSON_STRING) {
+/* "YYYY-MM-DD" into the day, false when it is not a date */
+static bool schedule_parse_date(struct prayer_times_data_schedule *day, const char *str,
+                                size_t length) {
+  int year = parse_digits(str, length, 0, 4);
+  int month = parse_digits(str, length, 5, 2);
+  int mday = parse_digits(str, length, 8, 2);
+  if (length != 10 || str[4] != '-' || str[7] != '-' || year < 1 || month < 1 || month > 12 ||
+      mday < 1 || mday > 31)
+    return false;
+
+  day->year = (uint16_t)year;
+  day->month = (uint8_t)month;
+  day->day = (uint8_t)mday;
+  return true;
+}
 
-      struct prayer_times_req *request = calloc(1, sizeof(struct prayer_times_req));
-      if (request == NULL) {
-        fprintf(stderr, "Cannot allocate memory for prayer_tiems_req\n");
-        json_delete(root);
-        return -1;
-      }
+/* "HH:MM" into minutes after midnight, SCHEDULE_TIME_NONE for anything else */
+static uint16_t schedule_parse_time(const char *str, size_t length) {
+  int hours = parse_digits(str, length, 0, 2);
+  int minutes = parse_digits(str, length, 3, 2);
+  if (length != 5 || str[2] != ':' || hours < 0 || hours > 23 || minutes < 0 || minutes > 59)
+    return SCHEDULE_TIME_NONE;
+  return (uint16_t)(hours * 60 + minutes);
+}
 
-      char *tmp = path->string_;
-      request->path = strndup(tmp, strlen(tmp));
-      dest->req = *request;
-      free(request);
-    }
+static bool schedule_key_event(struct schedule_parser *parser, const JsonEvent *event) {
+  if (event->depth == 1) {
+    parser->root = json_event_is(event, "status")    ? SCHEDULE_KEY_STATUS
+                   : json_event_is(event, "request") ? SCHEDULE_KEY_REQUEST
+                   : json_event_is(event, "data")    ? SCHEDULE_KEY_DATA
+                                                     : SCHEDULE_KEY_NONE;
+    if (parser->root == SCHEDULE_KEY_DATA)
+      parser->has_data = true;
+  } else if (event->depth == 2 && parser->root == SCHEDULE_KEY_REQUEST) {
+    parser->key = json_event_is(event, "path") ? SCHEDULE_KEY_PATH : SCHEDULE_KEY_NONE;
+  } else if (event->depth == 2 && parser->root == SCHEDULE_KEY_DATA) {
+    parser->key = json_event_is(event, "id")          ? SCHEDULE_KEY_ID
+                  : json_event_is(event, "lokasi")    ? SCHEDULE_KEY_LOCATION
+                  : json_event_is(event, "daerah")    ? SCHEDULE_KEY_PROVINCE
+                  : json_event_is(event, "jadwal")    ? SCHEDULE_KEY_JADWAL
+                  : json_event_is(event, "koordinat") ? SCHEDULE_KEY_COORDINATES
+                                                      : SCHEDULE_KEY_NONE;
+  } else if (event->depth == 3 && parser->key == SCHEDULE_KEY_COORDINATES) {
+    parser->coordinate = json_event_is(event, "lat")   ? SCHEDULE_KEY_LATITUDE
+                         : json_event_is(event, "lon") ? SCHEDULE_KEY_LONGITUDE
+                                                       : SCHEDULE_KEY_NONE;
+  } else if (event->depth == 4 && parser->in_jadwal) {
+    parser->day_field = schedule_day_field(event);
+    parser->key = parser->day_field != -1 ? SCHEDULE_KEY_DAY_FIELD : SCHEDULE_KEY_NONE;
   }
 
-  struct prayer_times_data *data = calloc(1, sizeof(struct prayer_times_data));
-  if (data == NULL) {
-    fprintf(stderr, "Cannot allocate memory for prayer_times_data\n");
-    json_delete(root);
-    return -1;
+  return true;
+}
+
+static bool schedule_string_event(struct schedule_parser *parser, const JsonEvent *event) {
+  struct prayer_times *dest = parser->dest;
+
+  if (event->depth == 2 && parser->root == SCHEDULE_KEY_REQUEST &&
+      parser->key == SCHEDULE_KEY_PATH)
+    return schedule_store_string(parser, &dest->req.path, event);
+
+  if (event->depth == 2 && parser->root == SCHEDULE_KEY_DATA) {
+    if (parser->key == SCHEDULE_KEY_LOCATION)
+      return schedule_store_string(parser, &dest->data.location, event);
+    if (parser->key == SCHEDULE_KEY_PROVINCE)
+      return schedule_store_string(parser, &dest->data.province, event);
   }
 
-  JsonNode *data_json = json_find_member(root, "data");
-  if (data_json == NULL) {
-    fprintf(stderr, "Cannot find member of 'data'\n");
-    free(dest->req.path);
-    free(data);
-    json_delete(root);
-    return -1;
+  if (event->depth == 4 && parser->in_jadwal && parser->key == SCHEDULE_KEY_DAY_FIELD) {
+    struct prayer_times_data *data = &dest->data;
+    struct prayer_times_data_schedule *day = &data->schedule[data->schedule_size - 1];
+    if (parser->day_field == SCHEDULE_DAY_DATE)
+      schedule_parse_date(day, event->string, event->length);
+    else
+      day->times[parser->day_field] = schedule_parse_time(event->string, event->length);
   }
 
-  if (data_json->tag == JSON_OBJECT) {
-    JsonNode *id = json_find_member(data_json, "id");
-    if (id && id->tag == JSON_NUMBER) {
-      data->id = id->number_;
-    }
+  return true;
+}
 
-    JsonNode *location = json_find_member(data_json, "lokasi");
-    if (location && location->tag == JSON_STRING) {
-      char *tmp = location->string_;
-      data->location = strndup(tmp, strlen(tmp));
-    }
+static void schedule_coordinate(struct schedule_parser *parser, double value) {
+  struct prayer_times_data *data = &parser->dest->data;
 
-    JsonNode *province = json_find_member(data_json, "daerah");
-    if (province && province->tag == JSON_STRING) {
-      char *tmp = province->string_;
-      data->province = strndup(tmp, strlen(tmp));
-    }
+  if (parser->coordinate == SCHEDULE_KEY_LATITUDE)
+    data->latitude = value;
+  else if (parser->coordinate == SCHEDULE_KEY_LONGITUDE)
+    data->longitude = value;
+  else
+    return;
 
-    JsonNode *schedules = json_find_member(data_json, "jadwal");
-    if (schedules && schedules->tag == JSON_ARRAY) {
-      size_t count = 0;
-      JsonNode *child;
-
-      json_foreach(child, schedules) { count++; };
-      data->schedule_size = (int)count;
-
-      data->schedule = calloc(count, sizeof(struct prayer_times_data_schedule));
-      if (data->schedule == NULL) {
-        fprintf(stderr, "Cannot allocate memory for prayer times\n");
-        free(dest->req.path);
-        free(data->location);
-        free(data->province);
-        free(data);
-        json_delete(root);
-        return -1;
-      }
+  /* Both members are needed; the flag is confirmed when the second one arrives */
+  parser->coordinates |= parser->coordinate == SCHEDULE_KEY_LATITUDE ? 1 : 2;
+  data->has_coordinates = parser->coordinates == 3;
+}
 
-      size_t index = 0;
-      json_foreach(child, schedules) {
-        if (child && child->tag == JSON_OBJECT) {
-
-          JsonNode *date = json_find_member(child, "date");
-          if (date && date->tag == JSON_STRING) {
-            char *tmp = date->string_;
-            data->schedule[index].date = strndup(tmp, strlen(tmp));
-          }
-
-          JsonNode *fajr = json_find_member(child, "subuh");
-          if (fajr && fajr->tag == JSON_STRING) {
-            char *tmp = fajr->string_;
-            data->schedule[index].fajr = strndup(tmp, strlen(tmp));
-          }
-
-          JsonNode *dhuha = json_find_member(child, "dhuha");
-          if (dhuha && dhuha->tag == JSON_STRING) {
-            char *tmp = dhuha->string_;
-            data->schedule[index].dhuha = strndup(tmp, strlen(tmp));
-          }
-
-          JsonNode *dzuhr = json_find_member(child, "dzuhur");
-          if (dzuhr && dzuhr->tag == JSON_STRING) {
-            char *tmp = dzuhr->string_;
-            data->schedule[index].dzuhr = strndup(tmp, strlen(tmp));
-          }
-
-          JsonNode *ashr = json_find_member(child, "ashar");
-          if (ashr && ashr->tag == JSON_STRING) {
-            char *tmp = ashr->string_;
-            data->schedule[index].ashr = strndup(tmp, strlen(tmp));
-          }
-
-          JsonNode *maghrib = json_find_member(child, "maghrib");
-          if (maghrib && maghrib->tag == JSON_STRING) {
-            char *tmp = maghrib->string_;
-            data->schedule[index].maghrib = strndup(tmp, strlen(tmp));
-          }
-
-          JsonNode *isya = json_find_member(child, "isya");
-          if (isya && isya->tag == JSON_STRING) {
-            char *tmp = isya->string_;
-            data->schedule[index].isya = strndup(tmp, strlen(tmp));
-          }
-        }
-        index++;
-      }
-    }
+static bool schedule_event(void *user, const JsonEvent *event) {
+  struct schedule_parser *parser = user;
+  struct prayer_times *dest = parser->dest;
+
+  switch (event->type) {
+  case JSON_EVENT_KEY:
+    return schedule_key_event(parser, event);
+
+  case JSON_EVENT_STRING:
+    return schedule_string_event(parser, event);
+
+  case JSON_EVENT_BOOL:
+    if (event->depth == 1 && parser->root == SCHEDULE_KEY_STATUS)
+      dest->status = event->bool_;
+    break;
+
+  case JSON_EVENT_NUMBER:
+    if (event->depth == 2 && parser->root == SCHEDULE_KEY_DATA && parser->key == SCHEDULE_KEY_ID)
+      dest->data.id = (int)event->number_;
+    else if (event->depth == 3 && parser->key == SCHEDULE_KEY_COORDINATES)
+      schedule_coordinate(parser, event->number_);
+    break;
+
+  case JSON_EVENT_OBJECT_START:
+    if (event->depth == 3 && parser->in_jadwal)
+      return schedule_append(parser);
+    break;
+
+  case JSON_EVENT_ARRAY_START:
+    if (event->depth == 2 && parser->root == SCHEDULE_KEY_DATA &&
+        parser->key == SCHEDULE_KEY_JADWAL)
+      parser->in_jadwal = true;
+    break;
+
+  case JSON_EVENT_ARRAY_END:
+    if (event->depth == 2)
+      parser->in_jadwal = false;
+    break;
+
+  default:
+    break;
   }
 
-  dest->data = *data;
-  free(data);
-  json_delete(root);
+  return true;
+}
+
+/* Days ordered by date */
+static uint32_t schedule_date_key(int year, int month, int day) {
+  return (uint32_t)year << 9 | (uint32_t)month << 5 | (uint32_t)day;
+}
+
+static int schedule_compare(const void *a, const void *b) {
+  const struct prayer_times_data_schedule *x = a, *y = b;
+  uint32_t kx = schedule_date_key(x->year, x->month, x->day);
+  uint32_t ky = schedule_date_key(y->year, y->month, y->day);
+  return (kx > ky) - (kx < ky);
+}
+
+static void schedule_parser_init(struct schedule_parser *parser, struct prayer_times *dest) {
+  memset(parser, 0, sizeof(*parser));
+  memset(dest, 0, sizeof(*dest));
+  arena_init(&dest->arena, SCHEDULE_ARENA_BLOCK);
+  parser->dest = dest;
+  json_sax_init(&parser->sax, schedule_event, parser);
+}
+
+/* http_body_cb feeding received body bytes to the parser */
+static int schedule_parser_body(void *user, const char *data, size_t len) {
+  struct schedule_parser *parser = user;
+  struct stats_span span;
+  stats_begin(&span);
+  if (!parser->failed && !json_sax_feed(&parser->sax, data, len))
+    parser->failed = true;
+  stats_end(&span, STATS_PARSE, len);
   return 0;
 }
 
-int get_prayer_times(const char *city_id, struct prayer_times *dest) {
-  if (city_id == NULL || dest == NULL) {
-    fprintf(stderr, "City id or destination must be not NULL\n");
+static int schedule_parser_finish(struct schedule_parser *parser) {
+  bool complete = !parser->failed && json_sax_finish(&parser->sax);
+  json_sax_free(&parser->sax);
+
+  if (!complete) {
+    fprintf(stderr, "Cannot proceed prayer times json\n");
     return -1;
   }
 
+  if (!parser->has_data) {
+    fprintf(stderr, "Cannot find member of 'data'\n");
+    return -1;
+  }
+
+  /* Lookups search by date; the API already sends the days in order */
+  struct prayer_times_data *data = &parser->dest->data;
+  if (data->schedule_size > 1)
+    qsort(data->schedule, data->schedule_size, sizeof(*data->schedule), schedule_compare);
+
+  return 0;
+}
+
+int get_prayer_times(const char *city_id, struct prayer_times *dest) {
   struct tmutils tm;
   memset(&tm, 0, sizeof(tm));
   get_current_time(&tm);
 
-  int year = tm.year;
-  int month = tm.month;
-  // /idid/yyyy/mm + null terminator
-  char path[14];
-  snprintf(path, 14, "/%s/%d/%d", city_id, year, month);
+  return get_prayer_times_month(city_id, tm.year, tm.month, dest);
+}
+
+int parse_prayer_times_json(const char *json_str, struct prayer_times *dest) {
+  if (json_str == NULL || dest == NULL) {
+    fprintf(stderr, "parse_prayer_times_json invalid argument\n");
+    return -1;
+  }
+
+  struct schedule_parser parser;
+  schedule_parser_init(&parser, dest);
+  schedule_parser_body(&parser, json_str, strlen(json_str));
 
-  int endpoint_len = strlen(API_VERSION) + strlen(PRAYER_TIME_ENDPOINT) + strlen(path) + 1;
+  if (schedule_parser_finish(&parser) < 0) {
+    get_prayer_times_free(dest);
+    memset(dest, 0, sizeof(*dest));
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Validators of a fetched month, stored with it for revalidation.
+ */
+struct schedule_validators {
+  char etag[128];         /**< ETag of the response, empty if none */
+  char last_modified[64]; /**< Last-Modified of the response, empty if none */
+};
+
+/**
+ * @brief Fetch and parse a month, over @p conn or the shared connection when NULL.
+ *
+ * @param validators  Receives the response's validators, may be NULL.
+ */
+static int schedule_fetch(struct http_conn *conn, const char *city_id, int year, int month,
+                          struct prayer_times *dest, struct schedule_validators *validators) {
+  // /<id>/yyyy/mm + null terminator
+  int endpoint_len = snprintf(NULL, 0, "%s%s/%s/%d/%d", API_VERSION, PRAYER_TIME_ENDPOINT,
+                              city_id, year, month) +
+                     1;
 
   char *endpoint = malloc(endpoint_len);
   if (endpoint == NULL) {
@@ -173,53 +381,542 @@ int get_prayer_times(const char *city_id, struct prayer_times *dest) {
     return -1;
   }
 
-  snprintf(endpoint, endpoint_len, "%s%s%s", API_VERSION, PRAYER_TIME_ENDPOINT, path);
+  snprintf(endpoint, endpoint_len, "%s%s/%s/%d/%d", API_VERSION, PRAYER_TIME_ENDPOINT, city_id,
+           year, month);
+
+  struct prayer_times prayer_t;
+  struct schedule_parser parser;
+  schedule_parser_init(&parser, &prayer_t);
 
   struct http_response response;
   memset(&response, 0, sizeof(response));
-  int get_request = get(HOST, endpoint, &response);
-  if (get_request < 0) {
-    fprintf(stderr, "GET prayer times faile\n");
-    free(endpoint);
+  int get_request =
+      conn ? http_conn_request_stream(conn, HOST, endpoint, NULL, schedule_parser_body, &parser,
+                                      &response)
+           : get_stream(HOST, endpoint, NULL, schedule_parser_body, &parser, &response);
+  free(endpoint);
+  if (validators) {
+    http_response_header_copy(response.header, "ETag", validators->etag,
+                              sizeof(validators->etag));
+    http_response_header_copy(response.header, "Last-Modified", validators->last_modified,
+                              sizeof(validators->last_modified));
+  }
+  http_response_free(&response);
+
+  int parse = schedule_parser_finish(&parser);
+  if (get_request < 0 || parse < 0) {
+    fprintf(stderr, get_request < 0 ? "GET prayer times faile\n" : "Parse json fail\n");
+    get_prayer_times_free(&prayer_t);
     return -1;
   }
-  free(endpoint);
 
-  struct prayer_times prayer_t;
-  memset(&prayer_t, 0, sizeof(prayer_t));
+  *dest = prayer_t;
+  return 0;
+}
 
-  int parse = parse_json(response.body, &prayer_t);
-  if (parse < 0) {
-    fprintf(stderr, "Parse json fail\n");
-    get_prayer_times_free(&prayer_t);
-    http_response_free(&response);
+int get_prayer_times_month(const char *city_id, int year, int month, struct prayer_times *dest) {
+  if (city_id == NULL || dest == NULL) {
+    fprintf(stderr, "City id or destination must be not NULL\n");
+    return -1;
+  }
+
+  return schedule_fetch(NULL, city_id, year, month, dest, NULL);
+}
+
+/**
+ * @brief Build the cache file path of a (city, year, month) schedule.
+ *
+ * The city ID ends up in a file name, so only alphanumeric IDs are accepted.
+ */
+static int schedule_cache_path(const char *city_id, int year, int month, char *dest,
+                               size_t dest_len) {
+  if (city_id[0] == '\0' || month < 1 || month > 12 || year < 1 || year > 9999)
     return -1;
+
+  for (const char *p = city_id; *p; p++) {
+    if (!isalnum((unsigned char)*p))
+      return -1;
   }
 
+  char name[128];
+  int len = snprintf(name, sizeof(name), "schedule-%s-%04d-%02d.snap", city_id, year, month);
+  if (len < 0 || (size_t)len >= sizeof(name))
+    return -1;
+
+  return cache_path(name, dest, dest_len);
+}
+
+/**
+ * @brief A cached day is usable: a real date after the previous day's, and
+ *        times within a day.
+ */
+static bool schedule_day_valid(const struct prayer_times_data_schedule *day,
+                               const struct prayer_times_data_schedule *previous) {
+  if (day->month < 1 || day->month > 12 || day->day < 1 ||
+      day->day > days_in_month(day->year, day->month))
+    return false;
+  if (previous && schedule_compare(previous, day) >= 0)
+    return false;
+
+  for (int i = 0; i < SCHEDULE_TIME_COUNT; i++) {
+    if (day->times[i] >= 24 * 60 && day->times[i] != SCHEDULE_TIME_NONE)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Map a cached monthly schedule snapshot.
+ *
+ * Location, province and request path point into the read-only mapping,
+ * and so does the schedule: its days are the snapshot's record table.
+ * Nothing is allocated.
+ */
+static int schedule_cache_load(const char *path, struct prayer_times *dest) {
+  struct snapshot snap;
+  if (snapshot_open(path, SNAPSHOT_SCHEDULE, SCHEDULE_WORDS, &snap) < 0)
+    return -1;
+
+  uint32_t count = snap.header->record_count;
+  struct prayer_times_data_schedule *schedule =
+      (struct prayer_times_data_schedule *)snap.records;
+  bool valid = count > 0 && count <= 31;
+  for (uint32_t i = 0; valid && i < count; i++)
+    valid = schedule_day_valid(&schedule[i], i > 0 ? &schedule[i - 1] : NULL);
+
+  if (!valid) {
+    snapshot_close(&snap);
+    return -1;
+  }
+
+  memset(dest, 0, sizeof(*dest));
+  dest->status = true;
+  dest->req.path = (char *)snapshot_string(&snap, snap.header->meta[2]);
+  dest->data.id = (int)snap.header->number;
+  dest->data.location = (char *)snapshot_string(&snap, snap.header->meta[0]);
+  dest->data.province = (char *)snapshot_string(&snap, snap.header->meta[1]);
+  const char *coordinates = snapshot_string(&snap, snap.header->meta[3]);
+  dest->data.has_coordinates =
+      coordinates && sscanf(coordinates, "%lf,%lf", &dest->data.latitude,
+                            &dest->data.longitude) == 2;
+  dest->data.schedule_size = (int)count;
+  dest->data.schedule = schedule;
+  dest->map = snap.map;
+  dest->map_size = snap.map_size;
+  return 0;
+}
+
+static int schedule_cache_store(const char *path, const struct prayer_times *prayer_t,
+                                const struct schedule_validators *validators) {
+  const struct prayer_times_data *data = &prayer_t->data;
+  if (data->schedule_size <= 0)
+    return -1;
+
+  struct snapshot_desc desc;
+  memset(&desc, 0, sizeof(desc));
+  desc.kind = SNAPSHOT_SCHEDULE;
+  desc.record_count = (uint32_t)data->schedule_size;
+  desc.record_fields = SCHEDULE_WORDS;
+  desc.words = data->schedule;
+  desc.meta[0] = data->location;
+  desc.meta[1] = data->province;
+  desc.meta[2] = prayer_t->req.path;
+
+  char coordinates[64];
+  if (data->has_coordinates) {
+    snprintf(coordinates, sizeof(coordinates), "%.7f,%.7f", data->latitude, data->longitude);
+    desc.meta[3] = coordinates;
+  }
+  if (validators) {
+    desc.meta[4] = validators->etag[0] ? validators->etag : NULL;
+    desc.meta[5] = validators->last_modified[0] ? validators->last_modified : NULL;
+  }
+  desc.fetched = (int64_t)time(NULL);
+  desc.number = data->id;
+
+  return snapshot_write(path, &desc);
+}
+
+/**
+ * @brief Conditional request headers for the cached copy of a month.
+ *
+ * @return 0 when dest holds If-None-Match and/or If-Modified-Since lines, -1
+ *         when there is no cached copy or it has no validators.
+ */
+static int schedule_cache_conditions(const char *path, char *dest, size_t len) {
+  struct snapshot snap;
+  if (snapshot_open(path, SNAPSHOT_SCHEDULE, SCHEDULE_WORDS, &snap) < 0)
+    return -1;
+
+  const char *etag = snapshot_string(&snap, snap.header->meta[4]);
+  const char *last_modified = snapshot_string(&snap, snap.header->meta[5]);
+  int written = 0;
+  dest[0] = '\0';
+  if (etag)
+    written += snprintf(dest + written, len - written, "If-None-Match: %s\r\n", etag);
+  if (last_modified && (size_t)written < len)
+    written += snprintf(dest + written, len - written, "If-Modified-Since: %s\r\n", last_modified);
+  snapshot_close(&snap);
+
+  /* Headers cut short would make the request malformed, send none then */
+  if (written == 0 || (size_t)written >= len) {
+    dest[0] = '\0';
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief UTC offset of an Indonesian province, as the API spells it.
+ */
+static double indonesia_utc_offset(const char *province) {
+  static const char *const wit[] = {"PAPUA", "MALUKU"};
+  static const char *const wita[] = {"BALI",      "NUSA TENGGARA",      "SULAWESI",
+                                     "GORONTALO", "KALIMANTAN SELATAN", "KALIMANTAN TIMUR",
+                                     "KALIMANTAN UTARA"};
+  if (province == NULL)
+    return 7.0;
+
+  for (size_t i = 0; i < sizeof(wit) / sizeof(wit[0]); i++) {
+    if (strstr(province, wit[i]))
+      return 9.0;
+  }
+  for (size_t i = 0; i < sizeof(wita) / sizeof(wita[0]); i++) {
+    if (strstr(province, wita[i]))
+      return 8.0;
+  }
+  return 7.0;
+}
+
+static char *schedule_copy_string(struct arena *arena, const char *str) {
+  return str ? arena_strndup(arena, str, strlen(str)) : NULL;
+}
+
+/**
+ * @brief Calculate a month locally when the API cannot be reached.
+ *
+ * A city's coordinates only arrive with its schedules, so another month of
+ * the same city must be cached: the next one (prefetched) or one of the
+ * twelve before. The result uses the Kemenag convention, like the API, and
+ * is not written to the cache.
+ */
+static int schedule_calculate(const char *city_id, int year, int month, struct prayer_times *dest) {
+  struct prayer_times cached;
+  bool found = false;
+
+  for (int step = 1; step >= -12 && !found; step--) {
+    int months = year * 12 + (month - 1) + step;
+    char path[4096];
+    if (step == 0 ||
+        schedule_cache_path(city_id, months / 12, months % 12 + 1, path, sizeof(path)) < 0 ||
+        schedule_cache_load(path, &cached) < 0)
+      continue;
+
+    found = cached.data.has_coordinates;
+    if (!found)
+      get_prayer_times_free(&cached);
+  }
+
+  if (!found)
+    return -1;
+
+  struct prayer_params params;
+  prayer_params_init(&params, PRAYER_METHOD_KEMENAG);
+  struct prayer_location location = {cached.data.latitude, cached.data.longitude,
+                                     indonesia_utc_offset(cached.data.province)};
+
+  int calculated = prayer_calc_month(&params, &location, year, month, dest);
+  if (calculated == 0) {
+    fprintf(stderr, "Schedule calculated offline from the city's coordinates\n");
+    dest->data.id = cached.data.id;
+    dest->data.location = schedule_copy_string(&dest->arena, cached.data.location);
+    dest->data.province = schedule_copy_string(&dest->arena, cached.data.province);
+  }
+
+  get_prayer_times_free(&cached);
+  return calculated;
+}
+
+int get_prayer_times_cached(const char *city_id, int year, int month, struct prayer_times *dest) {
+  if (city_id == NULL || dest == NULL) {
+    fprintf(stderr, "City id or destination must be not NULL\n");
+    return -1;
+  }
+
+  char path[4096];
+  bool has_path = schedule_cache_path(city_id, year, month, path, sizeof(path)) == 0;
+
+  if (has_path && schedule_cache_load(path, dest) == 0)
+    return 0;
+
+  struct prayer_times prayer_t;
+  memset(&prayer_t, 0, sizeof(prayer_t));
+  struct schedule_validators validators;
+  if (schedule_fetch(NULL, city_id, year, month, &prayer_t, &validators) < 0)
+    return has_path ? schedule_calculate(city_id, year, month, dest) : -1;
+
+  /* Never persist an error response, it would be served forever */
+  if (has_path && prayer_t.status && prayer_t.data.schedule_size > 0 &&
+      schedule_cache_store(path, &prayer_t, &validators) < 0)
+    fprintf(stderr, "Cannot write schedule cache\n");
+
   *dest = prayer_t;
-  http_response_free(&response);
   return 0;
 }
 
+bool get_prayer_times_is_cached(const char *city_id, int year, int month) {
+  char path[4096];
+  return city_id != NULL && schedule_cache_path(city_id, year, month, path, sizeof(path)) == 0 &&
+         access(path, R_OK) == 0;
+}
+
+/**
+ * @brief Working state of one month of get_prayer_times_refetch().
+ */
+struct schedule_refetch {
+  char path[4096];
+  char endpoint[256];
+  char conditions[256]; /**< Conditional request headers, empty when not cached */
+  struct prayer_times prayer_t;
+  struct schedule_parser parser;
+};
+
+/* Parse and store one pipelined response */
+static enum schedule_fetch_status
+schedule_refetch_finish(const struct schedule_fetch *fetch, struct schedule_refetch *state,
+                        const struct http_pipeline_request *request) {
+  const char *header = request->response.header;
+  int status = request->response.status;
+
+  /* 304 comes without a body, the parser never saw a byte */
+  if (request->result == 0 && status == 304 && state->conditions[0] != '\0') {
+    json_sax_free(&state->parser.sax);
+    return SCHEDULE_FETCH_UNCHANGED;
+  }
+
+  int parse = schedule_parser_finish(&state->parser);
+  if (request->result < 0 || parse < 0 || status != 200) {
+    fprintf(stderr, "GET prayer times %s %04d-%02d fail\n", fetch->city_id, fetch->year,
+            fetch->month);
+    return SCHEDULE_FETCH_FAILED;
+  }
+
+  /* Never persist an error response, it would be served forever */
+  if (!state->prayer_t.status || state->prayer_t.data.schedule_size == 0) {
+    fprintf(stderr, "No schedule for city %s %04d-%02d\n", fetch->city_id, fetch->year,
+            fetch->month);
+    return SCHEDULE_FETCH_FAILED;
+  }
+
+  struct schedule_validators validators;
+  http_response_header_copy(header, "ETag", validators.etag, sizeof(validators.etag));
+  http_response_header_copy(header, "Last-Modified", validators.last_modified,
+                            sizeof(validators.last_modified));
+  if (schedule_cache_store(state->path, &state->prayer_t, &validators) < 0) {
+    fprintf(stderr, "Cannot write schedule cache\n");
+    return SCHEDULE_FETCH_FAILED;
+  }
+  return SCHEDULE_FETCH_STORED;
+}
+
+int get_prayer_times_refetch(struct http_conn *conn, struct schedule_fetch *fetches, int count) {
+  if (conn == NULL || (fetches == NULL && count > 0) || count < 0 || count > HTTP_PIPELINE_MAX) {
+    fprintf(stderr, "get_prayer_times_refetch invalid argument\n");
+    return -1;
+  }
+
+  struct schedule_refetch *states = calloc(count ? count : 1, sizeof(struct schedule_refetch));
+  if (states == NULL) {
+    fprintf(stderr, "Cannot allocate memory for get prayer times\n");
+    return -1;
+  }
+
+  /* Months whose request goes out, in the order of fetches */
+  struct http_pipeline_request requests[HTTP_PIPELINE_MAX];
+  int sent[HTTP_PIPELINE_MAX];
+  int pending = 0;
+  for (int i = 0; i < count; i++) {
+    struct schedule_fetch *fetch = &fetches[i];
+    struct schedule_refetch *state = &states[i];
+    fetch->status = SCHEDULE_FETCH_FAILED;
+    fetch->latency_ms = 0.0;
+
+    int endpoint_len = fetch->city_id ? snprintf(state->endpoint, sizeof(state->endpoint),
+                                                 "%s%s/%s/%d/%d", API_VERSION,
+                                                 PRAYER_TIME_ENDPOINT, fetch->city_id,
+                                                 fetch->year, fetch->month)
+                                      : -1;
+    if (endpoint_len < 0 || (size_t)endpoint_len >= sizeof(state->endpoint) ||
+        schedule_cache_path(fetch->city_id, fetch->year, fetch->month, state->path,
+                            sizeof(state->path)) < 0) {
+      fprintf(stderr, "Invalid city %s\n", fetch->city_id ? fetch->city_id : "(null)");
+      continue;
+    }
+
+    /* A month we have is only sent again when the server's copy changed */
+    schedule_cache_conditions(state->path, state->conditions, sizeof(state->conditions));
+    schedule_parser_init(&state->parser, &state->prayer_t);
+
+    struct http_pipeline_request *request = &requests[pending];
+    memset(request, 0, sizeof(*request));
+    request->path = state->endpoint;
+    request->headers = state->conditions;
+    request->on_body = schedule_parser_body;
+    request->user = &state->parser;
+    sent[pending++] = i;
+  }
+
+  http_conn_pipeline(conn, HOST, requests, pending);
+
+  int failed = 0;
+  for (int k = 0; k < pending; k++) {
+    struct schedule_fetch *fetch = &fetches[sent[k]];
+    struct schedule_refetch *state = &states[sent[k]];
+    fetch->status = schedule_refetch_finish(fetch, state, &requests[k]);
+    fetch->latency_ms = requests[k].latency_ms;
+
+    get_prayer_times_free(&state->prayer_t);
+    if (requests[k].result == 0)
+      http_response_free(&requests[k].response);
+  }
+  for (int i = 0; i < count; i++)
+    failed += fetches[i].status == SCHEDULE_FETCH_FAILED;
+
+  free(states);
+  return failed;
+}
+
+/* Index of the first day not before the date */
+static int schedule_lower_bound(const struct prayer_times_data *data, int year, int month,
+                                int day) {
+  uint32_t key = schedule_date_key(year, month, day);
+  int low = 0, high = data->schedule_size;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    const struct prayer_times_data_schedule *entry = &data->schedule[mid];
+    if (schedule_date_key(entry->year, entry->month, entry->day) < key)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+const struct prayer_times_data_schedule *
+get_prayer_times_day(const struct prayer_times *prayer_t, int year, int month, int day) {
+  if (prayer_t == NULL || year < 0 || month < 0 || day < 0)
+    return NULL;
+
+  const struct prayer_times_data *data = &prayer_t->data;
+  int i = schedule_lower_bound(data, year, month, day);
+  if (i == data->schedule_size)
+    return NULL;
+
+  const struct prayer_times_data_schedule *entry = &data->schedule[i];
+  return entry->year == year && entry->month == month && entry->day == day ? entry : NULL;
+}
+
+int get_prayer_times_next(const struct prayer_times *prayer_t, int year, int month, int day,
+                          int minutes, const struct prayer_times_data_schedule **entry) {
+  if (prayer_t == NULL || entry == NULL || year < 0 || month < 0 || day < 0)
+    return -1;
+
+  const struct prayer_times_data *data = &prayer_t->data;
+  for (int i = schedule_lower_bound(data, year, month, day); i < data->schedule_size; i++) {
+    const struct prayer_times_data_schedule *candidate = &data->schedule[i];
+    bool same_day = candidate->year == year && candidate->month == month && candidate->day == day;
+
+    /* Times are in order, the first later one is next */
+    for (int t = 0; t < SCHEDULE_TIME_COUNT; t++) {
+      uint16_t at = candidate->times[t];
+      if (at != SCHEDULE_TIME_NONE && (!same_day || at > minutes)) {
+        *entry = candidate;
+        return t;
+      }
+    }
+  }
+
+  return -1;
+}
+
+const char *schedule_time_name(enum schedule_time time) {
+  static const char *const names[SCHEDULE_TIME_COUNT] = {
+      [SCHEDULE_FAJR] = "Fajr", [SCHEDULE_DHUHA] = "Dhuha",     [SCHEDULE_DZUHR] = "Dzuhr",
+      [SCHEDULE_ASHR] = "Ashr", [SCHEDULE_MAGHRIB] = "Maghrib", [SCHEDULE_ISYA] = "Isya"};
+  return (int)time >= 0 && time < SCHEDULE_TIME_COUNT ? names[time] : NULL;
+}
+
+char *schedule_format_time(uint16_t minutes, char dest[SCHEDULE_TIME_LEN]) {
+  if (minutes >= 24 * 60)
+    snprintf(dest, SCHEDULE_TIME_LEN, "-");
+  else
+    snprintf(dest, SCHEDULE_TIME_LEN, "%02d:%02d", minutes / 60, minutes % 60);
+  return dest;
+}
+
+int get_prayer_times_prefetch(const char *city_id) {
+  if (city_id == NULL)
+    return -1;
+
+  struct tmutils tm;
+  memset(&tm, 0, sizeof(tm));
+  get_current_time(&tm);
+
+  if (days_in_month(tm.year, tm.month) - tm.days >= SCHEDULE_PREFETCH_DAYS)
+    return 0;
+
+  int year = tm.month == 12 ? tm.year + 1 : tm.year;
+  int month = tm.month == 12 ? 1 : tm.month + 1;
+
+  char path[4096];
+  if (schedule_cache_path(city_id, year, month, path, sizeof(path)) < 0)
+    return -1;
+  if (access(path, R_OK) == 0)
+    return 0;
+
+  /*
+   * Double fork so the fetch outlives a short-lived caller and the
+   * grandchild is reparented to init instead of becoming a zombie.
+   */
+  fflush(NULL);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("get_prayer_times_prefetch fork");
+    return -1;
+  }
+
+  if (pid == 0) {
+    if (fork() != 0)
+      _exit(0);
+
+    int devnull = open("/dev/null", O_RDWR);
+    if (devnull >= 0) {
+      dup2(devnull, STDIN_FILENO);
+      dup2(devnull, STDOUT_FILENO);
+      dup2(devnull, STDERR_FILENO);
+      close(devnull);
+    }
+
+    struct prayer_times prayer_t;
+    memset(&prayer_t, 0, sizeof(prayer_t));
+    if (get_prayer_times_cached(city_id, year, month, &prayer_t) == 0)
+      get_prayer_times_free(&prayer_t);
+    _exit(0);
+  }
+
+  waitpid(pid, NULL, 0);
+  return 1;
+}
+
 void get_prayer_times_free(struct prayer_times *prayer_t) {
   if (prayer_t == NULL) {
     return;
   }
 
-  free(prayer_t->req.path);
-  free(prayer_t->data.location);
-  free(prayer_t->data.province);
-
-  if (prayer_t->data.schedule_size > 0) {
-    for (int i = 0; i < prayer_t->data.schedule_size; i++) {
-      free(prayer_t->data.schedule[i].date);
-      free(prayer_t->data.schedule[i].fajr);
-      free(prayer_t->data.schedule[i].dhuha);
-      free(prayer_t->data.schedule[i].dzuhr);
-      free(prayer_t->data.schedule[i].ashr);
-      free(prayer_t->data.schedule[i].maghrib);
-      free(prayer_t->data.schedule[i].isya);
-    }
+  /* Strings and days live either in the snapshot mapping or in the arena and the heap */
+  if (prayer_t->map != NULL)
+    snapshot_unmap(prayer_t->map, prayer_t->map_size);
+  else
     free(prayer_t->data.schedule);
-  }
+  arena_free(&prayer_t->arena);
 }
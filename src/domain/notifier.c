@@ -0,0 +1,142 @@
+/**
+ * @file notifier.c
+ * @brief Implementation of the prayer time notification daemon.
+ */
+
+#define _GNU_SOURCE /* TFD_TIMER_CANCEL_ON_SET */
+
+#include "domain/notifier.h"
+#include "domain/schedule_shm.h"
+#include "utils/tmutils.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+/**
+ * @brief Next prayer of one month's schedule after a moment, as a timestamp.
+ *
+ * @return 0 on success, -1 when the month loads but has no later prayer, -2
+ *         when it does not load.
+ */
+static int month_next(notifier_load_fn load, void *ctx, long utc_offset, int year, int month,
+                      int day, int minutes, time_t after, struct notifier_event *dest) {
+  struct prayer_times prayer_t;
+  memset(&prayer_t, 0, sizeof(prayer_t));
+  if (load(ctx, year, month, &prayer_t) < 0)
+    return -2;
+
+  int found = -1;
+  const struct prayer_times_data_schedule *entry;
+  int kind;
+  while ((kind = get_prayer_times_next(&prayer_t, year, month, day, minutes, &entry)) >= 0) {
+    uint16_t at = entry->times[kind];
+    dest->at = zone_time_at(entry->year, entry->month, entry->day, at / 60, at % 60, utc_offset);
+    dest->time = kind;
+    dest->name = schedule_time_name(kind);
+
+    /* Wall clock times a DST change skips or repeats can map to the past */
+    if (dest->at != (time_t)-1 && dest->at > after) {
+      found = 0;
+      break;
+    }
+    year = entry->year;
+    month = entry->month;
+    day = entry->day;
+    minutes = at;
+  }
+
+  get_prayer_times_free(&prayer_t);
+  return found;
+}
+
+int notifier_next(notifier_load_fn load, void *ctx, long utc_offset, time_t after,
+                  struct notifier_event *dest) {
+  if (load == NULL || dest == NULL)
+    return -1;
+
+  struct tmutils now;
+  get_zone_time_at(after, utc_offset, &now);
+
+  /* Prayers are on whole minutes, so one in the current minute is not later */
+  int in_month = month_next(load, ctx, utc_offset, now.year, now.month, now.days,
+                            now.hours * 60 + now.minutes, after, dest);
+  if (in_month == 0)
+    return 0;
+
+  int year = now.month == 12 ? now.year + 1 : now.year;
+  int month = now.month == 12 ? 1 : now.month + 1;
+  return month_next(load, ctx, utc_offset, year, month, 1, -1, after, dest) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Publish the month of a moment and the next prayer after it.
+ */
+static void publish(notifier_load_fn load, void *ctx, long utc_offset, struct schedule_shm *shm,
+                    time_t now, const struct notifier_event *next) {
+  struct tmutils at;
+  get_zone_time_at(now, utc_offset, &at);
+
+  struct prayer_times prayer_t;
+  memset(&prayer_t, 0, sizeof(prayer_t));
+  bool loaded = load(ctx, at.year, at.month, &prayer_t) == 0;
+  schedule_shm_publish(shm, loaded ? &prayer_t : NULL, utc_offset, next);
+  if (loaded)
+    get_prayer_times_free(&prayer_t);
+}
+
+int notifier_run(notifier_load_fn load, void *ctx, long utc_offset, FILE *out,
+                 struct schedule_shm *shm) {
+  int fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "notifier_run cannot create timer: %s\n", strerror(errno));
+    return -1;
+  }
+
+  /* Everything up to here counts as announced */
+  time_t last = time(NULL);
+
+  for (;;) {
+    struct notifier_event next;
+    bool found = notifier_next(load, ctx, utc_offset, last, &next) == 0;
+    time_t wake = found ? next.at : time(NULL) + NOTIFIER_RETRY_SECONDS;
+    if (shm != NULL)
+      publish(load, ctx, utc_offset, shm, time(NULL), found ? &next : NULL);
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = wake;
+    if (timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, NULL) < 0) {
+      fprintf(stderr, "notifier_run cannot arm timer: %s\n", strerror(errno));
+      break;
+    }
+
+    /* Returns when the time comes, or with ECANCELED when the clock is set */
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != ECANCELED) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "notifier_run cannot wait on timer: %s\n", strerror(errno));
+      break;
+    }
+
+    /* Everything that came due, each once: after a suspend there may be several */
+    time_t now = time(NULL);
+    while (found && next.at <= now) {
+      if (now - next.at <= NOTIFIER_LATE_SECONDS) {
+        struct tmutils at;
+        get_zone_time_at(next.at, utc_offset, &at);
+        fprintf(out, "%02d:%02d %s\n", at.hours, at.minutes, next.name);
+      }
+      found = notifier_next(load, ctx, utc_offset, next.at, &next) == 0;
+    }
+    fflush(out);
+
+    /* A clock set backwards makes the events in between come again */
+    last = now;
+  }
+
+  close(fd);
+  return -1;
+}
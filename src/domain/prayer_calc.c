@@ -0,0 +1,566 @@
+/**
+ * @file prayer_calc.c
+ * @brief Implementation of the offline prayer time calculation.
+ *
+ * The solar coordinates follow the low-precision formulas of the U.S.
+ * Naval Observatory (good to about a minute of arc until 2050), which is
+ * well below the one minute resolution of a schedule.
+ */
+
+#include "domain/prayer_calc.h"
+#include "utils/tmutils.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEG_TO_RAD (M_PI / 180.0)
+#define RAD_TO_DEG (180.0 / M_PI)
+
+#define SUNRISE_ALTITUDE (-0.833) /**< Refraction plus the sun's semi-diameter */
+
+/**
+ * @brief Position of the sun at one instant.
+ *
+ * @param declination  Radians.
+ * @param equation     Equation of time, hours (apparent minus mean solar time).
+ */
+struct sun_position {
+  double declination;
+  double equation;
+};
+
+static const struct {
+  const char *name;
+  struct prayer_params params;
+} methods[PRAYER_METHOD_COUNT] = {
+    [PRAYER_METHOD_KEMENAG] = {"kemenag", {20.0, 18.0, 0, 4.5, 1, 2, true}},
+    [PRAYER_METHOD_MWL] = {"mwl", {18.0, 17.0, 0, 4.5, 1, 0, false}},
+    [PRAYER_METHOD_ISNA] = {"isna", {15.0, 15.0, 0, 4.5, 1, 0, false}},
+    [PRAYER_METHOD_EGYPT] = {"egypt", {19.5, 17.5, 0, 4.5, 1, 0, false}},
+    [PRAYER_METHOD_UMM_AL_QURA] = {"makkah", {18.5, 0.0, 90, 4.5, 1, 0, false}},
+    [PRAYER_METHOD_KARACHI] = {"karachi", {18.0, 18.0, 0, 4.5, 1, 0, false}},
+    [PRAYER_METHOD_JAKIM] = {"jakim", {20.0, 18.0, 0, 4.5, 1, 0, false}},
+};
+
+int prayer_params_init(struct prayer_params *params, enum prayer_method method) {
+  if (params == NULL || (int)method < 0 || method >= PRAYER_METHOD_COUNT)
+    return -1;
+
+  *params = methods[method].params;
+  return 0;
+}
+
+int prayer_method_from_name(const char *name) {
+  if (name == NULL)
+    return -1;
+
+  for (int i = 0; i < PRAYER_METHOD_COUNT; i++) {
+    if (strcmp(methods[i].name, name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+const char *prayer_method_name(enum prayer_method method) {
+  if ((int)method < 0 || method >= PRAYER_METHOD_COUNT)
+    return NULL;
+  return methods[method].name;
+}
+
+/**
+ * @brief Julian day at 0h UT of a Gregorian date.
+ *
+ * Days past the end of the month simply continue into the next one.
+ */
+static double julian_day(int year, int month, int day) {
+  if (month <= 2) {
+    year -= 1;
+    month += 12;
+  }
+
+  int century = year / 100;
+  int correction = 2 - century + century / 4;
+  return floor(365.25 * (year + 4716)) + floor(30.6001 * (month + 1)) + day + correction - 1524.5;
+}
+
+static void sun_at(double jd, struct sun_position *dest) {
+  double d = jd - 2451545.0;
+
+  double anomaly = (357.529 + 0.98560028 * d) * DEG_TO_RAD;
+  double mean_longitude = fmod(280.459 + 0.98564736 * d, 360.0);
+  double longitude =
+      (mean_longitude + 1.915 * sin(anomaly) + 0.020 * sin(2 * anomaly)) * DEG_TO_RAD;
+  double obliquity = (23.439 - 0.00000036 * d) * DEG_TO_RAD;
+
+  double right_ascension = atan2(cos(obliquity) * sin(longitude), cos(longitude)) * RAD_TO_DEG;
+  double equation = fmod(mean_longitude - right_ascension, 360.0) / 15.0;
+
+  /* Both angles are modulo 360, bring the difference back next to zero */
+  if (equation > 12.0)
+    equation -= 24.0;
+  else if (equation < -12.0)
+    equation += 24.0;
+
+  dest->declination = asin(sin(obliquity) * sin(longitude));
+  dest->equation = equation;
+}
+
+/**
+ * @brief Sun at a midnight, in the form the kernel interpolates.
+ *
+ * Interpolating the sine and cosine of the declination instead of the
+ * angle leaves the kernel without any trigonometry; over one day the
+ * difference is far below a second of time.
+ */
+struct sun_midnight {
+  double sin_decl;
+  double cos_decl;
+  double equation; /**< Hours */
+};
+
+/**
+ * @brief Calculation parameters reduced to what the kernel uses.
+ */
+struct kernel_params {
+  double sin_fajr;
+  double sin_sunrise;
+  double sin_dhuha;
+  double sin_isya;
+  double shadow;
+  double isya_hours; /**< Fixed isya interval after maghrib, 0 to use sin_isya */
+  double margin;     /**< Ihtiyat, minutes */
+  double bias;       /**< Added before truncating: 0.5 rounds to the nearest minute */
+  int round_up;      /**< 1 to round up instead */
+};
+
+/**
+ * @brief PRAYER_BATCH_LANES locations, prepared once per batch.
+ *
+ * Unused lanes of the last block hold a valid dummy location.
+ */
+struct lane_block {
+  double lat_sin[PRAYER_BATCH_LANES];
+  double lat_cos[PRAYER_BATCH_LANES];
+  double lat_tan[PRAYER_BATCH_LANES];
+  double longitude[PRAYER_BATCH_LANES]; /**< Hours (degrees / 15) */
+  double offset[PRAYER_BATCH_LANES];    /**< UTC offset, minutes */
+};
+
+#define LANES PRAYER_BATCH_LANES
+
+static void kernel_params_init(struct kernel_params *kernel, const struct prayer_params *params) {
+  kernel->sin_fajr = sin(-params->fajr_angle * DEG_TO_RAD);
+  kernel->sin_sunrise = sin(SUNRISE_ALTITUDE * DEG_TO_RAD);
+  kernel->sin_dhuha = sin(params->dhuha_altitude * DEG_TO_RAD);
+  kernel->sin_isya = sin(-params->isya_angle * DEG_TO_RAD);
+  kernel->shadow = params->asr_shadow;
+  kernel->isya_hours = params->isya_minutes / 60.0;
+  kernel->margin = params->ihtiyat;
+  kernel->bias = params->round_up ? 0.0 : 0.5;
+  kernel->round_up = params->round_up ? 1 : 0;
+}
+
+static void sun_midnight_at(double jd, struct sun_midnight *dest) {
+  struct sun_position sun;
+  sun_at(jd, &sun);
+  dest->sin_decl = sin(sun.declination);
+  dest->cos_decl = cos(sun.declination);
+  dest->equation = sun.equation;
+}
+
+static void lane_block_init(struct lane_block *block, const struct prayer_batch *batch, int first,
+                            int lanes) {
+  for (int j = 0; j < LANES; j++) {
+    int i = first + (j < lanes ? j : 0);
+    double latitude = batch->latitude[i] * DEG_TO_RAD;
+    block->lat_sin[j] = sin(latitude);
+    block->lat_cos[j] = cos(latitude);
+    block->lat_tan[j] = tan(latitude);
+    block->longitude[j] = batch->longitude[i] / 15.0;
+    block->offset[j] = batch->utc_offset[i] * 60.0;
+  }
+}
+
+/**
+ * @brief arccos with an error below 2e-8 radians, for |x| <= 1.
+ *
+ * Abramowitz & Stegun 4.4.46; only arithmetic and a square root, so loops
+ * calling it vectorize.
+ */
+static inline double acos_poly(double x) {
+  double a = fabs(x);
+  double p = -0.0012624911;
+  p = p * a + 0.0066700901;
+  p = p * a - 0.0170881256;
+  p = p * a + 0.0308918810;
+  p = p * a - 0.0501743046;
+  p = p * a + 0.0889789874;
+  p = p * a - 0.2145988016;
+  p = p * a + 1.5707963050;
+  double r = sqrt(1.0 - a) * p;
+  return x < 0.0 ? M_PI - r : r;
+}
+
+/**
+ * @brief UT hours at which the sun crosses an altitude, NAN if it never does.
+ *
+ * @param guess    Approximate local solar time of the event, hours; the sun
+ *                 is taken at that time.
+ * @param sin_alt  Sine of the altitude per lane (NAN for none).
+ * @param sign     -1 before noon (rising sun), 1 after.
+ */
+static inline __attribute__((always_inline)) void
+lane_crossing(const struct lane_block *block, const struct sun_midnight *day,
+              const struct sun_midnight *next, double guess, const double sin_alt[LANES],
+              double sign, double ut[LANES]) {
+  for (int j = 0; j < LANES; j++) {
+    double t = (guess - block->longitude[j]) * (1.0 / 24.0);
+    double sin_decl = day->sin_decl + (next->sin_decl - day->sin_decl) * t;
+    double cos_decl = day->cos_decl + (next->cos_decl - day->cos_decl) * t;
+    double equation = day->equation + (next->equation - day->equation) * t;
+    double noon = 12.0 - block->longitude[j] - equation;
+
+    double cos_hour =
+        (sin_alt[j] - block->lat_sin[j] * sin_decl) / (block->lat_cos[j] * cos_decl);
+    bool valid = cos_hour >= -1.0 && cos_hour <= 1.0;
+    double hours = acos_poly(valid ? cos_hour : 0.0) * (12.0 / M_PI);
+    ut[j] = valid ? noon + sign * hours : NAN;
+  }
+}
+
+/**
+ * @brief Sine of the ashr altitude per lane, NAN when the sun never gets
+ *        that high.
+ *
+ * The altitude is acot(shadow + tan|latitude - declination|); the tangent
+ * of the difference comes from the tangents of both angles.
+ */
+static inline __attribute__((always_inline)) void
+lane_ashr_altitude(const struct kernel_params *kernel, const struct lane_block *block,
+                   const struct sun_midnight *day, const struct sun_midnight *next,
+                   double guess, double sin_alt[LANES]) {
+  for (int j = 0; j < LANES; j++) {
+    double t = (guess - block->longitude[j]) * (1.0 / 24.0);
+    double sin_decl = day->sin_decl + (next->sin_decl - day->sin_decl) * t;
+    double cos_decl = day->cos_decl + (next->cos_decl - day->cos_decl) * t;
+    double tan_decl = sin_decl / cos_decl;
+
+    double denominator = 1.0 + block->lat_tan[j] * tan_decl;
+    double cotangent = kernel->shadow + fabs((block->lat_tan[j] - tan_decl) / denominator);
+    sin_alt[j] = denominator > 0.0 ? 1.0 / sqrt(1.0 + cotangent * cotangent) : NAN;
+  }
+}
+
+/**
+ * @brief Turn UT hours into whole local minutes, PRAYER_TIME_NONE for NAN.
+ */
+static inline __attribute__((always_inline)) void
+lane_minutes(const struct lane_block *block, const double ut[LANES], double margin, double bias,
+             int round_up, int16_t dest[LANES]) {
+  for (int j = 0; j < LANES; j++) {
+    /* Shifted two days ahead so truncation rounds down */
+    double minutes = ut[j] * 60.0 + block->offset[j] + margin + 2880.0;
+    bool valid = minutes >= 0.0 && minutes < 14400.0;
+    minutes = valid ? minutes : 0.0;
+
+    int whole = (int)(minutes + bias);
+    whole += round_up & ((double)whole < minutes);
+    whole -= 1440 * (int)((whole + 0.5) * (1.0 / 1440.0));
+    dest[j] = valid ? (int16_t)whole : PRAYER_TIME_NONE;
+  }
+}
+
+static inline __attribute__((always_inline)) void
+lane_fill(double value, double dest[LANES]) {
+  for (int j = 0; j < LANES; j++)
+    dest[j] = value;
+}
+
+/* One day of one block, every time as UT hours and then as local minutes */
+static inline __attribute__((always_inline)) void
+block_day(const struct kernel_params *kernel, const struct lane_block *block,
+          const struct sun_midnight *day, const struct sun_midnight *next,
+          int16_t dest[PRAYER_KIND_COUNT][LANES]) {
+  double ut[PRAYER_KIND_COUNT][LANES];
+  double sin_alt[LANES];
+
+  lane_fill(kernel->sin_fajr, sin_alt);
+  lane_crossing(block, day, next, 5.0, sin_alt, -1.0, ut[PRAYER_FAJR]);
+  lane_fill(kernel->sin_sunrise, sin_alt);
+  lane_crossing(block, day, next, 6.0, sin_alt, -1.0, ut[PRAYER_SUNRISE]);
+  lane_crossing(block, day, next, 18.0, sin_alt, 1.0, ut[PRAYER_MAGHRIB]);
+  lane_fill(kernel->sin_dhuha, sin_alt);
+  lane_crossing(block, day, next, 6.0, sin_alt, -1.0, ut[PRAYER_DHUHA]);
+  lane_ashr_altitude(kernel, block, day, next, 13.0, sin_alt);
+  lane_crossing(block, day, next, 13.0, sin_alt, 1.0, ut[PRAYER_ASHR]);
+
+  for (int j = 0; j < LANES; j++) {
+    double t = (12.0 - block->longitude[j]) * (1.0 / 24.0);
+    double equation = day->equation + (next->equation - day->equation) * t;
+    ut[PRAYER_DZUHR][j] = 12.0 - block->longitude[j] - equation;
+  }
+
+  if (kernel->isya_hours > 0.0) {
+    for (int j = 0; j < LANES; j++)
+      ut[PRAYER_ISYA][j] = ut[PRAYER_MAGHRIB][j] + kernel->isya_hours;
+  } else {
+    lane_fill(kernel->sin_isya, sin_alt);
+    lane_crossing(block, day, next, 18.0, sin_alt, 1.0, ut[PRAYER_ISYA]);
+  }
+
+  for (int kind = 0; kind < PRAYER_KIND_COUNT; kind++) {
+    /* Sunrise ends fajr, so its margin goes the other way and rounds down */
+    if (kind == PRAYER_SUNRISE)
+      lane_minutes(block, ut[kind], -kernel->margin, 0.0, 0, dest[kind]);
+    else
+      lane_minutes(block, ut[kind], kernel->margin, kernel->bias, kernel->round_up, dest[kind]);
+  }
+}
+
+/**
+ * @brief Calculate locations [first, last) of a batch over every day.
+ */
+typedef void (*slice_fn)(const struct kernel_params *kernel, const struct sun_midnight *sun,
+                         const struct prayer_batch *batch, int first, int last,
+                         struct prayer_table *dest);
+
+static inline __attribute__((always_inline)) void
+slice_with(const struct kernel_params *kernel, const struct sun_midnight *sun,
+           const struct prayer_batch *batch, int first, int last, struct prayer_table *dest) {
+  for (int base = first; base < last; base += LANES) {
+    int lanes = last - base < LANES ? last - base : LANES;
+    struct lane_block block;
+    lane_block_init(&block, batch, base, lanes);
+
+    for (int d = 0; d < dest->days; d++) {
+      int16_t times[PRAYER_KIND_COUNT][LANES];
+      block_day(kernel, &block, &sun[d], &sun[d + 1], times);
+
+      size_t row = (size_t)d * dest->count + base;
+      for (int kind = 0; kind < PRAYER_KIND_COUNT; kind++)
+        memcpy(dest->times[kind] + row, times[kind], lanes * sizeof(int16_t));
+    }
+  }
+}
+
+static void slice_default(const struct kernel_params *kernel, const struct sun_midnight *sun,
+                          const struct prayer_batch *batch, int first, int last,
+                          struct prayer_table *dest) {
+  slice_with(kernel, sun, batch, first, last, dest);
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/* Same code, four lanes per instruction instead of two */
+__attribute__((target("avx2"))) static void
+slice_avx2(const struct kernel_params *kernel, const struct sun_midnight *sun,
+           const struct prayer_batch *batch, int first, int last, struct prayer_table *dest) {
+  slice_with(kernel, sun, batch, first, last, dest);
+}
+#endif
+
+static slice_fn best_slice(void) {
+#if defined(__x86_64__) && defined(__GNUC__)
+  if (__builtin_cpu_supports("avx2"))
+    return slice_avx2;
+#endif
+  return slice_default;
+}
+
+/**
+ * @brief A slice of a batch calculated by one thread.
+ */
+struct table_job {
+  slice_fn run;
+  const struct kernel_params *kernel;
+  const struct sun_midnight *sun;
+  const struct prayer_batch *batch;
+  struct prayer_table *dest;
+  int first;
+  int last;
+};
+
+static void *table_worker(void *arg) {
+  struct table_job *job = arg;
+  job->run(job->kernel, job->sun, job->batch, job->first, job->last, job->dest);
+  return NULL;
+}
+
+int prayer_table_init(struct prayer_table *table, int count, int days) {
+  if (table == NULL || count < 1 || days < 1 || days > PRAYER_CALC_MAX_DAYS)
+    return -1;
+
+  memset(table, 0, sizeof(*table));
+  size_t entries = (size_t)count * days;
+  int16_t *times = malloc(entries * PRAYER_KIND_COUNT * sizeof(int16_t));
+  if (times == NULL) {
+    fprintf(stderr, "prayer_table_init cannot allocate memory\n");
+    return -1;
+  }
+
+  for (int kind = 0; kind < PRAYER_KIND_COUNT; kind++)
+    table->times[kind] = times + entries * kind;
+  table->count = count;
+  table->days = days;
+  return 0;
+}
+
+void prayer_table_free(struct prayer_table *table) {
+  if (table == NULL)
+    return;
+
+  free(table->times[0]);
+  memset(table, 0, sizeof(*table));
+}
+
+int prayer_calc_table(const struct prayer_params *params, const struct prayer_batch *batch,
+                      int year, int month, int day, int threads, struct prayer_table *dest) {
+  if (params == NULL || batch == NULL || dest == NULL || batch->count != dest->count ||
+      dest->times[0] == NULL || month < 1 || month > 12 || day < 1)
+    return -1;
+
+  for (int i = 0; i < batch->count; i++) {
+    if (!(batch->latitude[i] >= -90.0 && batch->latitude[i] <= 90.0))
+      return -1;
+  }
+
+  struct kernel_params kernel;
+  kernel_params_init(&kernel, params);
+
+  /* Sun at every midnight of the range, shared by all locations */
+  struct sun_midnight sun[PRAYER_CALC_MAX_DAYS + 1];
+  double jd = julian_day(year, month, day);
+  for (int i = 0; i <= dest->days; i++)
+    sun_midnight_at(jd + i, &sun[i]);
+
+  if (threads <= 0)
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads > batch->count / PRAYER_BATCH_MIN)
+    threads = batch->count / PRAYER_BATCH_MIN;
+  if (threads > PRAYER_BATCH_MAX_THREADS)
+    threads = PRAYER_BATCH_MAX_THREADS;
+  if (threads < 1)
+    threads = 1;
+
+  /* Whole blocks per thread, the caller takes the first slice */
+  int blocks = (batch->count + LANES - 1) / LANES;
+  struct table_job jobs[PRAYER_BATCH_MAX_THREADS];
+  pthread_t workers[PRAYER_BATCH_MAX_THREADS];
+  bool started[PRAYER_BATCH_MAX_THREADS] = {false};
+  slice_fn run = best_slice();
+
+  for (int t = 0; t < threads; t++) {
+    int first = (int)((long)blocks * t / threads) * LANES;
+    int last = (int)((long)blocks * (t + 1) / threads) * LANES;
+    jobs[t] = (struct table_job){run, &kernel, sun, batch, dest, first,
+                                 last < batch->count ? last : batch->count};
+    if (t > 0)
+      started[t] = pthread_create(&workers[t], NULL, table_worker, &jobs[t]) == 0;
+  }
+
+  table_worker(&jobs[0]);
+  for (int t = 1; t < threads; t++) {
+    if (started[t])
+      pthread_join(workers[t], NULL);
+    else
+      table_worker(&jobs[t]); /* No thread for it, calculate it here */
+  }
+
+  return 0;
+}
+
+int prayer_calc_days(const struct prayer_params *params, const struct prayer_location *locations,
+                     int location_count, int year, int month, int day, int days,
+                     struct prayer_day *dest) {
+  if (params == NULL || locations == NULL || dest == NULL || location_count < 0)
+    return -1;
+  if (location_count == 0)
+    return 0;
+
+  double *coordinates = malloc(sizeof(double) * 3 * location_count);
+  struct prayer_table table;
+  if (coordinates == NULL || prayer_table_init(&table, location_count, days) < 0) {
+    free(coordinates);
+    return -1;
+  }
+
+  struct prayer_batch batch = {location_count, coordinates, coordinates + location_count,
+                               coordinates + 2 * location_count};
+  for (int l = 0; l < location_count; l++) {
+    coordinates[l] = locations[l].latitude;
+    coordinates[location_count + l] = locations[l].longitude;
+    coordinates[2 * location_count + l] = locations[l].utc_offset;
+  }
+
+  int calculated = prayer_calc_table(params, &batch, year, month, day, 0, &table);
+  for (int l = 0; calculated == 0 && l < location_count; l++) {
+    for (int d = 0; d < days; d++) {
+      size_t i = (size_t)d * location_count + l;
+      struct prayer_day *out = &dest[(size_t)l * days + d];
+      out->fajr = table.times[PRAYER_FAJR][i];
+      out->sunrise = table.times[PRAYER_SUNRISE][i];
+      out->dhuha = table.times[PRAYER_DHUHA][i];
+      out->dzuhr = table.times[PRAYER_DZUHR][i];
+      out->ashr = table.times[PRAYER_ASHR][i];
+      out->maghrib = table.times[PRAYER_MAGHRIB][i];
+      out->isya = table.times[PRAYER_ISYA][i];
+    }
+  }
+
+  prayer_table_free(&table);
+  free(coordinates);
+  return calculated;
+}
+
+int prayer_calc_day(const struct prayer_params *params, const struct prayer_location *location,
+                    int year, int month, int day, struct prayer_day *dest) {
+  return prayer_calc_days(params, location, 1, year, month, day, 1, dest);
+}
+
+/* Minutes as a schedule stores them */
+static uint16_t schedule_minutes(int minutes) {
+  return minutes == PRAYER_TIME_NONE ? SCHEDULE_TIME_NONE : (uint16_t)minutes;
+}
+
+int prayer_calc_month(const struct prayer_params *params, const struct prayer_location *location,
+                      int year, int month, struct prayer_times *dest) {
+  if (params == NULL || location == NULL || dest == NULL)
+    return -1;
+
+  int days = days_in_month(year, month);
+  struct prayer_day times[31];
+  if (days == 0 || prayer_calc_days(params, location, 1, year, month, 1, days, times) < 0) {
+    fprintf(stderr, "prayer_calc_month invalid date or location\n");
+    return -1;
+  }
+
+  memset(dest, 0, sizeof(*dest));
+  arena_init(&dest->arena, SCHEDULE_ARENA_BLOCK);
+  dest->data.schedule = calloc(days, sizeof(struct prayer_times_data_schedule));
+  if (dest->data.schedule == NULL) {
+    fprintf(stderr, "prayer_calc_month cannot allocate memory\n");
+    return -1;
+  }
+
+  for (int i = 0; i < days; i++) {
+    struct prayer_times_data_schedule *entry = &dest->data.schedule[i];
+    entry->year = (uint16_t)year;
+    entry->month = (uint8_t)month;
+    entry->day = (uint8_t)(i + 1);
+    entry->times[SCHEDULE_FAJR] = schedule_minutes(times[i].fajr);
+    entry->times[SCHEDULE_DHUHA] = schedule_minutes(times[i].dhuha);
+    entry->times[SCHEDULE_DZUHR] = schedule_minutes(times[i].dzuhr);
+    entry->times[SCHEDULE_ASHR] = schedule_minutes(times[i].ashr);
+    entry->times[SCHEDULE_MAGHRIB] = schedule_minutes(times[i].maghrib);
+    entry->times[SCHEDULE_ISYA] = schedule_minutes(times[i].isya);
+  }
+
+  dest->status = true;
+  dest->data.schedule_size = days;
+  dest->data.has_coordinates = true;
+  dest->data.latitude = location->latitude;
+  dest->data.longitude = location->longitude;
+  return 0;
+}
@@ -0,0 +1,204 @@
+/**
+ * @file schedule_batch.c
+ * @brief Implementation of the batch schedule fetch.
+ *
+ * The TLS stack is blocking, so concurrency comes from threads rather than
+ * an event loop: each worker owns one struct http_conn and takes the next
+ * few requests off a shared counter, pipelined, until the batch is done.
+ */
+
+#define _POSIX_C_SOURCE 200809L /* clock_nanosleep */
+
+#include "domain/schedule_batch.h"
+#include "domain/get_prayer_times.h"
+#include "network/connection.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define SCHEDULE_BATCH_DEFAULT_CONNECTIONS 4
+#define SCHEDULE_BATCH_DEFAULT_PIPELINE    8
+
+/**
+ * @brief State the workers of a batch share, under lock.
+ */
+struct batch_state {
+  const struct schedule_request *requests;
+  struct schedule_result *results;
+  int count;
+  const struct schedule_batch_options *options;
+  int pipeline; /**< Requests a worker takes at a time */
+
+  pthread_mutex_t lock;
+  int next;                   /**< First request no worker took yet */
+  int done;                   /**< Requests finished */
+  int failed;                 /**< Requests that failed */
+  struct timespec next_start; /**< Earliest start of the next request under the rate limit */
+};
+
+static int timespec_compare(const struct timespec *a, const struct timespec *b) {
+  if (a->tv_sec != b->tv_sec)
+    return a->tv_sec < b->tv_sec ? -1 : 1;
+  return a->tv_nsec < b->tv_nsec ? -1 : a->tv_nsec > b->tv_nsec;
+}
+
+/**
+ * @brief Take the next requests, at most state->pipeline of them.
+ *
+ * @return Index of the first request, -1 when there are none left.
+ */
+static int batch_take(struct batch_state *state, int *count) {
+  pthread_mutex_lock(&state->lock);
+  int first = state->next < state->count ? state->next : -1;
+  *count = 0;
+  if (first >= 0) {
+    *count = state->count - first < state->pipeline ? state->count - first : state->pipeline;
+    state->next += *count;
+  }
+  pthread_mutex_unlock(&state->lock);
+  return first;
+}
+
+/**
+ * @brief Under a rate limit, wait for the start slots of count requests.
+ *
+ * Slots are 1/rate apart and shared by every worker; a slot left unused is
+ * not made up for. The requests go out together at the last of their slots.
+ */
+static void batch_wait_rate(struct batch_state *state, int count) {
+  double rate = state->options->rate;
+  if (rate <= 0 || count <= 0)
+    return;
+
+  pthread_mutex_lock(&state->lock);
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  struct timespec start = timespec_compare(&now, &state->next_start) > 0 ? now : state->next_start;
+
+  long long interval = (long long)(1e9 / rate);
+  long long last = start.tv_nsec + interval * (count - 1);
+  long long after = last + interval;
+  state->next_start.tv_sec = start.tv_sec + (time_t)(after / 1000000000);
+  state->next_start.tv_nsec = (long)(after % 1000000000);
+  start.tv_sec += (time_t)(last / 1000000000);
+  start.tv_nsec = (long)(last % 1000000000);
+  pthread_mutex_unlock(&state->lock);
+
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &start, NULL) == EINTR)
+    ;
+}
+
+static void batch_finish(struct batch_state *state, int index,
+                         const struct schedule_result *result) {
+  pthread_mutex_lock(&state->lock);
+  state->done++;
+  if (result->status == SCHEDULE_BATCH_FAILED)
+    state->failed++;
+  if (state->results)
+    state->results[index] = *result;
+  if (state->options->progress)
+    state->options->progress(state->options->user, &state->requests[index], result, state->done,
+                             state->count);
+  pthread_mutex_unlock(&state->lock);
+}
+
+static enum schedule_batch_status batch_status(enum schedule_fetch_status status) {
+  switch (status) {
+  case SCHEDULE_FETCH_STORED:
+    return SCHEDULE_BATCH_FETCHED;
+  case SCHEDULE_FETCH_UNCHANGED:
+    return SCHEDULE_BATCH_UNCHANGED;
+  default:
+    return SCHEDULE_BATCH_FAILED;
+  }
+}
+
+static void *batch_worker(void *arg) {
+  struct batch_state *state = arg;
+  struct http_conn conn = {.fd = -1};
+
+  int first, taken;
+  while ((first = batch_take(state, &taken)) >= 0) {
+    struct schedule_fetch fetches[SCHEDULE_BATCH_MAX_PIPELINE];
+    int indices[SCHEDULE_BATCH_MAX_PIPELINE];
+    int count = 0;
+
+    for (int index = first; index < first + taken; index++) {
+      const struct schedule_request *request = &state->requests[index];
+      if (!state->options->refresh &&
+          get_prayer_times_is_cached(request->city_id, request->year, request->month)) {
+        struct schedule_result cached = {SCHEDULE_BATCH_CACHED, 0.0};
+        batch_finish(state, index, &cached);
+        continue;
+      }
+
+      struct schedule_fetch *fetch = &fetches[count];
+      memset(fetch, 0, sizeof(*fetch));
+      fetch->city_id = request->city_id;
+      fetch->year = request->year;
+      fetch->month = request->month;
+      indices[count++] = index;
+    }
+    if (count == 0)
+      continue;
+
+    batch_wait_rate(state, count);
+    get_prayer_times_refetch(&conn, fetches, count);
+
+    for (int i = 0; i < count; i++) {
+      struct schedule_result result = {batch_status(fetches[i].status), fetches[i].latency_ms};
+      batch_finish(state, indices[i], &result);
+    }
+  }
+
+  http_conn_close(&conn);
+  return NULL;
+}
+
+int schedule_batch_fetch(const struct schedule_request *requests, int count,
+                         const struct schedule_batch_options *options,
+                         struct schedule_result *results) {
+  struct schedule_batch_options defaults = {0};
+  if (options == NULL)
+    options = &defaults;
+
+  if ((requests == NULL && count > 0) || count < 0 || options->connections < 0 ||
+      options->connections > SCHEDULE_BATCH_MAX_CONNECTIONS || options->pipeline < 0 ||
+      options->pipeline > SCHEDULE_BATCH_MAX_PIPELINE || options->rate < 0) {
+    fprintf(stderr, "schedule_batch_fetch invalid argument\n");
+    return -1;
+  }
+
+  struct batch_state state;
+  memset(&state, 0, sizeof(state));
+  state.requests = requests;
+  state.results = results;
+  state.count = count;
+  state.options = options;
+  state.pipeline = options->pipeline ? options->pipeline : SCHEDULE_BATCH_DEFAULT_PIPELINE;
+  pthread_mutex_init(&state.lock, NULL);
+
+  /* No more connections than requests, each would go unused */
+  int connections = options->connections ? options->connections
+                                         : SCHEDULE_BATCH_DEFAULT_CONNECTIONS;
+  if (connections > count)
+    connections = count;
+
+  pthread_t threads[SCHEDULE_BATCH_MAX_CONNECTIONS];
+  int started = 0;
+  for (; started < connections; started++) {
+    if (pthread_create(&threads[started], NULL, batch_worker, &state) != 0)
+      break;
+  }
+
+  /* The workers drain the shared counter, so even a single one finishes the batch */
+  if (started == 0 && count > 0)
+    batch_worker(&state);
+  for (int i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+
+  pthread_mutex_destroy(&state.lock);
+  return state.failed;
+}
@@ -0,0 +1,252 @@
+/**
+ * @file schedule_shm.c
+ * @brief Implementation of the shared memory schedule.
+ *
+ * The data is copied with plain memcpy() between the fences of the
+ * sequence lock. A copy that raced with the writer may be torn, but it is
+ * then thrown away because the sequence changed, and the fields are plain
+ * integers, so a torn copy is never acted upon.
+ */
+
+#define _DEFAULT_SOURCE /* flock */
+
+#include "domain/schedule_shm.h"
+#include "utils/tmutils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+_Static_assert(ATOMIC_INT_LOCK_FREE == 2, "the sequence must be lock-free to be shared");
+
+static void segment_name(char dest[32]) {
+  snprintf(dest, 32, SCHEDULE_SHM_NAME_PREFIX "%lu", (unsigned long)getuid());
+}
+
+static bool segment_valid(const struct schedule_shm_segment *segment) {
+  return memcmp(segment->magic, SCHEDULE_SHM_MAGIC, sizeof(segment->magic)) == 0 &&
+         segment->version == SCHEDULE_SHM_VERSION;
+}
+
+int schedule_shm_create(struct schedule_shm *shm) {
+  if (shm == NULL)
+    return -1;
+  shm->fd = -1;
+  shm->segment = NULL;
+
+  char name[32];
+  segment_name(name);
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    fprintf(stderr, "schedule_shm_create cannot open %s: %s\n", name, strerror(errno));
+    return -1;
+  }
+
+  /* The lock goes with the process, a crashed publisher leaves none behind */
+  if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+    if (errno == EWOULDBLOCK)
+      fprintf(stderr, "schedule_shm_create: %s is published by another process\n", name);
+    else
+      fprintf(stderr, "schedule_shm_create cannot lock %s: %s\n", name, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  if (ftruncate(fd, sizeof(struct schedule_shm_segment)) < 0) {
+    fprintf(stderr, "schedule_shm_create cannot size %s: %s\n", name, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  void *map = mmap(NULL, sizeof(struct schedule_shm_segment), PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "schedule_shm_create cannot map %s: %s\n", name, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  /*
+   * A segment of this layout keeps its sequence, so readers that mapped it
+   * under the previous publisher keep working; anything else starts over
+   */
+  struct schedule_shm_segment *segment = map;
+  if (!segment_valid(segment)) {
+    memset(segment, 0, sizeof(*segment));
+    memcpy(segment->magic, SCHEDULE_SHM_MAGIC, sizeof(segment->magic));
+    segment->version = SCHEDULE_SHM_VERSION;
+  }
+
+  shm->fd = fd;
+  shm->segment = segment;
+  return 0;
+}
+
+int schedule_shm_open(struct schedule_shm *shm) {
+  if (shm == NULL)
+    return -1;
+  shm->fd = -1;
+  shm->segment = NULL;
+
+  char name[32];
+  segment_name(name);
+  int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct schedule_shm_segment)) {
+    close(fd);
+    return -1;
+  }
+
+  void *map = mmap(NULL, sizeof(struct schedule_shm_segment), PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+
+  if (!segment_valid(map)) {
+    munmap(map, sizeof(struct schedule_shm_segment));
+    close(fd);
+    return -1;
+  }
+
+  shm->fd = fd;
+  shm->segment = map;
+  return 0;
+}
+
+void schedule_shm_close(struct schedule_shm *shm) {
+  if (shm == NULL)
+    return;
+
+  if (shm->segment != NULL)
+    munmap(shm->segment, sizeof(struct schedule_shm_segment));
+  if (shm->fd >= 0)
+    close(shm->fd);
+  shm->segment = NULL;
+  shm->fd = -1;
+}
+
+void schedule_shm_publish(struct schedule_shm *shm, const struct prayer_times *month,
+                          long utc_offset, const struct notifier_event *next) {
+  if (shm == NULL || shm->segment == NULL)
+    return;
+
+  struct schedule_shm_segment *segment = shm->segment;
+  struct schedule_shm_data *data = &segment->data;
+
+  /* Odd while writing; a publisher that died mid-update left it odd already */
+  uint32_t sequence = atomic_load_explicit(&segment->sequence, memory_order_relaxed) | 1;
+  atomic_store_explicit(&segment->sequence, sequence, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  memset(data, 0, sizeof(*data));
+  data->published_at = time(NULL);
+  data->next_day = -1;
+  data->next_time = -1;
+  data->local_zone = utc_offset == TMUTILS_LOCAL_ZONE;
+  data->utc_offset = data->local_zone ? 0 : (int32_t)utc_offset;
+  if (month != NULL) {
+    int count = month->data.schedule_size;
+    if (count > SCHEDULE_SHM_MAX_DAYS)
+      count = SCHEDULE_SHM_MAX_DAYS;
+    if (count > 0)
+      memcpy(data->days, month->data.schedule, sizeof(data->days[0]) * count);
+    data->days_count = count;
+    data->city_id = month->data.id;
+    if (month->data.location != NULL)
+      snprintf(data->location, sizeof(data->location), "%s", month->data.location);
+  }
+
+  if (next != NULL) {
+    data->next_at = next->at;
+    data->next_time = next->time;
+
+    struct tmutils at;
+    get_zone_time_at(next->at, utc_offset, &at);
+    for (int i = 0; i < data->days_count; i++) {
+      const struct prayer_times_data_schedule *day = &data->days[i];
+      if (day->year == at.year && day->month == at.month && day->day == at.days) {
+        data->next_day = i;
+        break;
+      }
+    }
+  }
+
+  atomic_store_explicit(&segment->sequence, sequence + 1, memory_order_release);
+}
+
+int schedule_shm_read(const struct schedule_shm *shm, struct schedule_shm_data *dest) {
+  if (shm == NULL || shm->segment == NULL || dest == NULL)
+    return -1;
+
+  struct schedule_shm_segment *segment = shm->segment;
+  for (int tries = 0; tries < SCHEDULE_SHM_READ_TRIES; tries++) {
+    uint32_t before = atomic_load_explicit(&segment->sequence, memory_order_acquire);
+    if (before & 1) {
+      /* Let a preempted writer finish rather than spin against it */
+      sched_yield();
+      continue;
+    }
+
+    memcpy(dest, &segment->data, sizeof(*dest));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&segment->sequence, memory_order_relaxed) == before)
+      return before == 0 ? -1 : 0;
+  }
+  return -1;
+}
+
+long schedule_shm_utc_offset(const struct schedule_shm_data *data) {
+  return data->local_zone ? TMUTILS_LOCAL_ZONE : data->utc_offset;
+}
+
+int schedule_shm_next(const struct schedule_shm_data *data, time_t after,
+                      struct notifier_event *dest) {
+  if (data == NULL || dest == NULL)
+    return -1;
+
+  if (data->next_time >= 0 && data->next_at > after) {
+    dest->at = data->next_at;
+    dest->time = data->next_time;
+    dest->name = schedule_time_name(data->next_time);
+    return 0;
+  }
+
+  /* The published prayer has passed: look further into the published month */
+  struct prayer_times month;
+  memset(&month, 0, sizeof(month));
+  month.data.schedule = (struct prayer_times_data_schedule *)data->days;
+  month.data.schedule_size = data->days_count;
+
+  long utc_offset = schedule_shm_utc_offset(data);
+  struct tmutils now;
+  get_zone_time_at(after, utc_offset, &now);
+  int year = now.year, mon = now.month, day = now.days;
+  int minutes = now.hours * 60 + now.minutes;
+
+  const struct prayer_times_data_schedule *entry;
+  int kind;
+  while ((kind = get_prayer_times_next(&month, year, mon, day, minutes, &entry)) >= 0) {
+    uint16_t at = entry->times[kind];
+    time_t when = zone_time_at(entry->year, entry->month, entry->day, at / 60, at % 60, utc_offset);
+    if (when != (time_t)-1 && when > after) {
+      dest->at = when;
+      dest->time = kind;
+      dest->name = schedule_time_name(kind);
+      return 0;
+    }
+    year = entry->year;
+    mon = entry->month;
+    day = entry->day;
+    minutes = at;
+  }
+  return -1;
+}
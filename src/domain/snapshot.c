@@ -0,0 +1,175 @@
+/**
+ * @file snapshot.c
+ * @brief Implementation of the binary snapshot reader and writer.
+ */
+
+#include "domain/snapshot.h"
+#include "utils/fsutils.h"
+#include "utils/stats.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Map and validate a snapshot, see snapshot_open() */
+static int snapshot_map(const char *path, uint32_t kind, uint32_t fields, struct snapshot *dest) {
+  memset(dest, 0, sizeof(*dest));
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct snapshot_header)) {
+    close(fd);
+    return -1;
+  }
+
+  size_t size = (size_t)st.st_size;
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror("snapshot_open mmap");
+    return -1;
+  }
+
+  const struct snapshot_header *header = map;
+  size_t table_size = (size_t)header->record_count * header->record_fields * sizeof(uint32_t);
+  const char *blob = (const char *)map + sizeof(*header) + table_size;
+
+  if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != SNAPSHOT_VERSION || header->kind != kind ||
+      header->record_fields != fields || header->blob_size == 0 ||
+      size != sizeof(*header) + table_size + header->blob_size ||
+      blob[header->blob_size - 1] != '\0') {
+    munmap(map, size);
+    return -1;
+  }
+
+  dest->map = map;
+  dest->map_size = size;
+  dest->header = header;
+  dest->records = (const uint32_t *)((const char *)map + sizeof(*header));
+  dest->blob = blob;
+  return 0;
+}
+
+int snapshot_open(const char *path, uint32_t kind, uint32_t fields, struct snapshot *dest) {
+  if (path == NULL || dest == NULL) {
+    fprintf(stderr, "snapshot_open invalid argument\n");
+    return -1;
+  }
+
+  struct stats_span span;
+  stats_begin(&span);
+  int mapped = snapshot_map(path, kind, fields, dest);
+  stats_end(&span, STATS_CACHE, mapped == 0 ? dest->map_size : 0);
+  return mapped;
+}
+
+const char *snapshot_string(const struct snapshot *snap, uint32_t offset) {
+  if (snap == NULL || offset == SNAPSHOT_NULL || offset >= snap->header->blob_size)
+    return NULL;
+  return snap->blob + offset;
+}
+
+const char *snapshot_field(const struct snapshot *snap, uint32_t record, uint32_t field) {
+  if (snap == NULL || record >= snap->header->record_count ||
+      field >= snap->header->record_fields)
+    return NULL;
+  return snapshot_string(snap, snap->records[(size_t)record * snap->header->record_fields + field]);
+}
+
+void snapshot_close(struct snapshot *snap) {
+  if (snap == NULL || snap->map == NULL)
+    return;
+
+  munmap(snap->map, snap->map_size);
+  memset(snap, 0, sizeof(*snap));
+}
+
+void snapshot_unmap(void *map, size_t map_size) {
+  if (map != NULL)
+    munmap(map, map_size);
+}
+
+/* Append a string to the blob and return its offset */
+static uint32_t blob_put(char *blob, size_t *blob_len, const char *str) {
+  if (str == NULL)
+    return SNAPSHOT_NULL;
+
+  size_t len = strlen(str) + 1;
+  uint32_t offset = (uint32_t)*blob_len;
+  memcpy(blob + *blob_len, str, len);
+  *blob_len += len;
+  return offset;
+}
+
+int snapshot_write(const char *path, const struct snapshot_desc *desc) {
+  if (path == NULL || desc == NULL ||
+      (desc->values == NULL && desc->words == NULL && desc->record_count > 0)) {
+    fprintf(stderr, "snapshot_write invalid argument\n");
+    return -1;
+  }
+
+  size_t value_count = (size_t)desc->record_count * desc->record_fields;
+
+  /* One leading NUL keeps the blob non-empty and doubles as the empty string */
+  size_t blob_size = 1;
+  for (size_t i = 0; desc->words == NULL && i < value_count; i++) {
+    if (desc->values[i])
+      blob_size += strlen(desc->values[i]) + 1;
+  }
+  for (int i = 0; i < SNAPSHOT_META_MAX; i++) {
+    if (desc->meta[i])
+      blob_size += strlen(desc->meta[i]) + 1;
+  }
+
+  if (blob_size >= SNAPSHOT_NULL) {
+    fprintf(stderr, "snapshot_write data too large\n");
+    return -1;
+  }
+
+  size_t table_size = value_count * sizeof(uint32_t);
+  size_t total = sizeof(struct snapshot_header) + table_size + blob_size;
+  struct stats_span span;
+  stats_begin(&span);
+  char *buffer = calloc(1, total);
+  if (buffer == NULL) {
+    stats_end(&span, STATS_CACHE, 0);
+    fprintf(stderr, "snapshot_write cannot allocate memory\n");
+    return -1;
+  }
+
+  struct snapshot_header *header = (struct snapshot_header *)buffer;
+  uint32_t *records = (uint32_t *)(buffer + sizeof(*header));
+  char *blob = buffer + sizeof(*header) + table_size;
+  size_t blob_len = 1;
+
+  memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+  header->version = SNAPSHOT_VERSION;
+  header->kind = desc->kind;
+  header->record_count = desc->record_count;
+  header->record_fields = desc->record_fields;
+  header->blob_size = (uint32_t)blob_size;
+  header->fetched = desc->fetched;
+  header->number = desc->number;
+
+  for (int i = 0; i < SNAPSHOT_META_MAX; i++)
+    header->meta[i] = blob_put(blob, &blob_len, desc->meta[i]);
+
+  if (desc->words != NULL) {
+    memcpy(records, desc->words, table_size);
+  } else {
+    for (size_t i = 0; i < value_count; i++)
+      records[i] = blob_put(blob, &blob_len, desc->values[i]);
+  }
+
+  int written = atomic_write_file(path, buffer, total);
+  free(buffer);
+  stats_end(&span, STATS_CACHE, written == 0 ? total : 0);
+  return written;
+}
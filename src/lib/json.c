@@ -1,4 +1,5 @@
 #include "lib/json.h"
+#include "utils/arena.h"
 
 #include <assert.h>
 #include <stdint.h>
@@ -285,12 +286,19 @@ static void to_surrogate_pair(uchar_t unicode, uint16_t *uc, uint16_t *lc) {
 #define is_space(c) ((c) == '\t' || (c) == '\n' || (c) == '\r' || (c) == ' ')
 #define is_digit(c) ((c) >= '0' && (c) <= '9')
 
-static bool parse_value(const char **sp, JsonNode **out);
-static bool parse_string(const char **sp, char **out);
+/* Where the decoder puts nodes and strings */
+typedef struct {
+  struct arena *arena; /* nodes and strings, NULL for the heap */
+  bool in_situ;        /* strings are unescaped inside the input instead of copied */
+} Decoder;
+
+static bool parse_value(const char **sp, JsonNode **out, const Decoder *dec);
+static bool parse_string(const char **sp, char **out, size_t *len, const Decoder *dec);
 static bool parse_number(const char **sp, double *out);
-static bool parse_array(const char **sp, JsonNode **out);
-static bool parse_object(const char **sp, JsonNode **out);
+static bool parse_array(const char **sp, JsonNode **out, const Decoder *dec);
+static bool parse_object(const char **sp, JsonNode **out, const Decoder *dec);
 static bool parse_hex16(const char **sp, uint16_t *out);
+static bool unescape_in_place(char *s, size_t *len);
 
 static bool expect_literal(const char **sp, const char *str);
 static void skip_space(const char **sp);
@@ -309,31 +317,52 @@ static void emit_object_indented(SB *out, const JsonNode *object, const char *sp
 static int write_hex16(char *out, uint16_t val);
 
 static JsonNode *mknode(JsonTag tag);
+static JsonNode *mknode_in(JsonTag tag, const Decoder *dec);
 static void append_node(JsonNode *parent, JsonNode *child);
 static void prepend_node(JsonNode *parent, JsonNode *child);
-static void append_member(JsonNode *object, char *key, JsonNode *value);
+static void append_member(JsonNode *object, char *key, size_t key_len, JsonNode *value);
 
 /* Assertion-friendly validity checks */
 static bool tag_is_valid(unsigned int tag);
 static bool number_is_valid(const char *num);
 
-JsonNode *json_decode(const char *json) {
+static JsonNode *decode(const char *json, const Decoder *dec) {
   const char *s = json;
   JsonNode *ret;
 
   skip_space(&s);
-  if (!parse_value(&s, &ret))
+  if (!parse_value(&s, &ret, dec))
     return NULL;
 
   skip_space(&s);
   if (*s != 0) {
-    json_delete(ret);
+    if (dec->arena == NULL)
+      json_delete(ret);
     return NULL;
   }
 
   return ret;
 }
 
+JsonNode *json_decode(const char *json) {
+  Decoder dec = {NULL, false};
+  return decode(json, &dec);
+}
+
+JsonNode *json_decode_arena(const char *json, struct arena *arena) {
+  if (arena == NULL)
+    return NULL;
+  Decoder dec = {arena, false};
+  return decode(json, &dec);
+}
+
+JsonNode *json_decode_in_situ(char *json, struct arena *arena) {
+  if (json == NULL || arena == NULL)
+    return NULL;
+  Decoder dec = {arena, true};
+  return decode(json, &dec);
+}
+
 char *json_encode(const JsonNode *node) { return json_stringify(node, NULL); }
 
 char *json_encode_string(const char *str) {
@@ -385,7 +414,8 @@ bool json_validate(const char *json) {
   const char *s = json;
 
   skip_space(&s);
-  if (!parse_value(&s, NULL))
+  Decoder dec = {NULL, false};
+  if (!parse_value(&s, NULL, &dec))
     return false;
 
   skip_space(&s);
@@ -411,13 +441,48 @@ JsonNode *json_find_element(JsonNode *array, int index) {
   return NULL;
 }
 
+/* Members compared by key before json_find_member switches to hashes */
+#define JSON_HASH_AFTER 4
+
+/* 32-bit FNV-1a */
+static uint32_t key_hash(const char *key) {
+  uint32_t hash = 2166136261u;
+  for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+    hash ^= *p;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
 JsonNode *json_find_member(JsonNode *object, const char *name) {
   JsonNode *member;
+  int scanned = 0;
+  uint32_t hash = 0;
 
   if (object == NULL || object->tag != JSON_OBJECT)
     return NULL;
 
-  json_foreach(member, object) if (strcmp(member->key, name) == 0) return member;
+  /*
+   * The first few members are compared directly, by length first, which is
+   * cheapest for the small objects that make up most payloads. Past that the
+   * name is hashed once and members with a different key_hash are skipped
+   * without touching their key.
+   */
+  size_t name_len = strlen(name);
+  json_foreach(member, object) {
+    if (scanned < JSON_HASH_AFTER) {
+      scanned++;
+      if (member->key_len == name_len && memcmp(member->key, name, name_len) == 0)
+        return member;
+      if (scanned == JSON_HASH_AFTER)
+        hash = key_hash(name);
+      continue;
+    }
+
+    if (member->key_hash == hash && member->key_len == name_len &&
+        memcmp(member->key, name, name_len) == 0)
+      return member;
+  }
 
   return NULL;
 }
@@ -436,6 +501,18 @@ static JsonNode *mknode(JsonTag tag) {
   return ret;
 }
 
+/* Allocate a node from @arena, or from the heap when it is NULL */
+static JsonNode *mknode_in(JsonTag tag, const Decoder *dec) {
+  if (dec->arena == NULL)
+    return mknode(tag);
+
+  JsonNode *ret = (JsonNode *)arena_calloc(dec->arena, sizeof(JsonNode));
+  if (ret == NULL)
+    out_of_memory();
+  ret->tag = tag;
+  return ret;
+}
+
 JsonNode *json_mknull(void) { return mknode(JSON_NULL); }
 
 JsonNode *json_mkbool(bool b) {
@@ -447,6 +524,7 @@ JsonNode *json_mkbool(bool b) {
 static JsonNode *mkstring(char *s) {
   JsonNode *ret = mknode(JSON_STRING);
   ret->string_ = s;
+  ret->string_len = strlen(s);
   return ret;
 }
 
@@ -486,8 +564,10 @@ static void prepend_node(JsonNode *parent, JsonNode *child) {
   parent->children.head = child;
 }
 
-static void append_member(JsonNode *object, char *key, JsonNode *value) {
+static void append_member(JsonNode *object, char *key, size_t key_len, JsonNode *value) {
   value->key = key;
+  value->key_len = (uint32_t)key_len;
+  value->key_hash = key_hash(key);
   append_node(object, value);
 }
 
@@ -509,7 +589,7 @@ void json_append_member(JsonNode *object, const char *key, JsonNode *value) {
   assert(object->tag == JSON_OBJECT);
   assert(value->parent == NULL);
 
-  append_member(object, json_strdup(key), value);
+  append_member(object, json_strdup(key), strlen(key), value);
 }
 
 void json_prepend_member(JsonNode *object, const char *key, JsonNode *value) {
@@ -517,6 +597,8 @@ void json_prepend_member(JsonNode *object, const char *key, JsonNode *value) {
   assert(value->parent == NULL);
 
   value->key = json_strdup(key);
+  value->key_len = (uint32_t)strlen(key);
+  value->key_hash = key_hash(value->key);
   prepend_node(object, value);
 }
 
@@ -538,17 +620,19 @@ void json_remove_from_parent(JsonNode *node) {
     node->parent = NULL;
     node->prev = node->next = NULL;
     node->key = NULL;
+    node->key_len = 0;
+    node->key_hash = 0;
   }
 }
 
-static bool parse_value(const char **sp, JsonNode **out) {
+static bool parse_value(const char **sp, JsonNode **out, const Decoder *dec) {
   const char *s = *sp;
 
   switch (*s) {
   case 'n':
     if (expect_literal(&s, "null")) {
       if (out)
-        *out = json_mknull();
+        *out = mknode_in(JSON_NULL, dec);
       *sp = s;
       return true;
     }
@@ -556,8 +640,10 @@ static bool parse_value(const char **sp, JsonNode **out) {
 
   case 'f':
     if (expect_literal(&s, "false")) {
-      if (out)
-        *out = json_mkbool(false);
+      if (out) {
+        *out = mknode_in(JSON_BOOL, dec);
+        (*out)->bool_ = false;
+      }
       *sp = s;
       return true;
     }
@@ -565,8 +651,10 @@ static bool parse_value(const char **sp, JsonNode **out) {
 
   case 't':
     if (expect_literal(&s, "true")) {
-      if (out)
-        *out = json_mkbool(true);
+      if (out) {
+        *out = mknode_in(JSON_BOOL, dec);
+        (*out)->bool_ = true;
+      }
       *sp = s;
       return true;
     }
@@ -574,9 +662,13 @@ static bool parse_value(const char **sp, JsonNode **out) {
 
   case '"': {
     char *str;
-    if (parse_string(&s, out ? &str : NULL)) {
-      if (out)
-        *out = mkstring(str);
+    size_t len;
+    if (parse_string(&s, out ? &str : NULL, &len, dec)) {
+      if (out) {
+        *out = mknode_in(JSON_STRING, dec);
+        (*out)->string_ = str;
+        (*out)->string_len = len;
+      }
       *sp = s;
       return true;
     }
@@ -584,14 +676,14 @@ static bool parse_value(const char **sp, JsonNode **out) {
   }
 
   case '[':
-    if (parse_array(&s, out)) {
+    if (parse_array(&s, out, dec)) {
       *sp = s;
       return true;
     }
     return false;
 
   case '{':
-    if (parse_object(&s, out)) {
+    if (parse_object(&s, out, dec)) {
       *sp = s;
       return true;
     }
@@ -600,8 +692,10 @@ static bool parse_value(const char **sp, JsonNode **out) {
   default: {
     double num;
     if (parse_number(&s, out ? &num : NULL)) {
-      if (out)
-        *out = json_mknumber(num);
+      if (out) {
+        *out = mknode_in(JSON_NUMBER, dec);
+        (*out)->number_ = num;
+      }
       *sp = s;
       return true;
     }
@@ -610,9 +704,9 @@ static bool parse_value(const char **sp, JsonNode **out) {
   }
 }
 
-static bool parse_array(const char **sp, JsonNode **out) {
+static bool parse_array(const char **sp, JsonNode **out, const Decoder *dec) {
   const char *s = *sp;
-  JsonNode *ret = out ? json_mkarray() : NULL;
+  JsonNode *ret = out ? mknode_in(JSON_ARRAY, dec) : NULL;
   JsonNode *element;
 
   if (*s++ != '[')
@@ -625,7 +719,7 @@ static bool parse_array(const char **sp, JsonNode **out) {
   }
 
   for (;;) {
-    if (!parse_value(&s, out ? &element : NULL))
+    if (!parse_value(&s, out ? &element : NULL, dec))
       goto failure;
     skip_space(&s);
 
@@ -649,14 +743,16 @@ success:
   return true;
 
 failure:
-  json_delete(ret);
+  if (dec->arena == NULL)
+    json_delete(ret);
   return false;
 }
 
-static bool parse_object(const char **sp, JsonNode **out) {
+static bool parse_object(const char **sp, JsonNode **out, const Decoder *dec) {
   const char *s = *sp;
-  JsonNode *ret = out ? json_mkobject() : NULL;
+  JsonNode *ret = out ? mknode_in(JSON_OBJECT, dec) : NULL;
   char *key;
+  size_t key_len;
   JsonNode *value;
 
   if (*s++ != '{')
@@ -669,7 +765,7 @@ static bool parse_object(const char **sp, JsonNode **out) {
   }
 
   for (;;) {
-    if (!parse_string(&s, out ? &key : NULL))
+    if (!parse_string(&s, out ? &key : NULL, &key_len, dec))
       goto failure;
     skip_space(&s);
 
@@ -677,12 +773,12 @@ static bool parse_object(const char **sp, JsonNode **out) {
       goto failure_free_key;
     skip_space(&s);
 
-    if (!parse_value(&s, out ? &value : NULL))
+    if (!parse_value(&s, out ? &value : NULL, dec))
       goto failure_free_key;
     skip_space(&s);
 
     if (out)
-      append_member(ret, key, value);
+      append_member(ret, key, key_len, value);
 
     if (*s == '}') {
       s++;
@@ -701,14 +797,57 @@ success:
   return true;
 
 failure_free_key:
-  if (out)
+  if (out && dec->arena == NULL)
     free(key);
 failure:
-  json_delete(ret);
+  if (dec->arena == NULL)
+    json_delete(ret);
   return false;
 }
 
-bool parse_string(const char **sp, char **out) {
+/*
+ * Arena variant of parse_string: find the end of the literal, copy it raw
+ * into the arena and unescape it there, so no temporary buffer is needed.
+ * In situ the literal is unescaped where it is instead, its closing quote
+ * becoming the terminator; unescaping never makes a string longer.
+ */
+static bool parse_string_arena(const char **sp, char **out, size_t *len, const Decoder *dec) {
+  const char *s = *sp;
+
+  if (*s++ != '"')
+    return false;
+
+  const char *start = s;
+  while (*s != '"') {
+    if (*s == 0)
+      return false;
+    if (*s == '\\' && s[1] != 0)
+      s++;
+    s++;
+  }
+
+  char *str;
+  if (dec->in_situ) {
+    str = (char *)start;
+    str[s - start] = 0;
+  } else {
+    str = arena_strndup(dec->arena, start, s - start);
+    if (str == NULL)
+      out_of_memory();
+  }
+
+  if (!unescape_in_place(str, len))
+    return false;
+
+  *out = str;
+  *sp = s + 1;
+  return true;
+}
+
+bool parse_string(const char **sp, char **out, size_t *len, const Decoder *dec) {
+  if (out && dec->arena)
+    return parse_string_arena(sp, out, len, dec);
+
   const char *s = *sp;
   SB sb;
   char throwaway_buffer[4];
@@ -810,8 +949,10 @@ bool parse_string(const char **sp, char **out) {
   }
   s++;
 
-  if (out)
+  if (out) {
+    *len = sb.cur - sb.start;
     *out = sb_finish(&sb);
+  }
   *sp = s;
   return true;
 
@@ -1222,6 +1363,12 @@ bool json_check(const JsonNode *node, char errmsg[256]) {
   if (node->key != NULL && !utf8_validate(node->key))
     problem("key contains invalid UTF-8");
 
+  if (node->key != NULL && node->key_hash != key_hash(node->key))
+    problem("key_hash does not match key");
+
+  if (node->key != NULL && node->key_len != strlen(node->key))
+    problem("key_len does not match key");
+
   if (!tag_is_valid(node->tag))
     problem("tag is invalid (%u)", node->tag);
 
@@ -1233,6 +1380,8 @@ bool json_check(const JsonNode *node, char errmsg[256]) {
       problem("string_ is NULL");
     if (!utf8_validate(node->string_))
       problem("string_ contains invalid UTF-8");
+    if (node->string_len != strlen(node->string_))
+      problem("string_len does not match string_");
   } else if (node->tag == JSON_ARRAY || node->tag == JSON_OBJECT) {
     JsonNode *head = node->children.head;
     JsonNode *tail = node->children.tail;
@@ -1298,3 +1447,413 @@ bool json_get_bool(JsonNode *obj, const char *key) {
 
   return false;
 }
+
+/*** Streaming (SAX) parser ***/
+
+enum {
+  SAX_VALUE,        /* expecting a value */
+  SAX_ARRAY_FIRST,  /* after '[': a value or ']' */
+  SAX_OBJECT_FIRST, /* after '{': a key or '}' */
+  SAX_KEY,          /* after ',' in an object */
+  SAX_COLON,        /* after a key */
+  SAX_AFTER_VALUE,  /* ',' or the end of the enclosing container */
+  SAX_STRING,       /* inside a string or key */
+  SAX_NUMBER,       /* inside a number */
+  SAX_LITERAL,      /* inside true, false or null */
+  SAX_DONE,         /* the root value is complete, only whitespace may follow */
+  SAX_ERROR,
+};
+
+void json_sax_init(JsonSax *sax, JsonEventCallback callback, void *user) {
+  memset(sax, 0, sizeof(*sax));
+  sax->callback = callback;
+  sax->user = user;
+  sax->state = SAX_VALUE;
+}
+
+void json_sax_free(JsonSax *sax) {
+  free(sax->scratch);
+  sax->scratch = NULL;
+  sax->scratch_len = sax->scratch_cap = 0;
+}
+
+static void sax_scratch_put(JsonSax *sax, const char *bytes, size_t count) {
+  if (sax->scratch_cap - sax->scratch_len < count + 1) {
+    size_t alloc = sax->scratch_cap ? sax->scratch_cap : 64;
+    while (alloc - sax->scratch_len < count + 1)
+      alloc *= 2;
+
+    sax->scratch = (char *)realloc(sax->scratch, alloc);
+    if (sax->scratch == NULL)
+      out_of_memory();
+    sax->scratch_cap = alloc;
+  }
+
+  memcpy(sax->scratch + sax->scratch_len, bytes, count);
+  sax->scratch_len += count;
+  sax->scratch[sax->scratch_len] = 0;
+}
+
+static bool sax_emit(JsonSax *sax, JsonEvent *event) {
+  if (sax->callback != NULL && !sax->callback(sax->user, event)) {
+    sax->state = SAX_ERROR;
+    return false;
+  }
+  return true;
+}
+
+static bool sax_emit_simple(JsonSax *sax, JsonEventType type, int depth) {
+  JsonEvent event = {.type = type, .depth = depth};
+  return sax_emit(sax, &event);
+}
+
+static void sax_value_done(JsonSax *sax) {
+  if (sax->state != SAX_ERROR)
+    sax->state = sax->depth == 0 ? SAX_DONE : SAX_AFTER_VALUE;
+}
+
+static bool sax_open(JsonSax *sax, char c) {
+  if (sax->depth >= JSON_SAX_MAX_DEPTH) {
+    sax->state = SAX_ERROR;
+    return false;
+  }
+
+  JsonEventType type = c == '{' ? JSON_EVENT_OBJECT_START : JSON_EVENT_ARRAY_START;
+  if (!sax_emit_simple(sax, type, sax->depth))
+    return false;
+
+  sax->stack[sax->depth++] = c;
+  sax->state = c == '{' ? SAX_OBJECT_FIRST : SAX_ARRAY_FIRST;
+  return true;
+}
+
+static bool sax_close(JsonSax *sax, char c) {
+  char open = c == '}' ? '{' : '[';
+  if (sax->depth == 0 || sax->stack[sax->depth - 1] != open) {
+    sax->state = SAX_ERROR;
+    return false;
+  }
+
+  sax->depth--;
+  JsonEventType type = c == '}' ? JSON_EVENT_OBJECT_END : JSON_EVENT_ARRAY_END;
+  if (!sax_emit_simple(sax, type, sax->depth))
+    return false;
+
+  sax_value_done(sax);
+  return true;
+}
+
+/*
+ * Check a string body without escapes: no control characters and valid
+ * UTF-8. @s must be followed by the closing quote, which stops
+ * utf8_validate_cz from reading past the end.
+ */
+static bool sax_plain_string_valid(const char *s, size_t len) {
+  size_t i = 0;
+  while (i < len) {
+    unsigned char c = s[i];
+    if (c <= 0x1F)
+      return false;
+    if (c < 0x80) {
+      i++;
+      continue;
+    }
+
+    int n = utf8_validate_cz(s + i);
+    if (n == 0 || i + n > len)
+      return false;
+    i += n;
+  }
+  return true;
+}
+
+/*
+ * Unescape a null-terminated raw string body in place. The decoded form is
+ * never longer than the escaped one.
+ */
+static bool unescape_in_place(char *s, size_t *len) {
+  const char *r = s;
+  char *w = s;
+
+  while (*r) {
+    unsigned char c = *r++;
+
+    if (c == '\\') {
+      c = *r++;
+      switch (c) {
+      case '"':
+      case '\\':
+      case '/':
+        *w++ = c;
+        break;
+      case 'b':
+        *w++ = '\b';
+        break;
+      case 'f':
+        *w++ = '\f';
+        break;
+      case 'n':
+        *w++ = '\n';
+        break;
+      case 'r':
+        *w++ = '\r';
+        break;
+      case 't':
+        *w++ = '\t';
+        break;
+      case 'u': {
+        uint16_t uc, lc;
+        uchar_t unicode;
+
+        if (!parse_hex16(&r, &uc))
+          return false;
+
+        if (uc >= 0xD800 && uc <= 0xDFFF) {
+          if (*r++ != '\\' || *r++ != 'u' || !parse_hex16(&r, &lc))
+            return false;
+          if (!from_surrogate_pair(uc, lc, &unicode))
+            return false;
+        } else if (uc == 0) {
+          return false;
+        } else {
+          unicode = uc;
+        }
+
+        w += utf8_write_char(unicode, w);
+        break;
+      }
+      default:
+        return false;
+      }
+    } else if (c <= 0x1F) {
+      return false;
+    } else {
+      int n;
+
+      r--;
+      n = utf8_validate_cz(r);
+      if (n == 0)
+        return false;
+
+      while (n--)
+        *w++ = *r++;
+    }
+  }
+
+  *w = 0;
+  *len = w - s;
+  return true;
+}
+
+static bool sax_string_done(JsonSax *sax, const char *str, size_t len) {
+  JsonEvent event = {
+      .type = sax->string_is_key ? JSON_EVENT_KEY : JSON_EVENT_STRING,
+      .depth = sax->depth,
+      .string = str,
+      .length = len,
+  };
+
+  if (!sax_emit(sax, &event))
+    return false;
+
+  if (sax->string_is_key)
+    sax->state = SAX_COLON;
+  else
+    sax_value_done(sax);
+  return true;
+}
+
+/*
+ * Consume string bytes from @s. Returns the number of bytes used, or -1 on
+ * error. A string that is complete in the current buffer and has no escapes
+ * is reported straight from the input without being copied.
+ */
+static long sax_string(JsonSax *sax, const char *s, size_t len) {
+  size_t i = 0;
+
+  if (sax->scratch_len == 0 && !sax->string_escape) {
+    while (i < len && s[i] != '"' && s[i] != '\\')
+      i++;
+
+    if (i < len && s[i] == '"') {
+      if (!sax_plain_string_valid(s, i) || !sax_string_done(sax, s, i))
+        return -1;
+      return (long)i + 1;
+    }
+    i = 0;
+  }
+
+  while (i < len) {
+    char c = s[i];
+    if (sax->string_escape) {
+      sax->string_escape = false;
+    } else if (c == '\\') {
+      sax->string_escape = true;
+    } else if (c == '"') {
+      sax_scratch_put(sax, s, i);
+      size_t decoded;
+      if (!unescape_in_place(sax->scratch, &decoded) || !sax_string_done(sax, sax->scratch, decoded))
+        return -1;
+      sax->scratch_len = 0;
+      return (long)i + 1;
+    }
+    i++;
+  }
+
+  sax_scratch_put(sax, s, len);
+  return (long)len;
+}
+
+static bool sax_number_done(JsonSax *sax) {
+  if (sax->scratch_len == 0 || !number_is_valid(sax->scratch)) {
+    sax->state = SAX_ERROR;
+    return false;
+  }
+
+  JsonEvent event = {
+      .type = JSON_EVENT_NUMBER, .depth = sax->depth, .number_ = strtod(sax->scratch, NULL)};
+  sax->scratch_len = 0;
+  if (!sax_emit(sax, &event))
+    return false;
+
+  sax_value_done(sax);
+  return true;
+}
+
+#define is_number_char(c)                                                                          \
+  (is_digit(c) || (c) == '-' || (c) == '+' || (c) == '.' || (c) == 'e' || (c) == 'E')
+
+bool json_sax_feed(JsonSax *sax, const char *data, size_t len) {
+  size_t i = 0;
+
+  while (i < len && sax->state != SAX_ERROR) {
+    char c = data[i];
+
+    switch (sax->state) {
+    case SAX_STRING: {
+      long used = sax_string(sax, data + i, len - i);
+      if (used < 0) {
+        sax->state = SAX_ERROR;
+        break;
+      }
+      i += (size_t)used;
+      continue;
+    }
+
+    case SAX_NUMBER: {
+      size_t start = i;
+      while (i < len && is_number_char(data[i]))
+        i++;
+      sax_scratch_put(sax, data + start, i - start);
+      if (i < len)
+        sax_number_done(sax);
+      continue;
+    }
+
+    case SAX_LITERAL:
+      if (c != sax->literal[sax->literal_pos++]) {
+        sax->state = SAX_ERROR;
+        break;
+      }
+      if (sax->literal[sax->literal_pos] == 0) {
+        JsonEvent event = {.depth = sax->depth};
+        if (sax->literal[0] == 'n') {
+          event.type = JSON_EVENT_NULL;
+        } else {
+          event.type = JSON_EVENT_BOOL;
+          event.bool_ = sax->literal[0] == 't';
+        }
+        if (sax_emit(sax, &event))
+          sax_value_done(sax);
+      }
+      break;
+
+    case SAX_VALUE:
+    case SAX_ARRAY_FIRST:
+      if (is_space(c))
+        break;
+      if (c == ']' && sax->state == SAX_ARRAY_FIRST) {
+        sax_close(sax, c);
+      } else if (c == '{' || c == '[') {
+        sax_open(sax, c);
+      } else if (c == '"') {
+        sax->string_is_key = false;
+        sax->state = SAX_STRING;
+      } else if (c == 't' || c == 'f' || c == 'n') {
+        sax->literal = c == 't' ? "true" : c == 'f' ? "false" : "null";
+        sax->literal_pos = 1;
+        sax->state = SAX_LITERAL;
+      } else if (c == '-' || is_digit(c)) {
+        sax->scratch_len = 0;
+        sax->state = SAX_NUMBER;
+        continue;
+      } else {
+        sax->state = SAX_ERROR;
+      }
+      break;
+
+    case SAX_OBJECT_FIRST:
+    case SAX_KEY:
+      if (is_space(c))
+        break;
+      if (c == '}' && sax->state == SAX_OBJECT_FIRST) {
+        sax_close(sax, c);
+      } else if (c == '"') {
+        sax->string_is_key = true;
+        sax->state = SAX_STRING;
+      } else {
+        sax->state = SAX_ERROR;
+      }
+      break;
+
+    case SAX_COLON:
+      if (is_space(c))
+        break;
+      sax->state = c == ':' ? SAX_VALUE : SAX_ERROR;
+      break;
+
+    case SAX_AFTER_VALUE:
+      if (is_space(c))
+        break;
+      if (c == ',') {
+        sax->state = sax->stack[sax->depth - 1] == '{' ? SAX_KEY : SAX_VALUE;
+      } else if (c == '}' || c == ']') {
+        sax_close(sax, c);
+      } else {
+        sax->state = SAX_ERROR;
+      }
+      break;
+
+    case SAX_DONE:
+      if (!is_space(c))
+        sax->state = SAX_ERROR;
+      break;
+    }
+
+    i++;
+  }
+
+  return sax->state != SAX_ERROR;
+}
+
+bool json_sax_finish(JsonSax *sax) {
+  /* A bare number at the root is only terminated by the end of input */
+  if (sax->state == SAX_NUMBER && sax->depth == 0)
+    sax_number_done(sax);
+
+  return sax->state == SAX_DONE;
+}
+
+bool json_sax_parse(const char *json, size_t len, JsonEventCallback callback, void *user) {
+  JsonSax sax;
+  json_sax_init(&sax, callback, user);
+
+  bool ok = json_sax_feed(&sax, json, len) && json_sax_finish(&sax);
+  json_sax_free(&sax);
+  return ok;
+}
+
+bool json_event_is(const JsonEvent *event, const char *name) {
+  size_t len = strlen(name);
+  return event->string != NULL && event->length == len && memcmp(event->string, name, len) == 0;
+}
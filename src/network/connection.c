@@ -6,49 +6,124 @@
  * hostname resolution, and HTTP response parsing functions.
  */
 
+#define _GNU_SOURCE /* strndup */
+
 #include "network/connection.h"
+#include "utils/fsutils.h"
+#include "utils/stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <strings.h>
+#include <time.h>
 #include <unistd.h>
 
-int fsocket() { return socket(AF_INET, SOCK_STREAM, 0); }
+/**
+ * @brief Resolver cache entry.
+ */
+struct dns_entry {
+  char hostname[256];          /**< Cached host, empty when the slot is free */
+  char port[8];                /**< Port the addresses were resolved for */
+  struct timespec expires;     /**< CLOCK_MONOTONIC expiry time */
+  struct resolved_host result; /**< Cached addresses */
+};
+
+static pthread_mutex_t dns_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dns_entry dns_cache[DNS_CACHE_SIZE];
+
+static long long monotonic_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-int fconnect(const int sockfd) {
-  if (sockfd < 0) {
-    perror("Creating socket is failure");
-    return -1;
+int fsocket(int family) { return socket(family, ADDR_TYPE | SOCK_NONBLOCK | SOCK_CLOEXEC, 0); }
+
+static bool dns_cache_lookup(const char *hostname, const char *port, struct resolved_host *dest) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  bool found = false;
+  pthread_mutex_lock(&dns_lock);
+  for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+    struct dns_entry *entry = &dns_cache[i];
+    if (strcmp(entry->hostname, hostname) != 0 || strcmp(entry->port, port) != 0)
+      continue;
+
+    if (now.tv_sec < entry->expires.tv_sec) {
+      *dest = entry->result;
+      dest->cached = true;
+      found = true;
+    } else {
+      entry->hostname[0] = '\0';
+    }
+    break;
   }
+  pthread_mutex_unlock(&dns_lock);
+
+  return found;
+}
 
-  struct sockaddr_in addr;
-  memset(&addr, 0, sizeof(addr));
+static void dns_cache_store(const char *hostname, const char *port,
+                            const struct resolved_host *result) {
+  if (strlen(hostname) >= sizeof(dns_cache[0].hostname) ||
+      strlen(port) >= sizeof(dns_cache[0].port))
+    return;
 
-  char ip[INET_ADDRSTRLEN];
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
 
-  int hostname_to_ip = htoip(HOST, PORTSTR, ip, sizeof(ip));
+  pthread_mutex_lock(&dns_lock);
 
-  if (hostname_to_ip < 0) {
-    printf("htoip error\n");
-    close(sockfd);
-    return -1;
+  /* Reuse the slot of the same host, else a free one, else the oldest */
+  struct dns_entry *slot = &dns_cache[0];
+  for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+    struct dns_entry *entry = &dns_cache[i];
+    if (strcmp(entry->hostname, hostname) == 0 || entry->hostname[0] == '\0') {
+      slot = entry;
+      break;
+    }
+    if (entry->expires.tv_sec < slot->expires.tv_sec)
+      slot = entry;
   }
 
-  addr.sin_family = AF_INET;
-  addr.sin_port = htons(PORT);
+  snprintf(slot->hostname, sizeof(slot->hostname), "%s", hostname);
+  snprintf(slot->port, sizeof(slot->port), "%s", port);
+  slot->expires = now;
+  slot->expires.tv_sec += DNS_CACHE_TTL;
+  slot->result = *result;
+  slot->result.cached = false;
 
-  if (inet_pton(AF_INET, ip, &addr.sin_addr.s_addr) < 1) {
-    perror("Failed to create server address");
-    close(sockfd);
-    return -1;
-  }
+  pthread_mutex_unlock(&dns_lock);
+}
 
-  return connect(sockfd, (const struct sockaddr *)&addr, sizeof(addr));
+void htoip_invalidate(const char *hostname) {
+  if (hostname == NULL)
+    return;
+
+  pthread_mutex_lock(&dns_lock);
+  for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+    if (strcmp(dns_cache[i].hostname, hostname) == 0)
+      dns_cache[i].hostname[0] = '\0';
+  }
+  pthread_mutex_unlock(&dns_lock);
 }
 
-int htoip(const char *hostname, const char *port, char *ipstr, size_t ipstr_len) {
+/**
+ * @brief Resolve a host that is not in the cache, and cache it.
+ */
+static int htoip_resolve(const char *hostname, const char *port, struct resolved_host *dest) {
+
   struct addrinfo hints, *res, *p;
   memset(&hints, 0, sizeof(hints));
 
-  hints.ai_family = AF_INET;
-  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_family = ADDR_FAMILY;
+  hints.ai_socktype = ADDR_TYPE;
+  hints.ai_flags = AI_ADDRCONFIG;
 
   int status = getaddrinfo(hostname, port, &hints, &res);
   if (status != 0) {
@@ -56,28 +131,197 @@ int htoip(const char *hostname, const char *port, char *ipstr, size_t ipstr_len)
     return -1;
   }
 
+  /* Split by family, keeping the resolver's preference order inside each */
+  struct addrinfo *v4[DNS_MAX_ADDRS], *v6[DNS_MAX_ADDRS];
+  int v4_count = 0, v6_count = 0;
+  int first_family = AF_UNSPEC;
+
   for (p = res; p != NULL; p = p->ai_next) {
-    struct sockaddr_in *ipv4 = (struct sockaddr_in *)p->ai_addr;
-    if (inet_ntop(AF_INET, &(ipv4->sin_addr), ipstr, ipstr_len) == NULL) {
-      perror("inet_ntop");
-      freeaddrinfo(res);
-      return -1;
+    if (p->ai_addrlen > sizeof(struct sockaddr_storage))
+      continue;
+
+    if (p->ai_family == AF_INET && v4_count < DNS_MAX_ADDRS) {
+      v4[v4_count++] = p;
+    } else if (p->ai_family == AF_INET6 && v6_count < DNS_MAX_ADDRS) {
+      v6[v6_count++] = p;
+    } else {
+      continue;
     }
 
-    break;
+    if (first_family == AF_UNSPEC)
+      first_family = p->ai_family;
   }
 
-  if (p == NULL) {
-    fprintf(stderr, "Failed to connect into any address\n");
-    freeaddrinfo(res);
-    return -1;
+  memset(dest, 0, sizeof(*dest));
+
+  /* Interleave families so a broken IPv6 (or IPv4) path costs one stagger at most */
+  struct addrinfo **primary = first_family == AF_INET6 ? v6 : v4;
+  struct addrinfo **secondary = first_family == AF_INET6 ? v4 : v6;
+  int primary_count = first_family == AF_INET6 ? v6_count : v4_count;
+  int secondary_count = first_family == AF_INET6 ? v4_count : v6_count;
+
+  for (int i = 0; dest->count < DNS_MAX_ADDRS && (i < primary_count || i < secondary_count);
+       i++) {
+    if (i < primary_count) {
+      memcpy(&dest->addrs[dest->count], primary[i]->ai_addr, primary[i]->ai_addrlen);
+      dest->lens[dest->count++] = primary[i]->ai_addrlen;
+    }
+    if (i < secondary_count && dest->count < DNS_MAX_ADDRS) {
+      memcpy(&dest->addrs[dest->count], secondary[i]->ai_addr, secondary[i]->ai_addrlen);
+      dest->lens[dest->count++] = secondary[i]->ai_addrlen;
+    }
   }
 
   freeaddrinfo(res);
 
+  if (dest->count == 0) {
+    fprintf(stderr, "Failed to connect into any address\n");
+    return -1;
+  }
+
+  dns_cache_store(hostname, port, dest);
   return 0;
 }
 
+int htoip(const char *hostname, const char *port, struct resolved_host *dest) {
+  if (hostname == NULL || port == NULL || dest == NULL) {
+    fprintf(stderr, "htoip invalid argument\n");
+    return -1;
+  }
+
+  struct stats_span span;
+  stats_begin(&span);
+  int resolved = dns_cache_lookup(hostname, port, dest) ? 0 : htoip_resolve(hostname, port, dest);
+  stats_end(&span, STATS_DNS, 0);
+  return resolved;
+}
+
+/**
+ * @brief Race connection attempts across the resolved addresses.
+ *
+ * @return Connected (still non-blocking) socket, or -1 when every attempt
+ *         failed or the deadline passed.
+ */
+static int connect_race(const struct resolved_host *addrs) {
+  struct pollfd pending[DNS_MAX_ADDRS];
+  int pending_count = 0;
+  int next = 0;
+  int winner = -1;
+
+  long long now = monotonic_ms();
+  long long deadline = now + CONNECT_TIMEOUT_MS;
+  long long next_start = now;
+
+  while (winner < 0) {
+    now = monotonic_ms();
+    if (now >= deadline)
+      break;
+
+    /* Start the next attempt when its stagger slot has come */
+    if (next < addrs->count && now >= next_start) {
+      const struct sockaddr *addr = (const struct sockaddr *)&addrs->addrs[next];
+      int fd = fsocket(addr->sa_family);
+      int rc = fd < 0 ? -1 : connect(fd, addr, addrs->lens[next]);
+      next++;
+
+      if (rc == 0) {
+        winner = fd;
+        break;
+      }
+
+      if (fd >= 0 && errno == EINPROGRESS) {
+        pending[pending_count].fd = fd;
+        pending[pending_count].events = POLLOUT;
+        pending[pending_count].revents = 0;
+        pending_count++;
+        next_start = now + CONNECT_STAGGER_MS;
+      } else {
+        if (fd >= 0)
+          close(fd);
+        next_start = now;
+      }
+      continue;
+    }
+
+    if (pending_count == 0 && next >= addrs->count)
+      break;
+
+    long long wake = deadline;
+    if (next < addrs->count && next_start < wake)
+      wake = next_start;
+
+    int rc = poll(pending, pending_count, (int)(wake - now));
+    if (rc < 0 && errno != EINTR)
+      break;
+    if (rc <= 0)
+      continue;
+
+    for (int i = 0; i < pending_count; i++) {
+      if (pending[i].revents == 0)
+        continue;
+
+      int err = 0;
+      socklen_t err_len = sizeof(err);
+      if (getsockopt(pending[i].fd, SOL_SOCKET, SO_ERROR, &err, &err_len) == 0 && err == 0) {
+        winner = pending[i].fd;
+        pending[i] = pending[--pending_count];
+        break;
+      }
+
+      /* This address failed: drop it and give the next one its turn right away */
+      close(pending[i].fd);
+      pending[i] = pending[--pending_count];
+      i--;
+      next_start = now;
+    }
+  }
+
+  for (int i = 0; i < pending_count; i++)
+    close(pending[i].fd);
+
+  return winner;
+}
+
+int fconnect(const char *hostname, const char *port) {
+  if (hostname == NULL || port == NULL) {
+    fprintf(stderr, "fconnect invalid argument\n");
+    return -1;
+  }
+
+  struct resolved_host addrs;
+  if (htoip(hostname, port, &addrs) < 0) {
+    printf("htoip error\n");
+    return -1;
+  }
+
+  struct stats_span span;
+  stats_begin(&span);
+  int sockfd = connect_race(&addrs);
+
+  /* Cached addresses may have moved, resolve again before giving up */
+  if (sockfd < 0 && addrs.cached) {
+    htoip_invalidate(hostname);
+    if (htoip(hostname, port, &addrs) == 0)
+      sockfd = connect_race(&addrs);
+  }
+  stats_end(&span, STATS_CONNECT, 0);
+
+  if (sockfd < 0) {
+    fprintf(stderr, "Cannot connect to %s:%s\n", hostname, port);
+    return -1;
+  }
+
+  /* TLS runs on blocking I/O */
+  int flags = fcntl(sockfd, F_GETFL);
+  if (flags < 0 || fcntl(sockfd, F_SETFL, flags & ~O_NONBLOCK) < 0) {
+    perror("fconnect fcntl");
+    close(sockfd);
+    return -1;
+  }
+
+  return sockfd;
+}
+
 SSL_CTX *ssl_init() {
   SSL_CTX *ctx;
 
@@ -91,6 +335,10 @@ SSL_CTX *ssl_init() {
 }
 
 SSL *ssl_connect(SSL_CTX *ctx, int fd, const char *hostname) {
+  return ssl_connect_session(ctx, fd, hostname, NULL);
+}
+
+SSL *ssl_connect_session(SSL_CTX *ctx, int fd, const char *hostname, SSL_SESSION *session) {
   if (ctx == NULL) {
     printf("ssl_connect SSL_CTX NULL\n");
     return NULL;
@@ -111,7 +359,16 @@ SSL *ssl_connect(SSL_CTX *ctx, int fd, const char *hostname) {
 
   SSL_set_fd(ssl, fd);
 
-  if (SSL_connect(ssl) <= 0) {
+  /* A rejected session is not fatal, the handshake simply falls back to a full one */
+  if (session != NULL && SSL_set_session(ssl, session) != 1)
+    ERR_clear_error();
+
+  struct stats_span span;
+  stats_begin(&span);
+  int connected = SSL_connect(ssl);
+  stats_end(&span, STATS_TLS, 0);
+
+  if (connected <= 0) {
     ERR_print_errors_fp(stderr);
     SSL_free(ssl);
     return NULL;
@@ -133,32 +390,6 @@ static void ssl_ctx_free(SSL_CTX *ctx) {
   }
 }
 
-char *http_response_extract_header(const char *raw_response) {
-  if (raw_response == NULL) {
-    printf("find_header() raw_response is NULL\n");
-    return NULL;
-  }
-
-  const char *body = strstr(raw_response, "\r\n\r\n");
-  if (!body) {
-    printf("No Content");
-    return NULL;
-  }
-
-  size_t header_len = body - raw_response;
-
-  // +1 is for null terminator
-  char *headers = malloc(header_len + 1);
-  if (headers == NULL) {
-    printf("find_header() Cannot allocate memory\n");
-    return NULL;
-  }
-
-  strncpy(headers, raw_response, header_len);
-  headers[header_len] = '\0';
-  return headers;
-}
-
 int http_response_status_code(const char *header) {
   if (header == NULL) {
     printf("http_response_status_code header NULL");
@@ -188,68 +419,126 @@ int http_response_status_code(const char *header) {
   return atoi(status);
 }
 
-char *http_response_extract_body(const char *raw_response) {
-  if (raw_response == NULL) {
-    printf("find_body() raw_response is NULL\n");
+char *http_response_header_value(const char *header, const char *name) {
+  if (header == NULL || name == NULL) {
     return NULL;
   }
 
-  const char *body = strstr(raw_response, "\r\n\r\n");
-  if (!body) {
-    printf("No Content\n");
-    return NULL;
-  }
+  size_t name_len = strlen(name);
 
-  // skip \r\n\r\n
-  body += 4;
+  /* Skip the status line, header fields start on the second line */
+  const char *line = strstr(header, "\r\n");
+  while (line != NULL) {
+    line += 2;
 
-  if (!strstr(raw_response, "Transfer-Encoding: chunked")) {
-    return strndup(body, strlen(body));
-  }
+    if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+      const char *value = line + name_len + 1;
+      while (*value == ' ' || *value == '\t')
+        value++;
 
-  const char *p = body;
-  char *output = malloc(strlen(body) + 1);
-  if (output == NULL) {
-    printf("http_response_extract_body cannot allocate memory for output");
-    return NULL;
+      const char *end = strstr(value, "\r\n");
+      if (end == NULL)
+        end = value + strlen(value);
+
+      while (end > value && (end[-1] == ' ' || end[-1] == '\t'))
+        end--;
+
+      return strndup(value, end - value);
+    }
+
+    line = strstr(line, "\r\n");
   }
 
-  char *out = output;
+  return NULL;
+}
 
-  while (*p) {
-    while (*p == '\r' || *p == '\n')
-      p++;
+void http_response_header_copy(const char *header, const char *name, char *dest, size_t len) {
+  if (dest == NULL || len == 0)
+    return;
+  dest[0] = '\0';
 
-    char *endptr;
-    long chunk_size = strtol(p, &endptr, RADIX);
-    if (chunk_size <= 0)
-      break;
+  char *value = http_response_header_value(header, name);
+  if (value == NULL)
+    return;
 
-    p = strchr(p, '\n');
-    if (p == NULL)
-      break;
-    p++;
+  /* Values that do not fit are dropped rather than truncated */
+  if (strlen(value) < len)
+    strcpy(dest, value);
+  free(value);
+}
+
+/* Collects a decoded body into one null-terminated buffer */
+struct body_buffer {
+  const struct http_parser *parser;
+  char *data;
+  size_t len;
+  size_t capacity;
+};
 
-    memcpy(out, p, chunk_size);
-    out += chunk_size;
-    p += chunk_size;
+static int body_collect(void *user, const char *data, size_t len) {
+  struct body_buffer *buf = user;
 
-    if (p[0] == '\r' && p[1] == '\n')
-      p += 2;
+  if (buf->capacity - buf->len < len + 1) {
+    size_t capacity = buf->capacity ? buf->capacity : CHUNK_SIZE;
+
+    /* With a Content-Length the whole body lands in a single allocation */
+    long long length = buf->parser->content_length;
+    if (length > 0 && (size_t)length + 1 > capacity)
+      capacity = (size_t)length + 1;
+
+    while (capacity - buf->len < len + 1)
+      capacity *= 2;
+
+    char *grown = realloc(buf->data, capacity);
+    if (grown == NULL) {
+      fprintf(stderr, "Cannot allocate memory for response body\n");
+      return -1;
+    }
+    buf->data = grown;
+    buf->capacity = capacity;
   }
-  *out = '\0';
-  return output;
+
+  memcpy(buf->data + buf->len, data, len);
+  buf->len += len;
+  buf->data[buf->len] = '\0';
+  return 0;
+}
+
+/* Hand the collected body over, an empty string when nothing was received */
+static char *body_take(struct body_buffer *buf) {
+  char *body = buf->data ? buf->data : strdup("");
+  memset(buf, 0, sizeof(*buf));
+  return body;
 }
 
 struct http_response http_response_extract(const char *raw_response) {
   struct http_response response;
   memset(&response, 0, sizeof(response));
-  char *header = http_response_extract_header(raw_response);
+  response.status = -1;
 
-  response.header = header;
-  response.body = http_response_extract_body(raw_response);
-  response.status = http_response_status_code(header);
+  if (raw_response == NULL) {
+    fprintf(stderr, "http_response_extract raw_response is NULL\n");
+    return response;
+  }
+
+  struct http_parser parser;
+  struct body_buffer body = {.parser = &parser};
+  http_parser_init(&parser, body_collect, &body);
+
+  int rc = http_parser_feed(&parser, raw_response, strlen(raw_response), NULL);
+  if (rc == 0)
+    rc = http_parser_finish(&parser);
+
+  if (rc == 1) {
+    response.header = http_parser_take_header(&parser);
+    response.body = body_take(&body);
+    response.status = parser.status;
+  } else {
+    fprintf(stderr, "http_response_extract malformed response\n");
+    free(body.data);
+  }
 
+  http_parser_free(&parser);
   return response;
 }
 
@@ -263,106 +552,582 @@ void http_response_free(struct http_response *response) {
   free(response->body);
 }
 
-int get(const char *host, const char *path, struct http_response *dest) {
-  SSL_CTX *ctx = ssl_init();
+static pthread_once_t shared_ctx_once = PTHREAD_ONCE_INIT;
+static SSL_CTX *shared_ctx = NULL;
+
+/* Connection used by get() and get_with_headers() */
+static struct http_conn default_conn = {.fd = -1};
+
+/* Most recent resumable session, persisted to the cache dir at cleanup */
+static pthread_mutex_t session_lock = PTHREAD_MUTEX_INITIALIZER;
+static SSL_SESSION *saved_session = NULL;
+static bool session_loaded = false;
+static bool session_dirty = false;
+static struct tls_stats tls_counters;
+
+static SSL_SESSION *session_load(void) {
+  char path[4096];
+  if (cache_path(TLS_SESSION_FILE, path, sizeof(path)) < 0)
+    return NULL;
+
+  size_t size = 0;
+  char *der = read_file(path, &size);
+  if (der == NULL)
+    return NULL;
+
+  const unsigned char *p = (const unsigned char *)der;
+  SSL_SESSION *session = d2i_SSL_SESSION(NULL, &p, (long)size);
+  free(der);
+
+  if (session == NULL) {
+    ERR_clear_error();
+    return NULL;
+  }
+
+  /*
+   * Expired tickets would only cost a wasted round of the handshake. The file
+   * only ever holds sessions for HOST (TLS 1.3 tickets carry no SNI name).
+   */
+  time_t expires = (time_t)SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session);
+  if (!SSL_SESSION_is_resumable(session) || expires <= time(NULL)) {
+    SSL_SESSION_free(session);
+    return NULL;
+  }
+
+  return session;
+}
+
+static void session_store(SSL_SESSION *session) {
+  char path[4096];
+  if (cache_path(TLS_SESSION_FILE, path, sizeof(path)) < 0)
+    return;
+
+  int len = i2d_SSL_SESSION(session, NULL);
+  if (len <= 0)
+    return;
+
+  unsigned char *der = malloc(len);
+  if (der == NULL)
+    return;
+
+  unsigned char *p = der;
+  i2d_SSL_SESSION(session, &p);
+  if (atomic_write_file(path, der, (size_t)len) < 0)
+    fprintf(stderr, "Cannot persist TLS session\n");
+  free(der);
+}
+
+/*
+ * Take a reference to the session to offer on the next handshake, NULL when
+ * there is none that can still be resumed
+ */
+static SSL_SESSION *session_acquire(void) {
+  pthread_mutex_lock(&session_lock);
+  if (!session_loaded) {
+    saved_session = session_load();
+    session_loaded = true;
+  }
+
+  SSL_SESSION *session = saved_session;
+  if (session != NULL && SSL_SESSION_is_resumable(session))
+    SSL_SESSION_up_ref(session);
+  else
+    session = NULL;
+  pthread_mutex_unlock(&session_lock);
+
+  return session;
+}
+
+/*
+ * Called by OpenSSL whenever the server issues a session. With TLS 1.3 the
+ * tickets arrive after the handshake, so this runs during SSL_read().
+ */
+static int session_new_cb(SSL *ssl, SSL_SESSION *session) {
+  /* Only sessions for the API host are kept, the file has a single slot */
+  const char *servername = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+  if (servername == NULL || strcmp(servername, HOST) != 0)
+    return 0;
+
+  /*
+   * Keep a copy: the session handed in stays the live connection's, and
+   * OpenSSL marks it not resumable when that connection ends on an EOF
+   * without close_notify, as keep-alive servers often close
+   */
+  SSL_SESSION *copy = SSL_SESSION_dup(session);
+  if (copy == NULL)
+    return 0;
+
+  pthread_mutex_lock(&session_lock);
+  if (saved_session != NULL)
+    SSL_SESSION_free(saved_session);
+  saved_session = copy;
+  session_loaded = true;
+  session_dirty = true;
+  pthread_mutex_unlock(&session_lock);
+
+  /* OpenSSL keeps its own reference to the original */
+  return 0;
+}
+
+static void shared_ctx_init(void) {
+  /*
+   * A keep-alive peer may close the socket at any time; writing to it must
+   * fail with EPIPE instead of killing the process.
+   */
+  signal(SIGPIPE, SIG_IGN);
+  shared_ctx = ssl_init();
+
+  if (shared_ctx != NULL) {
+    SSL_CTX_set_session_cache_mode(shared_ctx,
+                                   SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(shared_ctx, session_new_cb);
+  }
+}
+
+void tls_stats_get(struct tls_stats *dest) {
+  if (dest == NULL)
+    return;
+
+  pthread_mutex_lock(&session_lock);
+  *dest = tls_counters;
+  pthread_mutex_unlock(&session_lock);
+}
+
+SSL_CTX *ssl_shared_ctx(void) {
+  pthread_once(&shared_ctx_once, shared_ctx_init);
+  return shared_ctx;
+}
+
+void network_cleanup(void) {
+  http_conn_close(&default_conn);
+
+  pthread_mutex_lock(&session_lock);
+  if (saved_session != NULL) {
+    if (session_dirty && SSL_SESSION_is_resumable(saved_session))
+      session_store(saved_session);
+    SSL_SESSION_free(saved_session);
+    saved_session = NULL;
+  }
+  session_loaded = false;
+  session_dirty = false;
+  pthread_mutex_unlock(&session_lock);
+
+  ssl_ctx_free(shared_ctx);
+  shared_ctx = NULL;
+}
+
+int http_conn_open(struct http_conn *conn, const char *host) {
+  if (conn == NULL || host == NULL) {
+    fprintf(stderr, "http_conn_open invalid argument\n");
+    return -1;
+  }
+
+  SSL_CTX *ctx = ssl_shared_ctx();
   if (ctx == NULL) {
     fprintf(stderr, "SSL_CTX NULL\n");
     return -1;
   }
 
-  int sockfd = fsocket();
-  if (fconnect(sockfd) < 0) {
-    fprintf(stderr, "Failed to connect");
-    ssl_ctx_free(ctx);
-    close(sockfd);
+  int sockfd = fconnect(host, PORTSTR);
+  if (sockfd < 0) {
+    fprintf(stderr, "Failed to connect\n");
     return -1;
   }
 
-  SSL *ssl = ssl_connect(ctx, sockfd, HOST);
+  SSL_SESSION *session = strcmp(host, HOST) == 0 ? session_acquire() : NULL;
+  SSL *ssl = ssl_connect_session(ctx, sockfd, host, session);
+
+  pthread_mutex_lock(&session_lock);
+  if (ssl != NULL) {
+    tls_counters.handshakes++;
+    stats_count(STATS_TLS_HANDSHAKES);
+    if (session != NULL) {
+      bool resumed = SSL_session_reused(ssl);
+      if (resumed)
+        tls_counters.resumed++;
+      else
+        tls_counters.rejected++;
+      stats_count(resumed ? STATS_TLS_RESUMED : STATS_TLS_REJECTED);
+    } else if (strcmp(host, HOST) == 0) {
+      /* A full handshake of our own making, not the server's */
+      tls_counters.not_offered++;
+      stats_count(STATS_TLS_NOT_OFFERED);
+    }
+  }
+  pthread_mutex_unlock(&session_lock);
+
+  if (session != NULL)
+    SSL_SESSION_free(session);
+
   if (ssl == NULL) {
-    ssl_ctx_free(ctx);
     close(sockfd);
     return -1;
   }
 
-  int request_len = snprintf(NULL, 0,
-                             "GET %s HTTP/1.1\r\n"
-                             "Host: %s\r\n"
-                             "Connection: close\r\n\r\n",
-                             path, host);
+  conn->fd = sockfd;
+  conn->ssl = ssl;
+  conn->pid = getpid();
+  conn->requests = 0;
+  return 0;
+}
+
+void http_conn_close(struct http_conn *conn) {
+  if (conn == NULL || conn->fd < 0)
+    return;
+
+  if (conn->pid == getpid()) {
+    ssl_session_free(conn->ssl);
+  } else {
+    /* Inherited across fork: the parent still owns the TLS session, stay silent */
+    SSL_free(conn->ssl);
+  }
+
+  close(conn->fd);
+  conn->fd = -1;
+  conn->ssl = NULL;
+  conn->requests = 0;
+}
+
+/* SSL_read() and SSL_write(), timed as the transfer phase */
+static int tls_read(SSL *ssl, void *buf, int len) {
+  struct stats_span span;
+  stats_begin(&span);
+  int rv = SSL_read(ssl, buf, len);
+  stats_end(&span, STATS_TRANSFER, rv > 0 ? (size_t)rv : 0);
+  return rv;
+}
+
+static int tls_write(SSL *ssl, const void *buf, int len) {
+  struct stats_span span;
+  stats_begin(&span);
+  int rv = SSL_write(ssl, buf, len);
+  stats_end(&span, STATS_TRANSFER, rv > 0 ? (size_t)rv : 0);
+  return rv;
+}
+
+/**
+ * @brief Received bytes not fed to a parser yet, the start of a pipelined response.
+ */
+struct recv_buffer {
+  char data[RECV_BUFFER_SIZE];
+  size_t start; /**< First unparsed byte */
+  size_t len;   /**< Unparsed bytes from start */
+};
+
+/**
+ * @brief Read exactly one HTTP response from the connection into a parser.
+ *
+ * Records are decrypted into a buffer and fed to the parser as they arrive;
+ * the parser delivers body bytes straight to its consumer. With @p pending
+ * the bytes after the response are kept there for the next one, otherwise
+ * they cannot belong to a request we sent and the connection is not reused.
+ *
+ * @return 0 on success, 1 when the connection failed before any byte
+ *         arrived (stale keep-alive connection), -1 on failure.
+ */
+static int http_conn_read_response(struct http_conn *conn, struct http_parser *parser,
+                                   struct recv_buffer *pending) {
+  struct recv_buffer local;
+  struct recv_buffer *buf = pending;
+  if (buf == NULL) {
+    buf = &local;
+    buf->len = 0;
+  }
+
+  bool received = buf->len > 0;
+  for (;;) {
+    if (buf->len == 0) {
+      int rv = tls_read(conn->ssl, buf->data, sizeof(buf->data));
+      if (rv <= 0) {
+        if (!received)
+          return 1;
+
+        int err = SSL_get_error(conn->ssl, rv);
+        bool closed = rv == 0 && (err == SSL_ERROR_ZERO_RETURN || err == SSL_ERROR_SYSCALL);
+        if (closed && http_parser_finish(parser) == 1) {
+          parser->keep_alive = false;
+          return 0;
+        }
+
+        fprintf(stderr, "Incomplete HTTP response\n");
+        return -1;
+      }
+      buf->start = 0;
+      buf->len = (size_t)rv;
+    }
+    received = true;
+
+    size_t consumed = 0;
+    int rc = http_parser_feed(parser, buf->data + buf->start, buf->len, &consumed);
+    if (rc < 0) {
+      fprintf(stderr, "Malformed HTTP response\n");
+      return -1;
+    }
+    buf->start += consumed;
+    buf->len -= consumed;
+
+    if (rc == 1) {
+      if (pending == NULL && (buf->len > 0 || SSL_pending(conn->ssl) > 0))
+        parser->keep_alive = false;
+      return 0;
+    }
+  }
+}
+
+/**
+ * @brief Format a GET request into dest, as snprintf() does.
+ *
+ * Every request offers the content codings the parser can decode.
+ */
+static int request_format(char *dest, size_t len, const char *host, const char *path,
+                          const char *headers) {
+  const char *accept = HTTP_ACCEPT_ENCODING;
+  return snprintf(dest, len,
+                  "GET %s HTTP/1.1\r\n"
+                  "Host: %s\r\n"
+                  "Connection: keep-alive\r\n"
+                  "%s%s%s"
+                  "%s\r\n",
+                  path, host, accept ? "Accept-Encoding: " : "", accept ? accept : "",
+                  accept ? "\r\n" : "", headers ? headers : "");
+}
+
+/**
+ * @brief Send a request and parse its response with a prepared parser.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int http_conn_exchange(struct http_conn *conn, const char *host, const char *path,
+                              const char *headers, struct http_parser *parser) {
+  /* A connection inherited through fork() belongs to the parent process */
+  if (conn->fd >= 0 && conn->pid != getpid())
+    http_conn_close(conn);
 
+  int request_len = request_format(NULL, 0, host, path, headers);
   char *request = malloc(request_len + 1);
   if (request == NULL) {
     fprintf(stderr, "Cannot allocate memory\n");
-    ssl_session_free(ssl);
-    ssl_ctx_free(ctx);
-    close(sockfd);
     return -1;
   }
+  request_format(request, request_len + 1, host, path, headers);
+
+  /*
+   * A reused connection may have been closed by the server while idle: retry
+   * once. Nothing reached the parser in that case, so it is still pristine.
+   */
+  for (int attempt = 0; attempt < 2; attempt++) {
+    bool reused = conn->fd >= 0;
+    if (!reused && http_conn_open(conn, host) < 0)
+      break;
 
-  snprintf(request, request_len + 1,
-           "GET %s HTTP/1.1\r\n"
-           "Host: %s\r\n"
-           "Connection: close\r\n\r\n",
-           path, host);
+    if (tls_write(conn->ssl, request, request_len) != request_len) {
+      http_conn_close(conn);
+      if (reused)
+        continue;
+      fprintf(stderr, "GET request to %s%s fail\n", host, path);
+      break;
+    }
+
+    int read = http_conn_read_response(conn, parser, NULL);
+    if (read == 1 && reused) {
+      http_conn_close(conn);
+      continue;
+    }
+
+    if (read != 0 || !parser->keep_alive) {
+      http_conn_close(conn);
+    } else {
+      conn->requests++;
+    }
+
+    free(request);
+    return read == 0 ? 0 : -1;
+  }
 
-  int send_request = SSL_write(ssl, request, request_len);
   free(request);
+  return -1;
+}
 
-  if (send_request != request_len) {
-    fprintf(stderr, "GET request to %s%s fail", host, path);
-    ssl_session_free(ssl);
-    ssl_ctx_free(ctx);
-    close(sockfd);
+int http_conn_request_stream(struct http_conn *conn, const char *host, const char *path,
+                             const char *headers, http_body_cb on_body, void *user,
+                             struct http_response *dest) {
+  if (conn == NULL || host == NULL || path == NULL || dest == NULL) {
+    fprintf(stderr, "http_conn_request_stream invalid argument\n");
     return -1;
   }
 
-  char *response = NULL;
-  size_t total = 0, capacity = 0;
-
-  char buffer[CHUNK_SIZE];
-  int rv;
+  struct http_parser parser;
+  http_parser_init(&parser, on_body, user);
 
-  while ((rv = SSL_read(ssl, buffer, sizeof(buffer))) > 0) {
-    size_t tmp_capacity = (capacity == 0) ? CHUNK_SIZE : capacity * 2;
+  int rc = http_conn_exchange(conn, host, path, headers, &parser);
+  if (rc == 0) {
+    dest->header = http_parser_take_header(&parser);
+    dest->body = NULL;
+    dest->status = parser.status;
+  }
 
-    if (total + rv >= tmp_capacity) {
-      tmp_capacity = total + rv + 1;
-    }
+  http_parser_free(&parser);
+  return rc;
+}
 
-    char *tmp_response = realloc(response, tmp_capacity);
-    if (tmp_response == NULL) {
-      fprintf(stderr, "Cannot realloc response\n");
-      ssl_session_free(ssl);
-      ssl_ctx_free(ctx);
-      close(sockfd);
-      free(response);
-      return -1;
-    }
+int http_conn_request(struct http_conn *conn, const char *host, const char *path,
+                      const char *headers, struct http_response *dest) {
+  if (conn == NULL || host == NULL || path == NULL || dest == NULL) {
+    fprintf(stderr, "http_conn_request invalid argument\n");
+    return -1;
+  }
 
-    response = tmp_response;
-    memcpy(response + total, buffer, rv);
-    total += rv;
-    capacity = tmp_capacity;
+  struct http_parser parser;
+  struct body_buffer body = {.parser = &parser};
+  http_parser_init(&parser, body_collect, &body);
+
+  int rc = http_conn_exchange(conn, host, path, headers, &parser);
+  if (rc == 0) {
+    dest->header = http_parser_take_header(&parser);
+    dest->body = body_take(&body);
+    dest->status = parser.status;
+  } else {
+    free(body.data);
   }
 
-  if (response != NULL) {
-    response[total] = '\0';
+  http_parser_free(&parser);
+  return rc;
+}
+
+/**
+ * @brief Write every request of a pipeline from @p first on, in one go.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int pipeline_send(struct http_conn *conn, const char *host,
+                         const struct http_pipeline_request *requests, int first, int count) {
+  size_t len = 0;
+  for (int i = first; i < count; i++)
+    len += (size_t)request_format(NULL, 0, host, requests[i].path, requests[i].headers);
+
+  char *batch = malloc(len + 1);
+  if (batch == NULL) {
+    fprintf(stderr, "Cannot allocate memory\n");
+    return -1;
   }
 
-  ssl_session_free(ssl);
-  ssl_ctx_free(ctx);
-  close(sockfd);
+  size_t offset = 0;
+  for (int i = first; i < count; i++)
+    offset += (size_t)request_format(batch + offset, len + 1 - offset, host, requests[i].path,
+                                     requests[i].headers);
 
-  struct http_response response_extract = http_response_extract(response);
-  if (response_extract.header == NULL && response_extract.body == NULL) {
-    fprintf(stderr, "Cannot extract json response or response invalid\n");
-    free(response);
+  int written = tls_write(conn->ssl, batch, (int)len);
+  free(batch);
+  return written == (int)len ? 0 : -1;
+}
+
+int http_conn_pipeline(struct http_conn *conn, const char *host,
+                       struct http_pipeline_request *requests, int count) {
+  if (conn == NULL || host == NULL || (requests == NULL && count > 0) || count < 0 ||
+      count > HTTP_PIPELINE_MAX) {
+    fprintf(stderr, "http_conn_pipeline invalid argument\n");
     return -1;
   }
 
-  *dest = response_extract;
+  for (int i = 0; i < count; i++) {
+    memset(&requests[i].response, 0, sizeof(requests[i].response));
+    requests[i].result = -1;
+    requests[i].latency_ms = 0.0;
+  }
+
+  /* A connection inherited through fork() belongs to the parent process */
+  if (conn->fd >= 0 && conn->pid != getpid())
+    http_conn_close(conn);
 
-  free(response);
-  return 0;
+  struct recv_buffer *pending = malloc(sizeof(struct recv_buffer));
+  if (pending == NULL) {
+    fprintf(stderr, "Cannot allocate memory\n");
+    return count;
+  }
+
+  /*
+   * Each round sends every request still without a response and reads the
+   * responses in order. The server may close the connection after any of
+   * them; the requests it never answered (nothing of their response arrived,
+   * so nothing reached their consumers) go out again on a new connection.
+   * A round that answers nothing is only retried once, for a reused
+   * connection that went stale while idle.
+   */
+  int next = 0;
+  bool retried = false;
+  while (next < count) {
+    bool reused = conn->fd >= 0;
+    if (!reused && http_conn_open(conn, host) < 0)
+      break;
+
+    struct timespec sent;
+    clock_gettime(CLOCK_MONOTONIC, &sent);
+    if (pipeline_send(conn, host, requests, next, count) < 0) {
+      http_conn_close(conn);
+      if (reused && !retried) {
+        retried = true;
+        continue;
+      }
+      fprintf(stderr, "GET request pipeline to %s fail\n", host);
+      break;
+    }
+
+    int first = next;
+    int read = 0;
+    pending->len = 0;
+    while (next < count) {
+      struct http_pipeline_request *request = &requests[next];
+      struct http_parser parser;
+      http_parser_init(&parser, request->on_body, request->user);
+
+      read = http_conn_read_response(conn, &parser, pending);
+      bool keep_alive = read == 0 && parser.keep_alive;
+      if (read == 0) {
+        struct timespec done;
+        clock_gettime(CLOCK_MONOTONIC, &done);
+        request->response.header = http_parser_take_header(&parser);
+        request->response.status = parser.status;
+        request->result = 0;
+        request->latency_ms = (double)(done.tv_sec - sent.tv_sec) * 1e3 +
+                              (double)(done.tv_nsec - sent.tv_nsec) / 1e6;
+        conn->requests++;
+      }
+      http_parser_free(&parser);
+
+      /* A response cut short already fed its consumer, it is not sent again */
+      if (read != 1)
+        next++;
+      if (!keep_alive) {
+        http_conn_close(conn);
+        break;
+      }
+    }
+
+    if (read == 1 && next == first) {
+      if (!reused || retried)
+        break;
+      retried = true;
+    }
+  }
+
+  free(pending);
+
+  int failed = 0;
+  for (int i = 0; i < count; i++)
+    failed += requests[i].result < 0;
+  return failed;
+}
+
+int get(const char *host, const char *path, struct http_response *dest) {
+  return get_with_headers(host, path, NULL, dest);
+}
+
+int get_with_headers(const char *host, const char *path, const char *headers,
+                     struct http_response *dest) {
+  return http_conn_request(&default_conn, host, path, headers, dest);
+}
+
+int get_stream(const char *host, const char *path, const char *headers, http_body_cb on_body,
+               void *user, struct http_response *dest) {
+  return http_conn_request_stream(&default_conn, host, path, headers, on_body, user, dest);
 }
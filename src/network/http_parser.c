@@ -0,0 +1,536 @@
+/**
+ * @file http_parser.c
+ * @brief Implementation of the incremental HTTP/1.1 response parser.
+ */
+
+#define _GNU_SOURCE /* memmem */
+
+#include "network/http_parser.h"
+#include "utils/stats.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#ifdef MUSLIMKIT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef MUSLIMKIT_HAVE_BROTLI
+#include <brotli/decode.h>
+#endif
+
+/**
+ * @brief Decompression state of one body.
+ */
+struct http_decoder {
+  bool started; /**< Some of the compressed stream arrived */
+  bool done;    /**< The compressed stream ended */
+#ifdef MUSLIMKIT_HAVE_ZLIB
+  z_stream zlib;
+#endif
+#ifdef MUSLIMKIT_HAVE_BROTLI
+  BrotliDecoderState *brotli;
+#endif
+};
+
+void http_parser_init(struct http_parser *parser, http_body_cb on_body, void *user) {
+  memset(parser, 0, sizeof(*parser));
+  parser->state = HTTP_PARSE_HEADERS;
+  parser->content_length = -1;
+  parser->on_body = on_body;
+  parser->user = user;
+}
+
+static void decoder_free(struct http_parser *parser) {
+  struct http_decoder *decoder = parser->decoder;
+  if (decoder == NULL)
+    return;
+
+#ifdef MUSLIMKIT_HAVE_ZLIB
+  if (parser->coding == HTTP_CODING_GZIP || parser->coding == HTTP_CODING_DEFLATE)
+    inflateEnd(&decoder->zlib);
+#endif
+#ifdef MUSLIMKIT_HAVE_BROTLI
+  if (parser->coding == HTTP_CODING_BROTLI)
+    BrotliDecoderDestroyInstance(decoder->brotli);
+#endif
+  free(decoder);
+  parser->decoder = NULL;
+}
+
+void http_parser_free(struct http_parser *parser) {
+  if (parser == NULL)
+    return;
+
+  decoder_free(parser);
+  free(parser->header);
+  parser->header = NULL;
+  parser->header_len = parser->header_cap = 0;
+}
+
+char *http_parser_take_header(struct http_parser *parser) {
+  char *header = parser->header;
+  parser->header = NULL;
+  parser->header_len = parser->header_cap = 0;
+  return header;
+}
+
+static int deliver_body(struct http_parser *parser, const char *data, size_t len) {
+  if (len == 0 || parser->on_body == NULL)
+    return 0;
+  return parser->on_body(parser->user, data, len);
+}
+
+/**
+ * @brief Set up the decompressor for the body's coding.
+ *
+ * @return 0 on success, -1 when the coding is not supported by this build.
+ */
+static int decoder_init(struct http_parser *parser) {
+  if (parser->coding == HTTP_CODING_IDENTITY)
+    return 0;
+
+  struct http_decoder *decoder = calloc(1, sizeof(struct http_decoder));
+  if (decoder == NULL) {
+    fprintf(stderr, "http_parser cannot allocate decoder\n");
+    return -1;
+  }
+
+  int ready = -1;
+  switch (parser->coding) {
+  case HTTP_CODING_GZIP:
+  case HTTP_CODING_DEFLATE:
+#ifdef MUSLIMKIT_HAVE_ZLIB
+    /* 32 asks zlib to detect the gzip or zlib wrapper itself */
+    ready = inflateInit2(&decoder->zlib, 15 + 32) == Z_OK ? 0 : -1;
+#endif
+    break;
+  case HTTP_CODING_BROTLI:
+#ifdef MUSLIMKIT_HAVE_BROTLI
+    decoder->brotli = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+    ready = decoder->brotli ? 0 : -1;
+#endif
+    break;
+  case HTTP_CODING_IDENTITY:
+    break;
+  }
+
+  if (ready < 0) {
+    fprintf(stderr, "http_parser cannot decode the response's Content-Encoding\n");
+    free(decoder);
+    return -1;
+  }
+  parser->decoder = decoder;
+  return 0;
+}
+
+#ifdef MUSLIMKIT_HAVE_ZLIB
+static int decode_zlib(struct http_parser *parser, const char *data, size_t len) {
+  z_stream *zlib = &parser->decoder->zlib;
+  char out[HTTP_DECODE_BUFFER];
+
+  zlib->next_in = (Bytef *)data;
+  zlib->avail_in = (uInt)len;
+  do {
+    zlib->next_out = (Bytef *)out;
+    zlib->avail_out = sizeof(out);
+    int rc = inflate(zlib, Z_NO_FLUSH);
+    if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR)
+      return -1;
+
+    size_t produced = sizeof(out) - zlib->avail_out;
+    if (deliver_body(parser, out, produced) != 0)
+      return -1;
+    if (rc == Z_STREAM_END) {
+      parser->decoder->done = true;
+      return 0;
+    }
+    if (rc == Z_BUF_ERROR && produced == 0)
+      return -1;
+  } while (zlib->avail_in > 0 || zlib->avail_out == 0);
+
+  return 0;
+}
+#endif
+
+#ifdef MUSLIMKIT_HAVE_BROTLI
+static int decode_brotli(struct http_parser *parser, const char *data, size_t len) {
+  BrotliDecoderState *brotli = parser->decoder->brotli;
+  char out[HTTP_DECODE_BUFFER];
+
+  const uint8_t *next_in = (const uint8_t *)data;
+  size_t avail_in = len;
+  BrotliDecoderResult rc;
+  do {
+    uint8_t *next_out = (uint8_t *)out;
+    size_t avail_out = sizeof(out);
+    rc = BrotliDecoderDecompressStream(brotli, &avail_in, &next_in, &avail_out, &next_out, NULL);
+    if (rc == BROTLI_DECODER_RESULT_ERROR)
+      return -1;
+
+    if (deliver_body(parser, out, sizeof(out) - avail_out) != 0)
+      return -1;
+  } while (rc == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT);
+
+  if (rc == BROTLI_DECODER_RESULT_SUCCESS)
+    parser->decoder->done = true;
+  return 0;
+}
+#endif
+
+/**
+ * @brief Hand body bytes to the consumer, decompressing them first if needed.
+ *
+ * Bytes after the end of a compressed stream are ignored.
+ */
+static int emit_body(struct http_parser *parser, const char *data, size_t len) {
+  if (parser->decoder == NULL)
+    return deliver_body(parser, data, len);
+  if (len == 0 || parser->decoder->done)
+    return 0;
+  parser->decoder->started = true;
+
+  struct stats_span span;
+  stats_begin(&span);
+  int decoded = -1;
+  switch (parser->coding) {
+#ifdef MUSLIMKIT_HAVE_ZLIB
+  case HTTP_CODING_GZIP:
+  case HTTP_CODING_DEFLATE:
+    decoded = decode_zlib(parser, data, len);
+    break;
+#endif
+#ifdef MUSLIMKIT_HAVE_BROTLI
+  case HTTP_CODING_BROTLI:
+    decoded = decode_brotli(parser, data, len);
+    break;
+#endif
+  default:
+    break;
+  }
+  stats_end(&span, STATS_DECODE, len);
+  return decoded;
+}
+
+/* A compressed body that stopped short of the end of its stream is truncated */
+static bool body_complete(const struct http_parser *parser) {
+  return parser->decoder == NULL || parser->decoder->done || !parser->decoder->started;
+}
+
+/* Case-insensitive check for a comma separated token in a header value */
+static bool value_has_token(const char *value, size_t len, const char *token) {
+  size_t token_len = strlen(token);
+
+  while (len > 0) {
+    while (len > 0 && (*value == ' ' || *value == '\t' || *value == ',')) {
+      value++;
+      len--;
+    }
+
+    size_t item = 0;
+    while (item < len && value[item] != ',')
+      item++;
+
+    size_t trimmed = item;
+    while (trimmed > 0 && (value[trimmed - 1] == ' ' || value[trimmed - 1] == '\t'))
+      trimmed--;
+
+    if (trimmed == token_len && strncasecmp(value, token, token_len) == 0)
+      return true;
+
+    value += item;
+    len -= item;
+  }
+
+  return false;
+}
+
+/**
+ * @brief Interpret the complete header block and pick the body framing.
+ */
+static int parse_header_block(struct http_parser *parser) {
+  const char *line = parser->header;
+  const char *end = parser->header + parser->header_len;
+
+  /* Status line: HTTP/<major>.<minor> <code> <reason> */
+  if (strncmp(line, "HTTP/1.", 7) != 0 || parser->header_len < 12)
+    return -1;
+
+  bool http11 = line[7] == '1';
+  const char *code = line + 9;
+  if (code[0] < '1' || code[0] > '5' || code[1] < '0' || code[1] > '9' || code[2] < '0' ||
+      code[2] > '9')
+    return -1;
+  parser->status = (code[0] - '0') * 100 + (code[1] - '0') * 10 + (code[2] - '0');
+
+  bool connection_close = false, connection_keep_alive = false;
+
+  const char *eol = memmem(line, end - line, "\r\n", 2);
+  while (eol != NULL) {
+    line = eol + 2;
+    eol = memmem(line, end - line, "\r\n", 2);
+    const char *line_end = eol ? eol : end;
+
+    const char *colon = memchr(line, ':', line_end - line);
+    if (colon == NULL)
+      continue;
+
+    size_t name_len = colon - line;
+    const char *value = colon + 1;
+    while (value < line_end && (*value == ' ' || *value == '\t'))
+      value++;
+    size_t value_len = line_end - value;
+
+    if (name_len == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+      char digits[32];
+      if (value_len == 0 || value_len >= sizeof(digits))
+        return -1;
+      memcpy(digits, value, value_len);
+      digits[value_len] = '\0';
+
+      char *endptr;
+      errno = 0;
+      long long length = strtoll(digits, &endptr, 10);
+      while (*endptr == ' ' || *endptr == '\t')
+        endptr++;
+      if (errno != 0 || length < 0 || *endptr != '\0')
+        return -1;
+      parser->content_length = length;
+    } else if (name_len == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0) {
+      parser->chunked = value_has_token(value, value_len, "chunked");
+    } else if (name_len == 16 && strncasecmp(line, "Content-Encoding", 16) == 0) {
+      while (value_len > 0 && (value[value_len - 1] == ' ' || value[value_len - 1] == '\t'))
+        value_len--;
+
+      /* Only a single coding is decoded; stacked ones are never sent to us */
+      if (value_len == 0 || value_has_token(value, value_len, "identity"))
+        parser->coding = HTTP_CODING_IDENTITY;
+      else if (value_has_token(value, value_len, "gzip") ||
+               value_has_token(value, value_len, "x-gzip"))
+        parser->coding = HTTP_CODING_GZIP;
+      else if (value_has_token(value, value_len, "deflate"))
+        parser->coding = HTTP_CODING_DEFLATE;
+      else if (value_has_token(value, value_len, "br"))
+        parser->coding = HTTP_CODING_BROTLI;
+      else
+        return -1;
+      if (memchr(value, ',', value_len) != NULL)
+        return -1;
+    } else if (name_len == 10 && strncasecmp(line, "Connection", 10) == 0) {
+      connection_close = value_has_token(value, value_len, "close");
+      connection_keep_alive = value_has_token(value, value_len, "keep-alive");
+    }
+  }
+
+  parser->keep_alive = http11 ? !connection_close : connection_keep_alive;
+  parser->headers_done = true;
+
+  bool no_body = (parser->status >= 100 && parser->status < 200) || parser->status == 204 ||
+                 parser->status == 304;
+
+  if (no_body) {
+    parser->state = HTTP_PARSE_DONE;
+    return 0;
+  }
+
+  if (decoder_init(parser) < 0)
+    return -1;
+
+  if (parser->chunked) {
+    parser->state = HTTP_PARSE_CHUNK_SIZE;
+  } else if (parser->content_length >= 0) {
+    parser->remaining = (unsigned long long)parser->content_length;
+    parser->state = parser->remaining == 0 ? HTTP_PARSE_DONE : HTTP_PARSE_IDENTITY;
+  } else {
+    parser->state = HTTP_PARSE_UNTIL_EOF;
+    parser->keep_alive = false;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Append header bytes and detect the end of the header block.
+ *
+ * @return Bytes of @p data that belonged to the header, or -1 on error.
+ */
+static long feed_headers(struct http_parser *parser, const char *data, size_t len) {
+  size_t take = len;
+  if (parser->header_len + take > HTTP_MAX_HEADER)
+    take = HTTP_MAX_HEADER - parser->header_len;
+
+  if (parser->header_len + take + 1 > parser->header_cap) {
+    size_t cap = parser->header_cap ? parser->header_cap : 1024;
+    while (cap < parser->header_len + take + 1)
+      cap *= 2;
+
+    char *header = realloc(parser->header, cap);
+    if (header == NULL) {
+      fprintf(stderr, "http_parser cannot allocate header\n");
+      return -1;
+    }
+    parser->header = header;
+    parser->header_cap = cap;
+  }
+
+  size_t old_len = parser->header_len;
+  memcpy(parser->header + old_len, data, take);
+  parser->header_len += take;
+  parser->header[parser->header_len] = '\0';
+
+  /* The terminator may straddle the previous feed */
+  size_t search = old_len >= 3 ? old_len - 3 : 0;
+  char *found = memmem(parser->header + search, parser->header_len - search, "\r\n\r\n", 4);
+  if (found == NULL) {
+    if (parser->header_len >= HTTP_MAX_HEADER)
+      return -1;
+    return (long)take;
+  }
+
+  size_t header_end = found - parser->header;
+  parser->header_len = header_end;
+  parser->header[header_end] = '\0';
+
+  if (parse_header_block(parser) < 0)
+    return -1;
+
+  return (long)(header_end + 4 - old_len);
+}
+
+int http_parser_feed(struct http_parser *parser, const char *data, size_t len, size_t *consumed) {
+  size_t pos = 0;
+
+  while (pos < len && parser->state != HTTP_PARSE_DONE && parser->state != HTTP_PARSE_ERROR) {
+    switch (parser->state) {
+    case HTTP_PARSE_HEADERS: {
+      long used = feed_headers(parser, data + pos, len - pos);
+      if (used < 0) {
+        parser->state = HTTP_PARSE_ERROR;
+        break;
+      }
+      pos += (size_t)used;
+      break;
+    }
+
+    case HTTP_PARSE_IDENTITY:
+    case HTTP_PARSE_CHUNK_DATA: {
+      size_t n = len - pos;
+      if (n > parser->remaining)
+        n = (size_t)parser->remaining;
+
+      if (emit_body(parser, data + pos, n) != 0) {
+        parser->state = HTTP_PARSE_ERROR;
+        break;
+      }
+      pos += n;
+      parser->remaining -= n;
+
+      if (parser->remaining == 0) {
+        parser->state =
+            parser->state == HTTP_PARSE_IDENTITY ? HTTP_PARSE_DONE : HTTP_PARSE_CHUNK_END;
+        parser->line_len = 0;
+      }
+      break;
+    }
+
+    case HTTP_PARSE_UNTIL_EOF:
+      if (emit_body(parser, data + pos, len - pos) != 0) {
+        parser->state = HTTP_PARSE_ERROR;
+        break;
+      }
+      pos = len;
+      break;
+
+    case HTTP_PARSE_CHUNK_END: {
+      char c = data[pos++];
+      if (c == '\n') {
+        parser->state = HTTP_PARSE_CHUNK_SIZE;
+        parser->line_len = 0;
+      } else if (c != '\r') {
+        parser->state = HTTP_PARSE_ERROR;
+      }
+      break;
+    }
+
+    case HTTP_PARSE_CHUNK_SIZE:
+    case HTTP_PARSE_TRAILERS: {
+      const char *eol = memchr(data + pos, '\n', len - pos);
+      size_t n = eol ? (size_t)(eol - (data + pos)) : len - pos;
+
+      /* Only the start of the line matters; long chunk extensions are skipped */
+      size_t keep = HTTP_MAX_LINE - 1 - (parser->line_len < HTTP_MAX_LINE - 1
+                                              ? parser->line_len
+                                              : HTTP_MAX_LINE - 1);
+      if (keep > n)
+        keep = n;
+      if (parser->line_len < HTTP_MAX_LINE - 1)
+        memcpy(parser->line + parser->line_len, data + pos, keep);
+      parser->line_len += n;
+      pos += n;
+
+      if (eol == NULL)
+        break;
+      pos++; /* '\n' */
+
+      size_t stored = parser->line_len < HTTP_MAX_LINE - 1 ? parser->line_len : HTTP_MAX_LINE - 1;
+      if (stored > 0 && parser->line[stored - 1] == '\r')
+        stored--;
+      parser->line[stored] = '\0';
+      bool empty = stored == 0;
+      parser->line_len = 0;
+
+      if (parser->state == HTTP_PARSE_TRAILERS) {
+        if (empty)
+          parser->state = HTTP_PARSE_DONE;
+        break;
+      }
+
+      char *endptr;
+      errno = 0;
+      unsigned long long size = strtoull(parser->line, &endptr, 16);
+      if (endptr == parser->line || errno != 0 ||
+          (*endptr != '\0' && *endptr != ';' && *endptr != ' ' && *endptr != '\t')) {
+        parser->state = HTTP_PARSE_ERROR;
+        break;
+      }
+
+      if (size == 0) {
+        parser->state = HTTP_PARSE_TRAILERS;
+      } else {
+        parser->remaining = size;
+        parser->state = HTTP_PARSE_CHUNK_DATA;
+      }
+      break;
+    }
+
+    case HTTP_PARSE_DONE:
+    case HTTP_PARSE_ERROR:
+      break;
+    }
+  }
+
+  if (consumed)
+    *consumed = pos;
+
+  if (parser->state == HTTP_PARSE_DONE && !body_complete(parser)) {
+    fprintf(stderr, "http_parser compressed body is truncated\n");
+    parser->state = HTTP_PARSE_ERROR;
+  }
+
+  if (parser->state == HTTP_PARSE_ERROR)
+    return -1;
+  return parser->state == HTTP_PARSE_DONE ? 1 : 0;
+}
+
+int http_parser_finish(struct http_parser *parser) {
+  if (parser->state == HTTP_PARSE_UNTIL_EOF)
+    parser->state = HTTP_PARSE_DONE;
+
+  if (parser->state != HTTP_PARSE_DONE || !body_complete(parser)) {
+    parser->state = HTTP_PARSE_ERROR;
+    return -1;
+  }
+
+  return 1;
+}
@@ -6,9 +6,17 @@
  * and event handling using the termbox library.
  */
 
+#define _GNU_SOURCE /* pipe2 */
+
 #include "presentation/uikit.h"
+#include "utils/stats.h"
+#include <errno.h>
+#include <fcntl.h>
 #include <float.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <unistd.h>
 
 /**
  * @brief Fuzzy search result with score
@@ -228,20 +236,6 @@ void inputtext_handler(char *input, const int input_size, const struct tb_event
   }
 }
 
-/**
- * @brief Fast alphanumeric character check (lowercase only).
- *
- * Checks if a character is a lowercase letter (a-z) or digit (0-9).
- * This is a performance-optimized inline function that avoids locale-dependent
- * isalnum() calls.
- *
- * @param c  Character to check.
- * @return   Non-zero if character is lowercase alphanumeric, 0 otherwise.
- */
-static inline int is_alnum_fast(char c) {
-  return ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'));
-}
-
 /**
  * @brief Calculate fuzzy match score between a string and pattern.
  *
@@ -268,40 +262,581 @@ double fuzzy_score(const char *str, const char *pattern) {
   if (patternl == 0)
     return 0.0;
 
-  double score = 0.0;
-  int si = 0, pi = 0, consecutive = 0;
+  char *buffer = malloc(FUZZY_ENTRY_SIZE(strl) + patternl);
+  if (buffer == NULL)
+    return -DBL_MAX;
+
+  struct fuzzy_entry entry;
+  char *lower_pattern = buffer + FUZZY_ENTRY_SIZE(strl);
+  fuzzy_entry_init(&entry, str, strl, buffer);
+  fuzzy_lower(lower_pattern, pattern, patternl);
+
+  double score = fuzzy_match(&entry, lower_pattern, patternl);
+  free(buffer);
+  return score;
+}
+
+static struct search_pool *search_pool_create(const struct search_index *index);
+static void search_pool_destroy(struct search_pool *pool);
+
+/**
+ * @brief A plain array of items seen as a struct listview_source.
+ */
+struct listview_array {
+  const struct listview_item *items;
+  int count;
+};
+
+static int array_count(void *ctx) { return ((const struct listview_array *)ctx)->count; }
+
+static int array_get_item(void *ctx, int index, struct listview_item *dest) {
+  const struct listview_array *array = ctx;
+  if (index < 0 || index >= array->count)
+    return -1;
+
+  *dest = array->items[index];
+  return 0;
+}
+
+int search_index_build(struct search_index *index, const struct listview_item items[],
+                       const int count) {
+  if (index == NULL || (items == NULL && count > 0) || count < 0)
+    return -1;
+
+  struct listview_array array = {items, count};
+  struct listview_source source = {&array, array_count, array_get_item, NULL, NULL, -1};
+  return search_index_build_source(index, &source);
+}
+
+int search_index_build_source(struct search_index *index, const struct listview_source *source) {
+  if (index == NULL || source == NULL || source->count == NULL || source->get_item == NULL)
+    return -1;
+
+  int count = source->count(source->ctx);
+  if (count < 0)
+    return -1;
+
+  memset(index, 0, sizeof(*index));
+  index->cancel_fd = -1;
+  arena_init(&index->arena, ARENA_BLOCK_SIZE);
+
+  size_t slots = count > 0 ? count : 1;
+  index->entries = malloc(sizeof(struct fuzzy_entry) * slots);
+  index->order = malloc(sizeof(int) * slots);
+  index->matches = malloc(sizeof(struct search_match) * slots);
+  index->misses = malloc(sizeof(int) * slots);
+  if (index->entries == NULL || index->order == NULL || index->matches == NULL ||
+      index->misses == NULL) {
+    fprintf(stderr, "search_index_build cannot allocate entries\n");
+    search_index_free(index);
+    return -1;
+  }
+
+  for (int i = 0; i < count; i++) {
+    struct listview_item item;
+    if (source->get_item(source->ctx, i, &item) < 0) {
+      fprintf(stderr, "search_index_build cannot read item %d\n", i);
+      search_index_free(index);
+      return -1;
+    }
+
+    const char *name = item.name ? item.name : "";
+    int length = strlen(name);
+
+    char *storage = arena_alloc(&index->arena, FUZZY_ENTRY_SIZE(length));
+    if (storage == NULL) {
+      fprintf(stderr, "search_index_build cannot allocate item\n");
+      search_index_free(index);
+      return -1;
+    }
+
+    fuzzy_entry_init(&index->entries[i], name, length, storage);
+    index->order[i] = i;
+  }
+
+  index->count = count;
+  index->matched = count;
+  index->sorted = count;
+
+  /* Without threads the index still works, just serially */
+  if (count >= SEARCH_PARALLEL_MIN)
+    index->pool = search_pool_create(index);
+  return 0;
+}
+
+void search_index_free(struct search_index *index) {
+  if (index == NULL)
+    return;
+
+  search_pool_destroy(index->pool);
+  free(index->entries);
+  free(index->order);
+  free(index->query);
+  free(index->matches);
+  free(index->misses);
+  arena_free(&index->arena);
+  memset(index, 0, sizeof(*index));
+}
+
+/* Descending score, ascending item index for equal scores */
+static int compare_match_desc(const void *a, const void *b) {
+  const struct search_match *ma = a, *mb = b;
+  if (ma->score != mb->score)
+    return (mb->score > ma->score) - (mb->score < ma->score);
+  return (ma->index > mb->index) - (ma->index < mb->index);
+}
+
+static int compare_int_asc(const void *a, const void *b) {
+  int ia = *(const int *)a, ib = *(const int *)b;
+  return (ia > ib) - (ia < ib);
+}
+
+static inline void swap_match(struct search_match *a, struct search_match *b) {
+  struct search_match tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+/**
+ * @brief Move the k best matches to the front of an array, unordered.
+ *
+ * Quickselect with a median-of-three pivot. If partitioning degrades past a
+ * depth budget the remaining range is sorted instead, which bounds the worst
+ * case to O(n log n).
+ */
+static void select_top(struct search_match *matches, int n, int k) {
+  int lo = 0, hi = n - 1;
+  int depth = 0;
+  for (int m = n; m > 1; m >>= 1)
+    depth += 2;
+
+  while (lo < hi && k > lo && k <= hi) {
+    if (depth-- == 0) {
+      qsort(matches + lo, hi - lo + 1, sizeof(struct search_match), compare_match_desc);
+      return;
+    }
+
+    int mid = lo + (hi - lo) / 2;
+    if (compare_match_desc(&matches[mid], &matches[lo]) < 0)
+      swap_match(&matches[mid], &matches[lo]);
+    if (compare_match_desc(&matches[hi], &matches[lo]) < 0)
+      swap_match(&matches[hi], &matches[lo]);
+    if (compare_match_desc(&matches[hi], &matches[mid]) < 0)
+      swap_match(&matches[hi], &matches[mid]);
+
+    /* Lomuto partition around the median, parked at hi */
+    swap_match(&matches[mid], &matches[hi]);
+    int store = lo;
+    for (int i = lo; i < hi; i++) {
+      if (compare_match_desc(&matches[i], &matches[hi]) < 0)
+        swap_match(&matches[i], &matches[store++]);
+    }
+    swap_match(&matches[store], &matches[hi]);
+
+    if (store == k || store + 1 == k)
+      return;
+    if (store > k)
+      hi = store - 1;
+    else
+      lo = store + 1;
+  }
+}
 
-  while (si < strl && pi < patternl) {
-    unsigned char sc = str[si];
-    unsigned char pc = pattern[pi];
+int search_index_rank(struct search_index *index, int upto) {
+  if (index == NULL)
+    return 0;
 
-    if (sc >= 'A' && sc <= 'z')
-      sc += 32;
-    if (pc >= 'A' && pc <= 'Z')
-      pc += 32;
+  if (upto > index->matched)
+    upto = index->matched;
+  if (index->sorted >= upto)
+    return index->sorted;
 
-    if (sc == pc) {
-      double s = 10.0 + consecutive * 5.0;
+  int start = index->sorted;
+  int remaining = index->matched - start;
+  int k = upto - start < SEARCH_TOP_K ? SEARCH_TOP_K : upto - start;
+  if (k > remaining)
+    k = remaining;
 
-      if (si + 1 == strl || !is_alnum_fast(str[si + 1]))
-        s += 15.0;
+  struct search_match *matches = index->matches + start;
+  if (k < remaining)
+    select_top(matches, remaining, k);
+  qsort(matches, k, sizeof(struct search_match), compare_match_desc);
 
-      score += s;
-      consecutive++;
-      pi++;
-    } else {
-      score -= 1.0;
-      consecutive = 0;
+  for (int i = 0; i < remaining; i++)
+    index->order[start + i] = matches[i].index;
+
+  index->sorted = start + k;
+  return index->sorted;
+}
+
+/**
+ * @brief Score candidates [lo, hi) of a filter.
+ *
+ * Matches are stored from @p matches, rejected item indices from @p misses,
+ * both in candidate order.
+ *
+ * @return false if @p cancel was raised before the range was done.
+ */
+static bool score_range(const struct search_index *index, const char *pattern, int patternl,
+                        bool refine, int lo, int hi, struct search_match *matches, int *misses,
+                        int *matched, int *missed, const int *cancel) {
+  const struct fuzzy_entry *batch[FUZZY_BATCH];
+  int items[FUZZY_BATCH];
+  double scores[FUZZY_BATCH];
+
+  int m = 0, x = 0;
+  for (int c = lo; c < hi; c += FUZZY_BATCH) {
+    if (cancel && __atomic_load_n(cancel, __ATOMIC_RELAXED))
+      return false;
+
+    int n = hi - c < FUZZY_BATCH ? hi - c : FUZZY_BATCH;
+    for (int j = 0; j < n; j++) {
+      items[j] = refine ? index->order[c + j] : c + j;
+      batch[j] = &index->entries[items[j]];
     }
 
-    si++;
-    if (strl - si < patternl - pi)
+    fuzzy_match_batch(batch, n, pattern, patternl, scores);
+
+    for (int j = 0; j < n; j++) {
+      if (scores[j] == -DBL_MAX)
+        misses[x++] = items[j];
+      else
+        matches[m++] = (struct search_match){.index = items[j], .score = scores[j]};
+    }
+  }
+
+  *matched = m;
+  *missed = x;
+  return true;
+}
+
+/**
+ * @brief Candidate slice of one worker and what it found.
+ */
+struct search_slice {
+  int lo, hi;
+  int matched, missed;
+  int top; /**< Leading matches that are the slice's best, sorted */
+};
+
+/**
+ * @brief Worker threads of a search index.
+ *
+ * Workers sleep on @p wake until @p generation changes, score their slice
+ * into @p scratch and @p index->misses at the slice's own offset, and the
+ * last one to finish writes a byte to @p done so the caller can poll() for
+ * completion and for input at the same time.
+ */
+struct search_pool {
+  const struct search_index *index;
+  pthread_t threads[SEARCH_MAX_WORKERS];
+  int workers;
+
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  unsigned generation;
+  int pending;
+  bool shutdown;
+  int done[2];
+  int cancel;
+
+  /* Current job, written before generation is bumped */
+  const char *pattern;
+  int patternl;
+  bool refine;
+  struct search_slice slices[SEARCH_MAX_WORKERS];
+  struct search_match *scratch;
+};
+
+struct search_worker_arg {
+  struct search_pool *pool;
+  int id;
+};
+
+static void *search_worker(void *arg) {
+  struct search_pool *pool = ((struct search_worker_arg *)arg)->pool;
+  const int id = ((struct search_worker_arg *)arg)->id;
+  free(arg);
+
+  unsigned seen = 0;
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->shutdown && pool->generation == seen)
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    if (pool->shutdown)
+      break;
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    struct search_slice *slice = &pool->slices[id];
+    struct search_match *matches = pool->scratch + slice->lo;
+    slice->top = 0;
+
+    if (score_range(pool->index, pool->pattern, pool->patternl, pool->refine, slice->lo,
+                    slice->hi, matches, pool->index->misses + slice->lo, &slice->matched,
+                    &slice->missed, &pool->cancel)) {
+      slice->top = slice->matched < SEARCH_TOP_K ? slice->matched : SEARCH_TOP_K;
+      if (slice->top < slice->matched)
+        select_top(matches, slice->matched, slice->top);
+      qsort(matches, slice->top, sizeof(struct search_match), compare_match_desc);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->pending == 0) {
+      ssize_t n;
+      do {
+        n = write(pool->done[1], "", 1);
+      } while (n < 0 && errno == EINTR);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+static struct search_pool *search_pool_create(const struct search_index *index) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cpus < 2)
+    return NULL;
+
+  struct search_pool *pool = calloc(1, sizeof(*pool));
+  if (pool == NULL)
+    return NULL;
+
+  pool->index = index;
+  pool->scratch = malloc(sizeof(struct search_match) * index->count);
+  if (pool->scratch == NULL || pipe2(pool->done, O_CLOEXEC) < 0) {
+    free(pool->scratch);
+    free(pool);
+    return NULL;
+  }
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+
+  int workers = cpus < SEARCH_MAX_WORKERS ? (int)cpus : SEARCH_MAX_WORKERS;
+  for (int i = 0; i < workers; i++) {
+    struct search_worker_arg *arg = malloc(sizeof(*arg));
+    if (arg == NULL)
+      break;
+    *arg = (struct search_worker_arg){.pool = pool, .id = i};
+    if (pthread_create(&pool->threads[i], NULL, search_worker, arg) != 0) {
+      free(arg);
       break;
+    }
+    pool->workers++;
   }
 
-  if (pi < patternl)
-    return -DBL_MAX;
-  return score;
+  if (pool->workers < 2) {
+    search_pool_destroy(pool);
+    return NULL;
+  }
+  return pool;
+}
+
+static void search_pool_destroy(struct search_pool *pool) {
+  if (pool == NULL)
+    return;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = true;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i = 0; i < pool->workers; i++)
+    pthread_join(pool->threads[i], NULL);
+
+  pthread_cond_destroy(&pool->wake);
+  pthread_mutex_destroy(&pool->lock);
+  close(pool->done[0]);
+  close(pool->done[1]);
+  free(pool->scratch);
+  free(pool);
+}
+
+/**
+ * @brief Score the candidates on the worker pool.
+ *
+ * On success index->matches holds the merged per-worker top lists followed
+ * by the other matches, and index->misses the rejected items in candidate
+ * order.
+ *
+ * @return 0 on success, SEARCH_CANCELLED if cancel_fd became readable first.
+ */
+static int search_pool_score(struct search_index *index, const char *pattern, int patternl,
+                             bool refine, int candidates, int *matched, int *missed) {
+  struct search_pool *pool = index->pool;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->pattern = pattern;
+  pool->patternl = patternl;
+  pool->refine = refine;
+  pool->cancel = 0;
+  for (int w = 0; w < pool->workers; w++) {
+    pool->slices[w].lo = (int)((long long)candidates * w / pool->workers);
+    pool->slices[w].hi = (int)((long long)candidates * (w + 1) / pool->workers);
+  }
+  pool->pending = pool->workers;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  /* Wait for the workers, giving up early when input arrives */
+  struct pollfd fds[2] = {{.fd = pool->done[0], .events = POLLIN},
+                          {.fd = index->cancel_fd, .events = POLLIN}};
+  bool watch = index->cancel_fd >= 0, cancelled = false;
+  for (;;) {
+    if (poll(fds, watch ? 2 : 1, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      watch = false;
+      continue;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      char byte;
+      if (read(pool->done[0], &byte, 1) == 1)
+        break;
+    }
+
+    if (watch && (fds[1].revents & POLLNVAL)) {
+      watch = false;
+    } else if (watch && (fds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+      cancelled = true;
+      watch = false;
+      __atomic_store_n(&pool->cancel, 1, __ATOMIC_RELAXED);
+    }
+  }
+
+  /* Pairs with the workers' last unlock, making their results visible */
+  pthread_mutex_lock(&pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+
+  if (cancelled)
+    return SEARCH_CANCELLED;
+
+  /* K-way merge of the sorted per-worker tops */
+  int heads[SEARCH_MAX_WORKERS];
+  int total = 0;
+  for (int w = 0; w < pool->workers; w++) {
+    heads[w] = pool->slices[w].lo;
+    total += pool->slices[w].matched;
+  }
+
+  int top = total < SEARCH_TOP_K ? total : SEARCH_TOP_K;
+  for (int out = 0; out < top; out++) {
+    int best = -1;
+    for (int w = 0; w < pool->workers; w++) {
+      const struct search_slice *slice = &pool->slices[w];
+      if (heads[w] < slice->lo + slice->top &&
+          (best < 0 ||
+           compare_match_desc(&pool->scratch[heads[w]], &pool->scratch[heads[best]]) < 0))
+        best = w;
+    }
+    index->matches[out] = pool->scratch[heads[best]++];
+  }
+
+  int m = top, x = 0;
+  for (int w = 0; w < pool->workers; w++) {
+    const struct search_slice *slice = &pool->slices[w];
+    int left = slice->lo + slice->matched - heads[w];
+    memcpy(index->matches + m, pool->scratch + heads[w], sizeof(struct search_match) * left);
+    m += left;
+
+    memmove(index->misses + x, index->misses + slice->lo, sizeof(int) * slice->missed);
+    x += slice->missed;
+  }
+
+  index->sorted = top;
+  *matched = m;
+  *missed = x;
+  return 0;
+}
+
+/* Rank the items against a query, see search_index_filter() */
+static int search_index_score(struct search_index *index, const char *query) {
+  const int count = index->count;
+  const int patternl = strlen(query);
+
+  char *pattern = malloc(patternl + 1);
+  if (pattern == NULL) {
+    fprintf(stderr, "search_index_filter cannot allocate memory\n");
+    return -1;
+  }
+
+  fuzzy_lower(pattern, query, patternl);
+  pattern[patternl] = '\0';
+
+  if (index->query != NULL && strcmp(index->query, pattern) == 0) {
+    free(pattern);
+    return index->matched;
+  }
+
+  if (patternl == 0) {
+    for (int i = 0; i < count; i++)
+      index->order[i] = i;
+    index->matched = count;
+    index->sorted = count;
+    free(index->query);
+    index->query = pattern;
+    return count;
+  }
+
+  /*
+   * Every item matching the new query also matched a prefix of it, so an
+   * extended query only needs to look at the previous matches. The items
+   * rejected earlier stay in the tail of order, in item order.
+   */
+  size_t previous = index->query ? strlen(index->query) : 0;
+  bool refine = previous > 0 && strncmp(index->query, pattern, previous) == 0;
+  int candidates = refine ? index->matched : count;
+  int tail = refine ? index->matched : count;
+
+  int matched, missed;
+  if (index->pool != NULL && candidates >= SEARCH_PARALLEL_MIN) {
+    if (search_pool_score(index, pattern, patternl, refine, candidates, &matched, &missed) < 0) {
+      free(pattern);
+      return SEARCH_CANCELLED;
+    }
+  } else {
+    score_range(index, pattern, patternl, refine, 0, candidates, index->matches, index->misses,
+                &matched, &missed, NULL);
+    index->sorted = 0;
+  }
+
+  if (refine)
+    qsort(index->misses, missed, sizeof(int), compare_int_asc);
+
+  for (int i = 0; i < matched; i++)
+    index->order[i] = index->matches[i].index;
+
+  /* Merge the new misses into the old tail; the write position never passes the read one */
+  int w = matched, m = 0, r = tail;
+  while (m < missed && r < count) {
+    if (index->misses[m] < index->order[r])
+      index->order[w++] = index->misses[m++];
+    else
+      index->order[w++] = index->order[r++];
+  }
+  while (m < missed)
+    index->order[w++] = index->misses[m++];
+
+  index->matched = matched;
+  free(index->query);
+  index->query = pattern;
+
+  search_index_rank(index, SEARCH_TOP_K);
+  return matched;
+}
+
+int search_index_filter(struct search_index *index, const char *query) {
+  if (index == NULL || query == NULL)
+    return -1;
+
+  struct stats_span span;
+  stats_begin(&span);
+  int matched = search_index_score(index, query);
+  stats_end(&span, STATS_FILTER, 0);
+  return matched;
 }
 
 /**
@@ -338,9 +873,14 @@ void list_filter(struct listview_item items[], const int count, char *query) {
   if (!items || !query || count <= 0)
     return;
 
+  struct stats_span span;
+  stats_begin(&span);
+
   struct fuzzy_score *arr = malloc(sizeof(struct fuzzy_score) * count);
-  if (!arr)
+  if (!arr) {
+    stats_end(&span, STATS_FILTER, 0);
     return;
+  }
 
   for (int i = 0; i < count; i++) {
     arr[i].id = items[i].id;
@@ -356,6 +896,7 @@ void list_filter(struct listview_item items[], const int count, char *query) {
   }
 
   free(arr);
+  stats_end(&span, STATS_FILTER, 0);
 }
 
 /**
@@ -419,6 +960,284 @@ void scrollbar(int current_index, int item_count, int visible_lines, int *offset
   }
 }
 
+/**
+ * @brief Marker for a front-buffer cell whose terminal content is unknown.
+ *
+ * No cell is ever drawn with this codepoint, so tb_present() always resends
+ * a cell marked with it.
+ */
+#define CELL_UNKNOWN 0xFFFFFFFFu
+
+/**
+ * @brief What the previous listview() frame put on screen.
+ *
+ * Lets a frame redraw only the parts that changed instead of clearing and
+ * repainting the whole back buffer.
+ *
+ * @param width, height  Terminal size of the frame, 0 before the first one.
+ * @param offset         Viewport offset of the frame.
+ * @param count          Number of rows the header was drawn for.
+ * @param selected_row   Highlighted list row, -1 for none.
+ * @param rows           Item shown on each list row, -1 when blank and -2
+ *                       when unknown. NULL redraws every row every frame.
+ * @param input          Query line contents.
+ * @param input_enabled  Whether the query line was shown.
+ * @param mode, vmode    Modes the footer was drawn for.
+ */
+struct listview_screen {
+  int width, height;
+  int offset;
+  int count;
+  int selected_row;
+  int *rows;
+  char input[100];
+  bool input_enabled;
+  enum motion_mode mode;
+  enum vim_mode vmode;
+};
+
+/**
+ * @brief Keep the selected item inside the viewport.
+ */
+static void viewport_follow(int current_index, int visible_lines, int *offset) {
+  if (current_index < *offset)
+    *offset = current_index;
+  if (current_index >= *offset + visible_lines)
+    *offset = current_index - visible_lines + 1;
+  if (*offset < 0)
+    *offset = 0;
+}
+
+/**
+ * @brief Blank a row of the back buffer from @p x to @p width.
+ */
+static void clear_span(int x, int width, int y) {
+  for (; x < width; x++)
+    tb_set_cell(x, y, ' ', TB_DEFAULT, TB_DEFAULT);
+}
+
+/**
+ * @brief Whether the terminal can scroll a region of rows (DECSTBM).
+ *
+ * Every terminal termbox knows supports it; cells are shifted by hand,
+ * which does not account for grapheme clusters.
+ */
+static bool scroll_regions_supported(void) {
+#ifdef TB_OPT_EGC
+  return false;
+#else
+  const char *term = getenv("TERM");
+  return term != NULL && *term != '\0' && strcmp(term, "dumb") != 0;
+#endif
+}
+
+/**
+ * @brief Scroll rows [top, bottom] by @p delta lines on the terminal.
+ *
+ * A positive delta moves the contents up. The terminal does the move, so
+ * only the rows scrolled into view have to be sent afterwards. Both termbox
+ * buffers are shifted to match: the front buffer mirrors the terminal, with
+ * the uncovered rows marked unknown, and the back buffer keeps what was
+ * drawn, with the uncovered rows blank.
+ */
+static void scroll_rows(int top, int bottom, int delta, int width) {
+  int lines = delta > 0 ? delta : -delta;
+
+  tb_sendf("\x1b[%d;%dr", top + 1, bottom + 1);
+  tb_sendf("\x1b[%d;1H", (delta > 0 ? bottom : top) + 1);
+  for (int i = 0; i < lines; i++)
+    tb_send(delta > 0 ? "\x1b" "D" : "\x1b" "M", 2);
+  tb_send("\x1b[r", 3);
+
+  for (int back = 0; back <= 1; back++) {
+    for (int step = 0; step <= bottom - top; step++) {
+      int y = delta > 0 ? top + step : bottom - step;
+      int src = y + delta;
+
+      for (int x = 0; x < width; x++) {
+        struct tb_cell *dst, *from;
+        if (tb_get_cell(x, y, back, &dst) != TB_OK)
+          continue;
+
+        if (src >= top && src <= bottom && tb_get_cell(x, src, back, &from) == TB_OK) {
+          dst->ch = from->ch;
+          dst->fg = from->fg;
+          dst->bg = from->bg;
+        } else if (back) {
+          dst->ch = ' ';
+          dst->fg = TB_DEFAULT;
+          dst->bg = TB_DEFAULT;
+        } else {
+          dst->ch = CELL_UNKNOWN;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief Forget the previous frame, e.g. after a resize.
+ *
+ * @return Number of list rows tracked (0 if they could not be allocated).
+ */
+static int listview_screen_reset(struct listview_screen *screen, int width, int height,
+                                 int visible_lines) {
+  free(screen->rows);
+  screen->rows = visible_lines > 0 ? malloc(sizeof(int) * visible_lines) : NULL;
+  for (int i = 0; screen->rows && i < visible_lines; i++)
+    screen->rows[i] = -2;
+
+  screen->width = width;
+  screen->height = height;
+  screen->offset = -1;
+  screen->selected_row = -1;
+  screen->input[0] = '\0';
+  screen->input_enabled = false;
+  return screen->rows ? visible_lines : 0;
+}
+
+/**
+ * @brief Most events listview() applies before it draws again.
+ *
+ * Bounds the time between frames when events keep arriving, e.g. a stream
+ * of mouse wheel events.
+ */
+#define LISTVIEW_EVENT_BATCH 256
+
+/**
+ * @brief Milliseconds between frames of the loading indicator.
+ */
+#define LISTVIEW_SPINNER_MS 100
+
+/**
+ * @brief What listview_wait() returned for.
+ *
+ * @enum LISTVIEW_WAKE_NONE    Timeout or interruption, nothing to apply
+ * @enum LISTVIEW_WAKE_EVENT   A terminal event was read
+ * @enum LISTVIEW_WAKE_UPDATE  The source has an update
+ */
+enum listview_wake { LISTVIEW_WAKE_NONE, LISTVIEW_WAKE_EVENT, LISTVIEW_WAKE_UPDATE };
+
+/**
+ * @brief Wait for a terminal event or an update of the source.
+ *
+ * Without update_fd and timeout this is tb_poll_event(). Otherwise the
+ * terminal and resize fds of termbox are polled along with update_fd; the
+ * events termbox already buffered, and terminal input, come first.
+ *
+ * @param update_fd   Fd of the source, -1 for none.
+ * @param timeout_ms  Longest wait, -1 for no limit.
+ */
+static enum listview_wake listview_wait(struct tb_event *ev, int update_fd, int timeout_ms) {
+  if (update_fd < 0 && timeout_ms < 0)
+    return tb_poll_event(ev) == TB_OK ? LISTVIEW_WAKE_EVENT : LISTVIEW_WAKE_NONE;
+
+  if (tb_peek_event(ev, 0) == TB_OK)
+    return LISTVIEW_WAKE_EVENT;
+
+  // poll() skips the negative fd when there is no update_fd
+  struct pollfd fds[3] = {
+      {.fd = -1, .events = POLLIN}, {.fd = -1, .events = POLLIN}, {.fd = update_fd, .events = POLLIN}};
+  tb_get_fds(&fds[0].fd, &fds[1].fd);
+  if (poll(fds, 3, timeout_ms) <= 0)
+    return LISTVIEW_WAKE_NONE;
+
+  if ((fds[0].revents | fds[1].revents) != 0 && tb_peek_event(ev, 0) == TB_OK)
+    return LISTVIEW_WAKE_EVENT;
+  if (fds[2].revents != 0)
+    return LISTVIEW_WAKE_UPDATE;
+  return LISTVIEW_WAKE_NONE;
+}
+
+/**
+ * @brief Apply one event to the listview state.
+ *
+ * Runs the motion handler of the current mode, then the query input handler.
+ *
+ * @return 0   Keep going.
+ * @return 1   The current item was chosen.
+ * @return -1  The user quit.
+ */
+static int listview_handle_event(const struct tb_event *ev, int count, int *current_index,
+                                 enum motion_mode *mode, enum vim_mode *vmode, char *input,
+                                 int input_size) {
+  if (*mode == DEFAULT) {
+    int motion = default_motion(count, current_index, *ev);
+    if (motion != 0)
+      return motion;
+
+    switch (ev->key) {
+    case TB_KEY_CTRL_SLASH:
+      *mode = VIM;
+      break;
+    }
+  } else {
+    int motion = vim_motion(count, current_index, vmode, *ev);
+    if (motion == 1 || motion < 0)
+      return motion;
+    if (motion == 2)
+      return 0; // The key only switched modes, do not type it
+
+    switch (ev->key) {
+    case TB_KEY_CTRL_SLASH:
+      *mode = DEFAULT;
+      break;
+    }
+
+    // Clear input when vim mode in normal
+    if (*vmode == NORMAL && *mode == VIM) {
+      input[0] = '\0';
+    }
+  }
+
+  // input text after the motion
+  inputtext_handler(input, input_size, *ev);
+  return 0;
+}
+
+/**
+ * @brief Item shown on a row: ranked through order, or the row itself when
+ *        the source does its own filtering (order is NULL). -1 past the end.
+ */
+static inline int row_item(const int *order, int count, int row) {
+  if (row >= count)
+    return -1;
+  return order ? order[row] : row;
+}
+
+/**
+ * @brief Name of an item of a source, "" when it cannot be read.
+ */
+static const char *source_name(const struct listview_source *source, int index) {
+  struct listview_item item;
+  if (source->get_item(source->ctx, index, &item) < 0 || item.name == NULL)
+    return "";
+  return item.name;
+}
+
+/**
+ * @brief Hand the query to a filtering source when it changed.
+ *
+ * @param applied  Query the source last filtered with, updated.
+ * @param count    Receives the new number of rows.
+ *
+ * @return true when the rows were replaced.
+ */
+static bool source_filter(const struct listview_source *source, const char *query,
+                          char applied[100], int *count) {
+  if (strcmp(query, applied) == 0)
+    return false;
+
+  // A failed filter is not retried until the query changes again
+  snprintf(applied, 100, "%s", query);
+  if (source->filter(source->ctx, query) < 0)
+    return false;
+
+  int rows = source->count(source->ctx);
+  *count = rows > 0 ? rows : 0;
+  return true;
+}
+
 /**
  * @brief Display an interactive selection menu with vim and default motion modes.
  *
@@ -436,25 +1255,68 @@ void scrollbar(int current_index, int item_count, int visible_lines, int *offset
  * - A footer with keybinding help text
  * - A mode indicator when in vim mode
  *
+ * Frames after the first only redraw what changed: rows whose item or
+ * highlight changed, the query line, the header and footer. When the
+ * viewport moves by less than a page the list region is scrolled on the
+ * terminal itself, so only the rows coming into view are sent. All events
+ * already queued are applied before the next frame, so a held key or a
+ * pasted query is filtered and drawn once rather than once per character.
+ *
+ * Items are read from the source only for the rows being drawn. Unless the
+ * source filters itself, they are ranked through a search index built once
+ * per call, which is only consulted again when the query changes.
+ *
+ * A source with an update callback is shown before its items are complete:
+ * while it has none yet a loading indicator takes the place of the header,
+ * and when update() replaces the items the search index is rebuilt and the
+ * whole screen drawn again, the query and cursor position kept.
+ *
  * @param title     Title to display at the top of the menu.
- * @param items     Array of strings representing the selectable items.
- * @param count     Number of items in the array.
- * @param selected  Pointer to an integer where the selected index will be stored.
+ * @param source    Items to display.
+ * @param selected  Pointer to an integer where the index of the selected item
+ *                  will be stored.
  *                  Will be set to -1 if the user quits without selecting.
  *
  * @note This function handles termbox initialization and cleanup internally.
  * @note The function blocks until the user makes a selection or quits.
  */
-void listview(const char *title, struct listview_item items[], const int count, int *selected) {
-  if (items == NULL || selected == NULL || count <= 0) {
+void listview_from_source(const char *title, const struct listview_source *source, int *selected) {
+  if (selected == NULL)
+    return;
+  // *selected is the starting cursor, nothing may be taken as chosen on failure
+  if (source == NULL || source->count == NULL || source->get_item == NULL) {
+    *selected = -1;
+    return;
+  }
+
+  // Without a filter of its own the source is read once, into the index
+  struct search_index index = {.cancel_fd = -1};
+  bool own_search = source->filter == NULL;
+  if (own_search && search_index_build_source(&index, source) < 0) {
+    fprintf(stderr, "listview cannot build search index\n");
+    *selected = -1;
+    return;
+  }
+  const int *order = index.order;
+
+  // A source that is still being updated may start out empty
+  bool updating = source->update != NULL && source->update_fd >= 0;
+  int count = own_search ? index.count : source->count(source->ctx);
+  if (count < 0)
+    count = 0;
+  if (count == 0 && !updating) {
+    search_index_free(&index);
+    *selected = -1;
     return;
   }
 
   char input[100] = "";
+  char source_query[100] = "";
   char *vmode_names[3] = {" Normal ", " Insert ", " Search "};
 
   int current_index = *selected;
   int offset = 0;
+  int spinner = 0;
 
   bool running = true;
 
@@ -463,109 +1325,223 @@ void listview(const char *title, struct listview_item items[], const int count,
 
   tb_init();
 
-  while (running) {
-    tb_clear();
+  // Typing while a large list is being filtered interrupts the filter
+  int resize_fd;
+  tb_get_fds(&index.cancel_fd, &resize_fd);
 
+  struct listview_screen screen = {0};
+  bool scroll_regions = scroll_regions_supported();
+
+  while (running) {
     int term_height = tb_height();
     int term_width = tb_width();
     int visible_lines = term_height - 10;
+    if (visible_lines < 0)
+      visible_lines = 0;
+
+    // Re-rank only when the query changed, then place the viewport
+    bool refiltered = false;
+    if (own_search)
+      search_index_filter(&index, input);
+    else
+      refiltered = source_filter(source, input, source_query, &count);
+    if (current_index >= count)
+      current_index = count - 1;
+    if (current_index < 0)
+      current_index = 0;
+    viewport_follow(current_index, visible_lines, &offset);
+    if (own_search)
+      search_index_rank(&index, offset + visible_lines);
+
+    bool full = screen.width != term_width || screen.height != term_height;
+    if (full) {
+      tb_clear();
+      listview_screen_reset(&screen, term_width, term_height, visible_lines);
+      tb_print(5, 2, TB_YELLOW | TB_BOLD, TB_DEFAULT, title);
+    }
+
+    // A filtering source renumbers its rows, so none of them can be trusted
+    for (int i = 0; refiltered && screen.rows != NULL && i < visible_lines; i++)
+      screen.rows[i] = -2;
 
     // Draw header
-    tb_print(5, 2, TB_YELLOW | TB_BOLD, TB_DEFAULT, title);
-    tb_printf(5, 3, TB_GREEN, TB_DEFAULT, "Showing %d-%d of %d", offset + 1,
-              (offset + visible_lines < count) ? offset + visible_lines : count, count);
+    bool loading = updating && count == 0;
+    if (loading) {
+      clear_span(5, term_width, 3);
+      tb_printf(5, 3, TB_GREEN, TB_DEFAULT, "Loading %c", "|/-\\"[spinner++ % 4]);
+    } else if (offset != screen.offset || count != screen.count) {
+      clear_span(5, term_width, 3);
+      tb_printf(5, 3, TB_GREEN, TB_DEFAULT, "Showing %d-%d of %d", offset + 1,
+                (offset + visible_lines < count) ? offset + visible_lines : count, count);
+    }
 
     bool inputtext_enabled = !(vmode == NORMAL && current_mode == VIM);
-    inputtext(5, 4, input, inputtext_enabled);
+    if (full || inputtext_enabled != screen.input_enabled || strcmp(input, screen.input) != 0) {
+      clear_span(5, term_width, 4);
+      inputtext(5, 4, input, inputtext_enabled);
+      screen.input_enabled = inputtext_enabled;
+      memcpy(screen.input, input, sizeof(screen.input));
+    }
 
     // Draw Footer
-    if (current_mode == DEFAULT) {
-      tb_print(5, term_height - 2, PRIMARY_COLOR, TB_DEFAULT,
-               "↑/↓: Navigate "
-               "| PgUp/pgDn: Fast scroll "
-               "| HOME/END: Top/Bottom "
-               "| Enter: Select "
-               "| ESC: Quit "
-               "| CTRL-/: Vim mode");
-    } else {
-      tb_print(5, term_height - 2, PRIMARY_COLOR, TB_DEFAULT,
-               "k/j: Navigate "
-               "| CTRL+U/CTRL+D: Fast scroll "
-               "| g/G: Top/Bottom "
-               "| Enter: Select "
-               "| q: Quit "
-               "| /: Search "
-               "| ESC: Normal mode"
-               "| CTRL-/: Default mode");
-
-      tb_print(term_width - strlen(vmode_names[vmode]) - 5, term_height - 1, TB_BLACK,
-               PRIMARY_COLOR, vmode_names[vmode]);
+    if (full || current_mode != screen.mode || vmode != screen.vmode) {
+      clear_span(0, term_width, term_height - 2);
+      clear_span(0, term_width, term_height - 1);
+
+      if (current_mode == DEFAULT) {
+        tb_print(5, term_height - 2, PRIMARY_COLOR, TB_DEFAULT,
+                 "↑/↓: Navigate "
+                 "| PgUp/pgDn: Fast scroll "
+                 "| HOME/END: Top/Bottom "
+                 "| Enter: Select "
+                 "| ESC: Quit "
+                 "| CTRL-/: Vim mode");
+      } else {
+        tb_print(5, term_height - 2, PRIMARY_COLOR, TB_DEFAULT,
+                 "k/j: Navigate "
+                 "| CTRL+U/CTRL+D: Fast scroll "
+                 "| g/G: Top/Bottom "
+                 "| Enter: Select "
+                 "| q: Quit "
+                 "| /: Search "
+                 "| ESC: Normal mode"
+                 "| CTRL-/: Default mode");
+
+        tb_print(term_width - strlen(vmode_names[vmode]) - 5, term_height - 1, TB_BLACK,
+                 PRIMARY_COLOR, vmode_names[vmode]);
+      }
+      screen.mode = current_mode;
+      screen.vmode = vmode;
+    }
+
+    // Scroll what is already on screen when the rows just moved
+    int delta = offset - screen.offset;
+    if (!full && scroll_regions && screen.rows != NULL && delta != 0 &&
+        abs(delta) < visible_lines) {
+      int probe = delta > 0 ? 0 : -delta;
+      if (screen.rows[probe + delta] == row_item(order, count, offset + probe)) {
+        scroll_rows(5, 5 + visible_lines - 1, delta, term_width);
+
+        int step = delta > 0 ? 1 : -1;
+        for (int i = delta > 0 ? 0 : visible_lines - 1; i >= 0 && i < visible_lines; i += step)
+          screen.rows[i] = i + delta >= 0 && i + delta < visible_lines ? screen.rows[i + delta] : -2;
+
+        screen.selected_row -= delta;
+      }
     }
 
-    // Draw visible items
-    list_filter(items, count, input);
-    for (int i = 0; i < visible_lines && (offset + i) < count; i++) {
+    // Draw the visible rows that changed
+    for (int i = 0; i < visible_lines; i++) {
       int idx = offset + i;
+      int item = row_item(order, count, idx);
+      bool highlighted = idx == current_index;
 
-      if (idx == current_index) {
+      if (screen.rows != NULL && screen.rows[i] == item &&
+          (screen.selected_row == i) == highlighted)
+        continue;
+
+      clear_span(5, term_width, 5 + i);
+      if (item >= 0 && highlighted) {
         tb_print(5, 5 + i, TB_BLACK, PRIMARY_COLOR, "> ");
-        tb_print(7, 5 + i, TB_BLACK, PRIMARY_COLOR, items[idx].name);
-      } else {
+        tb_print(7, 5 + i, TB_BLACK, PRIMARY_COLOR, source_name(source, item));
+      } else if (item >= 0) {
         tb_print(5, 5 + i, PRIMARY_COLOR, TB_DEFAULT, "  ");
-        tb_print(7, 5 + i, PRIMARY_COLOR, TB_DEFAULT, items[idx].name);
+        tb_print(7, 5 + i, PRIMARY_COLOR, TB_DEFAULT, source_name(source, item));
       }
+
+      if (screen.rows != NULL)
+        screen.rows[i] = item;
     }
+    screen.selected_row = current_index - offset;
+    screen.offset = offset;
+    screen.count = loading ? -1 : count; // The header is drawn again once loaded
 
     scrollbar(current_index, count, visible_lines, &offset);
 
     // Show everything to the front
+    struct stats_span render;
+    stats_begin(&render);
     tb_present();
+    stats_end(&render, STATS_RENDER, 0);
 
-    // handle event after ui show
+    // Apply every event already queued before drawing again, so key repeat
+    // and pastes cost one filter and one frame per burst
     struct tb_event term_ev;
-    tb_poll_event(&term_ev);
-
-    if (current_mode == DEFAULT) {
-      int motion = default_motion(count, &current_index, term_ev);
-      if (motion < 0) {
-        running = false;
-      } else if (motion == 1) {
-        *selected = current_index;
-        running = false;
+    int action = 0;
+    enum listview_wake wake = listview_wait(&term_ev, updating ? source->update_fd : -1,
+                                            loading ? LISTVIEW_SPINNER_MS : -1);
+    if (wake == LISTVIEW_WAKE_EVENT) {
+      int handled = 0;
+      do {
+        action = listview_handle_event(&term_ev, count, &current_index, &current_mode, &vmode,
+                                       input, sizeof(input));
+      } while (action == 0 && ++handled < LISTVIEW_EVENT_BATCH &&
+               tb_peek_event(&term_ev, 0) == TB_OK);
+    } else if (wake == LISTVIEW_WAKE_UPDATE) {
+      bool changed = false;
+      updating = source->update(source->ctx, &changed) > 0;
+
+      // New items: index them again, then redraw as after a resize
+      if (changed && own_search) {
+        search_index_free(&index);
+        if (search_index_build_source(&index, source) < 0)
+          action = -1;
+        tb_get_fds(&index.cancel_fd, &resize_fd);
+        order = index.order;
+        count = index.count;
+      } else if (changed) {
+        int rows = source->count(source->ctx);
+        count = rows > 0 ? rows : 0;
       }
+      if (changed)
+        screen.width = -1;
 
-      switch (term_ev.key) {
-      case TB_KEY_CTRL_SLASH:
-        current_mode = VIM;
-        break;
+      // Nothing came, and nothing will
+      if (!updating && count == 0)
+        action = -1;
+    }
+
+    if (action < 0) {
+      *selected = -1;
+      running = false;
+    } else if (action == 1) {
+      // Text typed in the same burst as Enter has not been filtered yet, and
+      // whatever is still queued must not cancel it
+      if (own_search) {
+        index.cancel_fd = -1;
+        search_index_filter(&index, input);
+        search_index_rank(&index, current_index + 1);
+      } else {
+        source_filter(source, input, source_query, &count);
       }
-    } else {
-      int motion = vim_motion(count, &current_index, &vmode, term_ev);
 
-      if (motion < 0) {
-        running = false;
-      } else if (motion == 1) {
-        *selected = current_index;
+      if (current_index < count) {
+        *selected = own_search ? order[current_index] : current_index;
         running = false;
-      } else if (motion == 2) {
-        continue;
       }
+    }
+  }
 
-      switch (term_ev.key) {
-      case TB_KEY_CTRL_SLASH:
-        current_mode = DEFAULT;
-        break;
-      }
+  tb_shutdown();
 
-      // Clear input when vim mode in normal
-      if (vmode == NORMAL && current_mode == VIM) {
-        input[0] = '\0';
-      }
-    }
+  free(screen.rows);
+  search_index_free(&index);
+}
 
-    // input text after the motion
-    inputtext_handler(input, sizeof(input), term_ev);
+/**
+ * @brief Display an interactive selection menu over an array of items.
+ *
+ * See listview_from_source(). The array is not reordered.
+ */
+void listview(const char *title, struct listview_item items[], const int count, int *selected) {
+  if (selected == NULL)
+    return;
+  if (items == NULL || count <= 0) {
+    *selected = -1;
+    return;
   }
 
-  tb_shutdown();
+  struct listview_array array = {items, count};
+  struct listview_source source = {&array, array_count, array_get_item, NULL, NULL, -1};
+  listview_from_source(title, &source, selected);
 }
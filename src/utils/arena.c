@@ -0,0 +1,101 @@
+#include "utils/arena.h"
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct arena_block {
+  struct arena_block *next;
+  size_t size;
+  size_t used;
+  alignas(max_align_t) char data[];
+};
+
+void arena_init(struct arena *arena, size_t block_size) {
+  arena->head = NULL;
+  arena->block_size = block_size;
+}
+
+static struct arena_block *arena_grow(struct arena *arena, size_t size) {
+  size_t block_size = arena->block_size ? arena->block_size : ARENA_BLOCK_SIZE;
+  if (size > block_size)
+    block_size = size;
+
+  struct arena_block *block = malloc(sizeof(struct arena_block) + block_size);
+  if (block == NULL) {
+    fprintf(stderr, "arena cannot allocate memory\n");
+    return NULL;
+  }
+
+  block->size = block_size;
+  block->used = 0;
+
+  /* An oversized block goes behind the current one so its free space stays usable */
+  if (size > (arena->block_size ? arena->block_size : ARENA_BLOCK_SIZE) && arena->head) {
+    block->next = arena->head->next;
+    arena->head->next = block;
+  } else {
+    block->next = arena->head;
+    arena->head = block;
+  }
+
+  return block;
+}
+
+/* Carve @p size bytes at @p align alignment out of the current block */
+static void *arena_take(struct arena *arena, size_t size, size_t align) {
+  if (arena == NULL || size > SIZE_MAX - ARENA_ALIGN)
+    return NULL;
+
+  struct arena_block *block = arena->head;
+  size_t offset = 0;
+  if (block != NULL)
+    offset = (block->used + align - 1) & ~(align - 1);
+
+  if (block == NULL || offset > block->size || block->size - offset < size) {
+    block = arena_grow(arena, size);
+    if (block == NULL)
+      return NULL;
+    offset = block->used;
+  }
+
+  block->used = offset + size;
+  return block->data + offset;
+}
+
+void *arena_alloc(struct arena *arena, size_t size) { return arena_take(arena, size, ARENA_ALIGN); }
+
+void *arena_calloc(struct arena *arena, size_t size) {
+  void *ptr = arena_alloc(arena, size);
+  if (ptr)
+    memset(ptr, 0, size);
+  return ptr;
+}
+
+char *arena_strndup(struct arena *arena, const char *str, size_t len) {
+  /* Strings need no alignment, so they pack tightly */
+  char *copy = arena_take(arena, len + 1, 1);
+  if (copy == NULL)
+    return NULL;
+
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+void arena_free(struct arena *arena) {
+  if (arena == NULL)
+    return;
+
+  struct arena_block *block = arena->head;
+  while (block != NULL) {
+    struct arena_block *next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->head = NULL;
+}
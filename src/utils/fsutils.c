@@ -0,0 +1,175 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "utils/fsutils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int mkdir_p(char *path) {
+  for (char *p = path + 1; *p; p++) {
+    if (*p != '/')
+      continue;
+
+    *p = '\0';
+    if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+      *p = '/';
+      return -1;
+    }
+    *p = '/';
+  }
+
+  if (mkdir(path, 0700) < 0 && errno != EEXIST)
+    return -1;
+
+  return 0;
+}
+
+int cache_dir(char *dest, size_t dest_len) {
+  if (dest == NULL || dest_len == 0) {
+    fprintf(stderr, "cache_dir destination NULL\n");
+    return -1;
+  }
+
+  int len;
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+
+  /* The XDG spec says relative paths must be ignored */
+  if (xdg != NULL && xdg[0] == '/') {
+    len = snprintf(dest, dest_len, "%s/%s", xdg, CACHE_APP_DIR);
+  } else if (home != NULL && home[0] != '\0') {
+    len = snprintf(dest, dest_len, "%s/.cache/%s", home, CACHE_APP_DIR);
+  } else {
+    fprintf(stderr, "cache_dir neither XDG_CACHE_HOME nor HOME is set\n");
+    return -1;
+  }
+
+  if (len < 0 || (size_t)len >= dest_len) {
+    fprintf(stderr, "cache_dir path too long\n");
+    return -1;
+  }
+
+  if (mkdir_p(dest) < 0) {
+    perror("cache_dir mkdir");
+    return -1;
+  }
+
+  return 0;
+}
+
+int cache_path(const char *name, char *dest, size_t dest_len) {
+  char dir[4096];
+  if (cache_dir(dir, sizeof(dir)) < 0)
+    return -1;
+
+  int len = snprintf(dest, dest_len, "%s/%s", dir, name);
+  if (len < 0 || (size_t)len >= dest_len) {
+    fprintf(stderr, "cache_path path too long\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+char *read_file(const char *path, size_t *size) {
+  if (path == NULL)
+    return NULL;
+
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL)
+    return NULL;
+
+  struct stat st;
+  if (fstat(fileno(fp), &st) < 0 || st.st_size < 0) {
+    fclose(fp);
+    return NULL;
+  }
+
+  size_t len = (size_t)st.st_size;
+  char *buffer = malloc(len + 1);
+  if (buffer == NULL) {
+    fprintf(stderr, "read_file cannot allocate memory\n");
+    fclose(fp);
+    return NULL;
+  }
+
+  if (fread(buffer, 1, len, fp) != len) {
+    free(buffer);
+    fclose(fp);
+    return NULL;
+  }
+
+  buffer[len] = '\0';
+  fclose(fp);
+
+  if (size)
+    *size = len;
+  return buffer;
+}
+
+int atomic_write_file(const char *path, const void *data, size_t len) {
+  if (path == NULL || (data == NULL && len > 0)) {
+    fprintf(stderr, "atomic_write_file invalid argument\n");
+    return -1;
+  }
+
+  size_t tmp_len = strlen(path) + sizeof(".XXXXXX");
+  char *tmp = malloc(tmp_len);
+  if (tmp == NULL) {
+    fprintf(stderr, "atomic_write_file cannot allocate memory\n");
+    return -1;
+  }
+  snprintf(tmp, tmp_len, "%s.XXXXXX", path);
+
+  int fd = mkstemp(tmp);
+  if (fd < 0) {
+    perror("atomic_write_file mkstemp");
+    free(tmp);
+    return -1;
+  }
+
+  const char *p = data;
+  size_t left = len;
+  while (left > 0) {
+    ssize_t n = write(fd, p, left);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("atomic_write_file write");
+      goto failure;
+    }
+    p += n;
+    left -= (size_t)n;
+  }
+
+  if (fsync(fd) < 0) {
+    perror("atomic_write_file fsync");
+    goto failure;
+  }
+
+  if (close(fd) < 0) {
+    fd = -1;
+    perror("atomic_write_file close");
+    goto failure;
+  }
+  fd = -1;
+
+  if (rename(tmp, path) < 0) {
+    perror("atomic_write_file rename");
+    goto failure;
+  }
+
+  free(tmp);
+  return 0;
+
+failure:
+  if (fd >= 0)
+    close(fd);
+  unlink(tmp);
+  free(tmp);
+  return -1;
+}
@@ -0,0 +1,292 @@
+/**
+ * @file fuzzy.c
+ * @brief Implementation of the fuzzy matcher and its kernels.
+ *
+ * The score only depends on where each pattern character is matched: the
+ * greedy scan of the original matcher takes the first occurrence after the
+ * previous match, and every byte it skips costs one point and breaks the
+ * consecutive run. Finding that first occurrence is a byte search, which is
+ * the part the kernels vectorize. Scores are sums of small integers, so they
+ * come out bit-identical whichever kernel runs.
+ */
+
+#include "utils/fuzzy.h"
+#include <float.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define FUZZY_HAVE_SSE2 1
+#endif
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <immintrin.h>
+#define FUZZY_HAVE_AVX2 1
+#endif
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FUZZY_HAVE_NEON 1
+#endif
+
+static inline bool is_alnum_fast(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9');
+}
+
+static inline char lower_fast(char c) { return (c >= 'A' && c <= 'Z') ? c + 32 : c; }
+
+static inline uint64_t char_bit(unsigned char c) { return 1ull << (c & 63); }
+
+void fuzzy_lower(char *dest, const char *src, int length) {
+  for (int i = 0; i < length; i++)
+    dest[i] = lower_fast(src[i]);
+}
+
+uint64_t fuzzy_pattern_mask(const char *pattern, int length) {
+  uint64_t mask = 0;
+  for (int i = 0; i < length; i++)
+    mask |= char_bit(pattern[i]);
+  return mask;
+}
+
+void fuzzy_entry_init(struct fuzzy_entry *entry, const char *text, int length, char *storage) {
+  char *lower = storage;
+  unsigned char *word_end = (unsigned char *)storage + length + 1;
+
+  fuzzy_lower(lower, text, length);
+  lower[length] = '\0';
+
+  for (int i = 0; i < length; i++)
+    word_end[i] = i + 1 == length || !is_alnum_fast(lower[i + 1]);
+  memset(word_end + length, 0, FUZZY_PAD);
+
+  entry->lower = lower;
+  entry->word_end = word_end;
+  entry->length = length;
+  entry->mask = fuzzy_pattern_mask(lower, length);
+}
+
+/**
+ * @brief Position of the first @p c in str[from, end), or -1.
+ *
+ * The vector versions may load up to FUZZY_PAD bytes beyond @p end; entries
+ * reserve that slack and out-of-range lanes are masked off.
+ */
+typedef int (*find_fn)(const char *str, int from, int end, char c);
+
+static int find_scalar(const char *str, int from, int end, char c) {
+  for (int i = from; i < end; i++) {
+    if (str[i] == c)
+      return i;
+  }
+  return -1;
+}
+
+#ifdef FUZZY_HAVE_SSE2
+static int find_sse2(const char *str, int from, int end, char c) {
+  const __m128i needle = _mm_set1_epi8(c);
+  for (int i = from; i < end; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(str + i));
+    unsigned bits = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+    if (end - i < 16)
+      bits &= (1u << (end - i)) - 1;
+    if (bits)
+      return i + __builtin_ctz(bits);
+  }
+  return -1;
+}
+#endif
+
+#ifdef FUZZY_HAVE_AVX2
+__attribute__((target("avx2"))) static int find_avx2(const char *str, int from, int end, char c) {
+  const __m256i needle = _mm256_set1_epi8(c);
+  for (int i = from; i < end; i += 32) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(str + i));
+    unsigned bits = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle));
+    if (end - i < 32)
+      bits &= (1u << (end - i)) - 1;
+    if (bits)
+      return i + __builtin_ctz(bits);
+  }
+  return -1;
+}
+#endif
+
+#ifdef FUZZY_HAVE_NEON
+static int find_neon(const char *str, int from, int end, char c) {
+  const uint8x16_t needle = vdupq_n_u8((uint8_t)c);
+  for (int i = from; i < end; i += 16) {
+    uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t *)(str + i)), needle);
+    /* Narrow to four bits per byte */
+    uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+    if (end - i < 16)
+      bits &= (1ull << ((end - i) * 4)) - 1;
+    if (bits)
+      return i + __builtin_ctzll(bits) / 4;
+  }
+  return -1;
+}
+#endif
+
+/* Shared scorer, inlined into each kernel so the search is a direct call */
+static inline __attribute__((always_inline)) double
+match_with(find_fn find, const struct fuzzy_entry *entry, const char *pattern, int patternl) {
+  if (patternl == 0)
+    return 0.0;
+  if (entry->length < patternl)
+    return -DBL_MAX;
+
+  double score = 0.0;
+  int si = 0, consecutive = 0;
+
+  for (int pi = 0; pi < patternl; pi++) {
+    /* Leave room for the rest of the pattern, as the greedy scan did */
+    int end = entry->length - (patternl - pi - 1);
+    int pos = si;
+
+    /* Runs of consecutive matches are common and need no search */
+    if (si >= end)
+      return -DBL_MAX;
+    if (entry->lower[si] != pattern[pi]) {
+      pos = find(entry->lower, si + 1, end, pattern[pi]);
+      if (pos < 0)
+        return -DBL_MAX;
+    }
+
+    if (pos != si) {
+      score -= pos - si;
+      consecutive = 0;
+    }
+
+    score += 10.0 + consecutive * 5.0;
+    if (entry->word_end[pos])
+      score += 15.0;
+
+    consecutive++;
+    si = pos + 1;
+  }
+
+  return score;
+}
+
+static inline __attribute__((always_inline)) void
+batch_with(find_fn find, const struct fuzzy_entry *const entries[], int count, const char *pattern,
+           int patternl, double scores[]) {
+  const uint64_t need = fuzzy_pattern_mask(pattern, patternl);
+  for (int i = 0; i < count; i++) {
+    if ((entries[i]->mask & need) != need)
+      scores[i] = -DBL_MAX;
+    else
+      scores[i] = match_with(find, entries[i], pattern, patternl);
+  }
+}
+
+typedef void (*batch_fn)(const struct fuzzy_entry *const entries[], int count, const char *pattern,
+                         int patternl, double scores[]);
+
+static void batch_scalar(const struct fuzzy_entry *const entries[], int count, const char *pattern,
+                         int patternl, double scores[]) {
+  batch_with(find_scalar, entries, count, pattern, patternl, scores);
+}
+
+#ifdef FUZZY_HAVE_SSE2
+static void batch_sse2(const struct fuzzy_entry *const entries[], int count, const char *pattern,
+                       int patternl, double scores[]) {
+  batch_with(find_sse2, entries, count, pattern, patternl, scores);
+}
+#endif
+
+#ifdef FUZZY_HAVE_AVX2
+__attribute__((target("avx2"))) static void batch_avx2(const struct fuzzy_entry *const entries[],
+                                                       int count, const char *pattern,
+                                                       int patternl, double scores[]) {
+  batch_with(find_avx2, entries, count, pattern, patternl, scores);
+}
+#endif
+
+#ifdef FUZZY_HAVE_NEON
+static void batch_neon(const struct fuzzy_entry *const entries[], int count, const char *pattern,
+                       int patternl, double scores[]) {
+  batch_with(find_neon, entries, count, pattern, patternl, scores);
+}
+#endif
+
+struct kernel {
+  const char *name;
+  batch_fn batch;
+};
+
+static const struct kernel kernels[] = {
+    [FUZZY_KERNEL_SCALAR] = {"scalar", batch_scalar},
+#ifdef FUZZY_HAVE_SSE2
+    [FUZZY_KERNEL_SSE2] = {"sse2", batch_sse2},
+#endif
+#ifdef FUZZY_HAVE_AVX2
+    [FUZZY_KERNEL_AVX2] = {"avx2", batch_avx2},
+#endif
+#ifdef FUZZY_HAVE_NEON
+    [FUZZY_KERNEL_NEON] = {"neon", batch_neon},
+#endif
+};
+
+#define KERNEL_COUNT ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+/* Resolved on first use; every thread resolves to the same value */
+static const struct kernel *active;
+
+static bool kernel_supported(enum fuzzy_kernel kernel) {
+  if ((int)kernel >= KERNEL_COUNT || kernels[kernel].batch == NULL)
+    return false;
+#ifdef FUZZY_HAVE_AVX2
+  if (kernel == FUZZY_KERNEL_AVX2)
+    return __builtin_cpu_supports("avx2");
+#endif
+  return true;
+}
+
+static const struct kernel *best_kernel(void) {
+  static const enum fuzzy_kernel preference[] = {FUZZY_KERNEL_AVX2, FUZZY_KERNEL_NEON,
+                                                 FUZZY_KERNEL_SSE2};
+  for (size_t i = 0; i < sizeof(preference) / sizeof(preference[0]); i++) {
+    if (kernel_supported(preference[i]))
+      return &kernels[preference[i]];
+  }
+  return &kernels[FUZZY_KERNEL_SCALAR];
+}
+
+static const struct kernel *current_kernel(void) {
+  const struct kernel *kernel = __atomic_load_n(&active, __ATOMIC_ACQUIRE);
+  if (kernel == NULL) {
+    kernel = best_kernel();
+    __atomic_store_n(&active, kernel, __ATOMIC_RELEASE);
+  }
+  return kernel;
+}
+
+int fuzzy_set_kernel(enum fuzzy_kernel kernel) {
+  if (kernel == FUZZY_KERNEL_AUTO) {
+    __atomic_store_n(&active, best_kernel(), __ATOMIC_RELEASE);
+    return 0;
+  }
+
+  if (!kernel_supported(kernel))
+    return -1;
+
+  __atomic_store_n(&active, &kernels[kernel], __ATOMIC_RELEASE);
+  return 0;
+}
+
+const char *fuzzy_kernel_name(void) { return current_kernel()->name; }
+
+void fuzzy_match_batch(const struct fuzzy_entry *const entries[], int count, const char *pattern,
+                       int patternl, double scores[]) {
+  current_kernel()->batch(entries, count, pattern, patternl, scores);
+}
+
+double fuzzy_match(const struct fuzzy_entry *entry, const char *pattern, int patternl) {
+  double score;
+  current_kernel()->batch(&entry, 1, pattern, patternl, &score);
+  return score;
+}
@@ -0,0 +1,182 @@
+/**
+ * @file stats.c
+ * @brief Implementation of the hot path spans.
+ *
+ * Each thread keeps its innermost open span, so a closing span can hand its
+ * duration to the one it is nested in. Allocations are counted per thread
+ * when the build wraps the allocator (MUSLIMKIT_STATS_ALLOCS, see
+ * CMakeLists.txt); otherwise they are reported as unknown.
+ */
+
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include "utils/stats.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * @brief Totals of one phase.
+ */
+struct stats_totals {
+  uint64_t calls;
+  uint64_t ns;
+  uint64_t max_ns; /**< Longest single span */
+  uint64_t bytes;
+  uint64_t allocs;
+};
+
+static const char *const phase_names[STATS_PHASE_COUNT] = {
+    "dns", "connect", "tls", "transfer", "decode", "parse", "cache", "filter", "render"};
+
+static const char *const counter_names[STATS_COUNTER_COUNT] = {
+    "tls_handshakes", "tls_resumed", "tls_rejected", "tls_not_offered"};
+
+bool stats_enabled = false;
+
+static enum stats_format report_format;
+static uint64_t enabled_at;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct stats_totals totals[STATS_PHASE_COUNT];
+static uint64_t counters[STATS_COUNTER_COUNT];
+
+static _Thread_local struct stats_span *innermost;
+static _Thread_local uint64_t thread_allocs;
+
+#ifdef MUSLIMKIT_STATS_ALLOCS
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  if (stats_enabled)
+    thread_allocs++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  if (stats_enabled)
+    thread_allocs++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  if (stats_enabled)
+    thread_allocs++;
+  return __real_realloc(ptr, size);
+}
+#endif
+
+static uint64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void stats_span_open(struct stats_span *span) {
+  span->start = monotonic_ns();
+  span->nested_ns = 0;
+  span->allocs = thread_allocs;
+  span->nested_allocs = 0;
+  span->outer = innermost;
+  innermost = span;
+}
+
+void stats_span_close(struct stats_span *span, enum stats_phase phase, size_t bytes) {
+  uint64_t elapsed = monotonic_ns() - span->start;
+  uint64_t allocs = thread_allocs - span->allocs;
+
+  innermost = span->outer;
+  if (span->outer != NULL) {
+    span->outer->nested_ns += elapsed;
+    span->outer->nested_allocs += allocs;
+  }
+
+  uint64_t own = elapsed - span->nested_ns;
+  pthread_mutex_lock(&totals_lock);
+  struct stats_totals *phase_totals = &totals[phase];
+  phase_totals->calls++;
+  phase_totals->ns += own;
+  if (own > phase_totals->max_ns)
+    phase_totals->max_ns = own;
+  phase_totals->bytes += bytes;
+  phase_totals->allocs += allocs - span->nested_allocs;
+  pthread_mutex_unlock(&totals_lock);
+}
+
+void stats_counter_add(enum stats_counter counter) {
+  pthread_mutex_lock(&totals_lock);
+  counters[counter]++;
+  pthread_mutex_unlock(&totals_lock);
+}
+
+static void report_at_exit(void) { stats_report(stderr, report_format); }
+
+void stats_enable(enum stats_format format) {
+  if (stats_enabled)
+    return;
+
+  report_format = format;
+  enabled_at = monotonic_ns();
+  stats_enabled = true;
+  atexit(report_at_exit);
+}
+
+void stats_report(FILE *out, enum stats_format format) {
+  struct stats_totals copy[STATS_PHASE_COUNT];
+  uint64_t counts[STATS_COUNTER_COUNT];
+  pthread_mutex_lock(&totals_lock);
+  for (int i = 0; i < STATS_PHASE_COUNT; i++)
+    copy[i] = totals[i];
+  for (int i = 0; i < STATS_COUNTER_COUNT; i++)
+    counts[i] = counters[i];
+  pthread_mutex_unlock(&totals_lock);
+
+  double wall_ms = enabled_at ? (monotonic_ns() - enabled_at) / 1e6 : 0.0;
+#ifdef MUSLIMKIT_STATS_ALLOCS
+  bool counted = true;
+#else
+  bool counted = false;
+#endif
+
+  if (format == STATS_JSON) {
+    fprintf(out, "{\"wall_ms\":%.3f,\"allocs_counted\":%s,\"phases\":{", wall_ms,
+            counted ? "true" : "false");
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+      fprintf(out,
+              "%s\"%s\":{\"calls\":%llu,\"total_ms\":%.3f,\"max_ms\":%.3f,\"bytes\":%llu,"
+              "\"allocs\":%llu}",
+              i ? "," : "", phase_names[i], (unsigned long long)copy[i].calls, copy[i].ns / 1e6,
+              copy[i].max_ns / 1e6, (unsigned long long)copy[i].bytes,
+              (unsigned long long)copy[i].allocs);
+    }
+    fprintf(out, "},\"counters\":{");
+    for (int i = 0; i < STATS_COUNTER_COUNT; i++)
+      fprintf(out, "%s\"%s\":%llu", i ? "," : "", counter_names[i], (unsigned long long)counts[i]);
+    fprintf(out, "}}\n");
+    return;
+  }
+
+  fprintf(out, "%-10s %8s %12s %10s %12s %8s\n", "phase", "calls", "total ms", "max ms", "bytes",
+          "allocs");
+  for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+    if (copy[i].calls == 0)
+      continue;
+
+    fprintf(out, "%-10s %8llu %12.3f %10.3f %12llu", phase_names[i],
+            (unsigned long long)copy[i].calls, copy[i].ns / 1e6, copy[i].max_ns / 1e6,
+            (unsigned long long)copy[i].bytes);
+    if (counted)
+      fprintf(out, " %8llu\n", (unsigned long long)copy[i].allocs);
+    else
+      fprintf(out, " %8s\n", "-");
+  }
+  fprintf(out, "%-10s %8s %12.3f\n", "wall", "", wall_ms);
+
+  if (counts[STATS_TLS_HANDSHAKES] > 0)
+    fprintf(out, "tls handshakes %llu: %llu resumed, %llu sessions rejected, %llu not offered\n",
+            (unsigned long long)counts[STATS_TLS_HANDSHAKES],
+            (unsigned long long)counts[STATS_TLS_RESUMED],
+            (unsigned long long)counts[STATS_TLS_REJECTED],
+            (unsigned long long)counts[STATS_TLS_NOT_OFFERED]);
+}
@@ -1,3 +1,5 @@
+#define _DEFAULT_SOURCE /* tm_gmtoff, timegm */
+
 #include "utils/tmutils.h"
 #include <stdio.h>
 #include <string.h>
@@ -8,15 +10,92 @@ void get_current_time(struct tmutils *dest) {
     fprintf(stderr, "get_current_time ERROR: destination NULL");
     return;
   }
-  time_t now = time(NULL);
-  struct tm *t = localtime(&now);
+  get_time_at(time(NULL), dest);
+}
 
+void get_time_at(time_t when, struct tmutils *dest) {
+  if (dest == NULL) {
+    fprintf(stderr, "get_time_at ERROR: destination NULL");
+    return;
+  }
+  struct tm t;
   memset(dest, 0, sizeof(*dest));
+  if (localtime_r(&when, &t) == NULL)
+    return;
 
-  dest->year = t->tm_year + 1900;
-  dest->month = t->tm_mon + 1;
-  dest->days = t->tm_mday;
-  dest->hours = t->tm_hour;
-  dest->minutes = t->tm_min;
-  dest->seconds = t->tm_sec;
+  dest->year = t.tm_year + 1900;
+  dest->month = t.tm_mon + 1;
+  dest->days = t.tm_mday;
+  dest->hours = t.tm_hour;
+  dest->minutes = t.tm_min;
+  dest->seconds = t.tm_sec;
+}
+
+time_t local_time_at(int year, int month, int day, int hours, int minutes) {
+  struct tm t;
+  memset(&t, 0, sizeof(t));
+  t.tm_year = year - 1900;
+  t.tm_mon = month - 1;
+  t.tm_mday = day;
+  t.tm_hour = hours;
+  t.tm_min = minutes;
+  t.tm_isdst = -1; /* Let mktime() find out for that date */
+  return mktime(&t);
+}
+
+void get_zone_time_at(time_t when, long utc_offset, struct tmutils *dest) {
+  if (utc_offset == TMUTILS_LOCAL_ZONE) {
+    get_time_at(when, dest);
+    return;
+  }
+  if (dest == NULL) {
+    fprintf(stderr, "get_zone_time_at ERROR: destination NULL");
+    return;
+  }
+
+  /* The wall clock at the offset is UTC shifted by it */
+  struct tm t;
+  time_t shifted = when + utc_offset;
+  memset(dest, 0, sizeof(*dest));
+  if (gmtime_r(&shifted, &t) == NULL)
+    return;
+
+  dest->year = t.tm_year + 1900;
+  dest->month = t.tm_mon + 1;
+  dest->days = t.tm_mday;
+  dest->hours = t.tm_hour;
+  dest->minutes = t.tm_min;
+  dest->seconds = t.tm_sec;
+}
+
+time_t zone_time_at(int year, int month, int day, int hours, int minutes, long utc_offset) {
+  if (utc_offset == TMUTILS_LOCAL_ZONE)
+    return local_time_at(year, month, day, hours, minutes);
+
+  struct tm t;
+  memset(&t, 0, sizeof(t));
+  t.tm_year = year - 1900;
+  t.tm_mon = month - 1;
+  t.tm_mday = day;
+  t.tm_hour = hours;
+  t.tm_min = minutes;
+  time_t utc = timegm(&t);
+  return utc == (time_t)-1 ? utc : utc - utc_offset;
+}
+
+int days_in_month(int year, int month) {
+  static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  if (month < 1 || month > 12)
+    return 0;
+
+  int leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+  return (month == 2 && leap) ? 29 : days[month - 1];
+}
+
+long get_utc_offset(void) {
+  time_t now = time(NULL);
+  struct tm local;
+  if (localtime_r(&now, &local) == NULL)
+    return 0;
+  return local.tm_gmtoff;
 }